@@ -0,0 +1,97 @@
+#ifndef _ADV_POLICY_HPP_
+#define _ADV_POLICY_HPP_
+
+#include <cstdint>
+
+/**
+ * @brief Advertising phases between two connections.
+ *
+ * @details Advertising starts with high duty directed advertising toward the bonded central,
+ *          if there is one, which the controller ends after 1.28 s. Fast undirected advertising
+ *          follows for fast_ms, then slow advertising until a central connects. Every boot and
+ *          every disconnection starts over from the first phase. The time from a disconnection
+ *          to the next connection is measured for the reconnection statistics.
+*/
+class AdvPolicy {
+public:
+  enum class Phase : uint8_t {
+    // Connected, or advertising not started yet.
+    NONE,
+    DIRECTED,
+    FAST,
+    SLOW,
+  };
+
+  explicit constexpr AdvPolicy(uint32_t fast_ms) : fast_ms_(fast_ms) {}
+
+  /**
+   * @brief Start over from the first phase.
+   *
+   * @param bonded Whether a bonded central can be advertised to.
+   *
+   * @return The phase to advertise in.
+  */
+  Phase start(bool bonded) {
+    phase_ = bonded ? Phase::DIRECTED : Phase::FAST;
+    return phase_;
+  }
+
+  /**
+   * @brief Move on once the current phase ended without a connection.
+   *
+   * @return The phase to advertise in. Slow advertising goes on until a connection.
+  */
+  Phase next() {
+    switch (phase_) {
+    case Phase::DIRECTED:
+      phase_ = Phase::FAST;
+      break;
+    case Phase::FAST:
+    case Phase::SLOW:
+      phase_ = Phase::SLOW;
+      break;
+    case Phase::NONE:
+      break;
+    }
+    return phase_;
+  }
+
+  // The link went down at now_ms. The next connection counts as a reconnection.
+  void disconnected(int64_t now_ms) {
+    down_at_ = now_ms;
+  }
+
+  /**
+   * @brief A central connected.
+   *
+   * @param now_ms The uptime in milliseconds.
+   *
+   * @return The time since the disconnection in milliseconds, or -1 for the first connection
+   *         since boot.
+  */
+  int64_t connected(int64_t now_ms) {
+    int64_t latency = (down_at_ < 0) ? -1 : now_ms - down_at_;
+
+    phase_ = Phase::NONE;
+    down_at_ = -1;
+    return latency;
+  }
+
+  Phase phase() const {
+    return phase_;
+  }
+
+  // How long fast advertising lasts before it slows down.
+  uint32_t fast_ms() const {
+    return fast_ms_;
+  }
+
+private:
+  uint32_t fast_ms_;
+  Phase phase_{Phase::NONE};
+
+  // Uptime of the last disconnection, -1 if none since the last connection.
+  int64_t down_at_{-1};
+};
+
+#endif // _ADV_POLICY_HPP_
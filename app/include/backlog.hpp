@@ -0,0 +1,149 @@
+#ifndef _BACKLOG_HPP_
+#define _BACKLOG_HPP_
+
+#include "spsc_ring.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Bounded store for a byte stream waiting for its link.
+ *
+ * @details The data is kept in records of at most MAX_RECORD bytes, each behind a 2 byte
+ *          length, so that a full backlog drops whole pieces of the stream as they were pushed
+ *          rather than a few bytes off an arbitrary edge. Reading ignores the record bounds and
+ *          returns the stream as it was pushed.
+ *
+ *          Both sides must be called from the same thread. The ring is only used for its
+ *          wrap-around handling.
+ *
+ * @tparam Capacity The size in bytes, record headers included. Must be a power of two.
+*/
+template<size_t Capacity>
+class Backlog {
+public:
+  enum class Policy : uint8_t {
+    // Make room by dropping the oldest records.
+    DROP_OLDEST,
+    // Drop the data being pushed.
+    DROP_NEWEST,
+  };
+
+  static constexpr size_t capacity = Capacity;
+
+  explicit Backlog(Policy policy) : policy_(policy) {}
+
+  Backlog(const Backlog&) = delete;
+  Backlog& operator=(const Backlog&) = delete;
+
+  /**
+   * @brief Store data at the end of the backlog.
+   *
+   * @param data The data.
+   * @param len The length of the data.
+   *
+   * @return The number of bytes dropped to keep within the capacity, old or new.
+  */
+  size_t push(const uint8_t *data, size_t len) {
+    size_t dropped = 0;
+
+    for (size_t pos = 0; pos < len;) {
+      uint16_t chunk = static_cast<uint16_t>((len - pos < MAX_RECORD) ? len - pos : MAX_RECORD);
+
+      while ((ring_.space() < sizeof(chunk) + chunk) && (policy_ == Policy::DROP_OLDEST)) {
+        dropped += drop_record();
+      }
+      if (ring_.space() < sizeof(chunk) + chunk) {
+        dropped += chunk;
+      } else {
+        ring_.stage(reinterpret_cast<const uint8_t *>(&chunk), sizeof(chunk));
+        ring_.stage(&data[pos], chunk);
+        ring_.write_commit(sizeof(chunk) + chunk);
+      }
+
+      pos += chunk;
+    }
+
+    return dropped;
+  }
+
+  /**
+   * @brief Take data from the start of the backlog.
+   *
+   * @param buf The destination.
+   * @param size The largest number of bytes to take.
+   *
+   * @return The number of bytes taken.
+  */
+  size_t read(uint8_t *buf, size_t size) {
+    size_t len = 0;
+
+    while (len < size) {
+      if (left_ == 0) {
+        uint16_t hdr;
+        if (ring_.read(reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr)) != sizeof(hdr)) {
+          break;
+        }
+        left_ = hdr;
+        continue;
+      }
+
+      size_t chunk = ring_.read(&buf[len], (size - len < left_) ? size - len : left_);
+      len += chunk;
+      left_ -= chunk;
+    }
+
+    return len;
+  }
+
+  // True if len bytes can be pushed without dropping any.
+  bool fits(size_t len) const {
+    size_t records = (len + MAX_RECORD - 1) / MAX_RECORD;
+    return ring_.space() >= len + records * sizeof(uint16_t);
+  }
+
+  // Bytes stored, record headers included.
+  size_t size() const {
+    return ring_.size();
+  }
+
+  bool empty() const {
+    return ring_.empty();
+  }
+
+private:
+  // Small enough that dropping one record frees a useful amount without losing most of the backlog.
+  static constexpr size_t MAX_RECORD = ((Capacity / 4) < UINT16_MAX) ? (Capacity / 4) : UINT16_MAX;
+  static_assert(MAX_RECORD > 0, "Backlog capacity too small");
+
+  /**
+   * @brief Drop the oldest record, or what is left of the one being read.
+   *
+   * @return The number of data bytes dropped.
+  */
+  size_t drop_record() {
+    size_t len = left_;
+
+    if (len == 0) {
+      uint16_t hdr = 0;
+      (void)ring_.read(reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr));
+      len = hdr;
+    }
+    left_ = 0;
+
+    for (size_t skipped = 0; skipped < len;) {
+      auto span = ring_.read_claim(len - skipped);
+      ring_.read_commit(span.len);
+      skipped += span.len;
+    }
+
+    return len;
+  }
+
+  SpscRing<Capacity> ring_;
+  Policy policy_;
+
+  // Data bytes left in the record being read.
+  size_t left_{0};
+};
+
+#endif // _BACKLOG_HPP_
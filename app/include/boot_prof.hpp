@@ -0,0 +1,52 @@
+#ifndef _BOOT_PROF_HPP_
+#define _BOOT_PROF_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Startup stages, timed from the start of the system clock, shortly after reset.
+ *
+ * @details The stages run in parallel where they can, so they do not complete in this order.
+ *          - MAIN: main() entered, the kernel and the drivers are up.
+ *          - BT_ENABLED: the Bluetooth stack and controller are ready.
+ *          - SETTINGS_LOADED: the bonds and the other settings are loaded.
+ *          - ADVERTISING: the first advertising started.
+ *          - UART_RX: UART reception enabled.
+ *          - NUS_READY: the NUS callbacks registered and the NUS task queued.
+*/
+enum class BootStage : uint8_t {
+  MAIN,
+  BT_ENABLED,
+  SETTINGS_LOADED,
+  ADVERTISING,
+  UART_RX,
+  NUS_READY,
+  COUNT,
+};
+
+constexpr size_t BOOT_STAGE_COUNT = static_cast<size_t>(BootStage::COUNT);
+
+#if defined(CONFIG_APP_BOOT_PROFILE)
+
+// Record the time of a stage, once per boot. Logs the profile once every stage is reached.
+// Safe to call from any thread.
+void boot_mark(BootStage stage);
+
+// Time of a stage in microseconds, or -1 if it was not reached yet.
+int64_t boot_stage_us(BootStage stage);
+
+#else
+
+static inline void boot_mark(BootStage stage) {
+  (void)stage;
+}
+
+static inline int64_t boot_stage_us(BootStage stage) {
+  (void)stage;
+  return -1;
+}
+
+#endif
+
+#endif // _BOOT_PROF_HPP_
@@ -0,0 +1,173 @@
+#ifndef _CHANNEL_MUX_HPP_
+#define _CHANNEL_MUX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Logical channels over one link.
+ *
+ * @details With multiplexing, every notification and every write is a run of records:
+ *
+ *            record = channel | len | data x len
+ *
+ *          The channel id and the data length take one byte each. A notification or a write
+ *          holds whole records, except in a compressed stream: there the records are the
+ *          decoded bytes and may span blocks.
+*/
+constexpr size_t MUX_HDR_SIZE = 2;
+constexpr size_t MUX_MAX_RECORD = UINT8_MAX;
+
+/**
+ * @brief Packs the data of several channels into one buffer.
+ *
+ * @details Data of the channel written last extends its record, so a byte stream written in
+ *          small pieces costs one header per record rather than one per piece.
+*/
+class MuxWriter {
+public:
+  MuxWriter(uint8_t *buf, size_t size) : buf_(buf), size_(size) {}
+
+  /**
+   * @brief Append data of a channel.
+   *
+   * @param channel The channel id.
+   * @param data The data.
+   * @param len The length of the data.
+   *
+   * @return The number of bytes taken, fewer than len once the buffer is full.
+  */
+  size_t write(uint8_t channel, const uint8_t *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+      if (!open_ || (buf_[last_] != channel) || (buf_[last_ + 1] == MUX_MAX_RECORD)) {
+        if (full()) {
+          break;
+        }
+        last_ = len_;
+        open_ = true;
+        buf_[len_++] = channel;
+        buf_[len_++] = 0;
+      }
+
+      size_t chunk = len - done;
+      chunk = (chunk < size_ - len_) ? chunk : size_ - len_;
+      chunk = (chunk < MUX_MAX_RECORD - buf_[last_ + 1]) ? chunk : MUX_MAX_RECORD - buf_[last_ + 1];
+      if (chunk == 0) {
+        break;
+      }
+
+      memcpy(&buf_[len_], &data[done], chunk);
+      buf_[last_ + 1] += static_cast<uint8_t>(chunk);
+      len_ += chunk;
+      done += chunk;
+    }
+
+    return done;
+  }
+
+  // True once a new record would not fit with any data.
+  bool full() const {
+    return size_ - len_ <= MUX_HDR_SIZE;
+  }
+
+  // Bytes written, record headers included.
+  size_t len() const {
+    return len_;
+  }
+
+private:
+  uint8_t *buf_;
+  size_t size_;
+  size_t len_{0};
+
+  // Offset of the last record, if any.
+  size_t last_{0};
+  bool open_{false};
+};
+
+/**
+ * @brief Splits a run of records into the data of each channel.
+ *
+ * @details Works on a stream: a record may come in several pieces, and each piece is passed to
+ *          the sink as it comes.
+*/
+class MuxParser {
+public:
+  using Sink = void (*)(uint8_t channel, const uint8_t *data, size_t len);
+
+  /**
+   * @brief Parse the next bytes of the stream.
+   *
+   * @param data The bytes.
+   * @param len The number of bytes.
+   * @param sink Gets the data of the records. Not called for empty records.
+  */
+  void feed(const uint8_t *data, size_t len, Sink sink) {
+    for (size_t pos = 0; pos < len;) {
+      switch (state_) {
+      case State::CHANNEL:
+        channel_ = data[pos++];
+        state_ = State::LEN;
+        break;
+      case State::LEN:
+        left_ = data[pos++];
+        state_ = (left_ > 0) ? State::DATA : State::CHANNEL;
+        break;
+      case State::DATA: {
+        size_t chunk = (len - pos < left_) ? len - pos : left_;
+        sink(channel_, &data[pos], chunk);
+        pos += chunk;
+        left_ -= chunk;
+        if (left_ == 0) {
+          state_ = State::CHANNEL;
+        }
+        break;
+      }
+      }
+    }
+  }
+
+  // True between records.
+  bool idle() const {
+    return state_ == State::CHANNEL;
+  }
+
+  // Drop the rest of the record being parsed.
+  void reset() {
+    state_ = State::CHANNEL;
+    left_ = 0;
+  }
+
+  /**
+   * @brief Check that a buffer holds whole records.
+   *
+   * @param data The buffer.
+   * @param len The length of the buffer.
+   *
+   * @return True if the last record ends with the buffer.
+  */
+  static bool whole(const uint8_t *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos + MUX_HDR_SIZE <= len) {
+      pos += MUX_HDR_SIZE + data[pos + 1];
+    }
+    return pos == len;
+  }
+
+private:
+  enum class State : uint8_t {
+    CHANNEL,
+    LEN,
+    DATA,
+  };
+
+  State state_{State::CHANNEL};
+  uint8_t channel_{0};
+  size_t left_{0};
+};
+
+#endif // _CHANNEL_MUX_HPP_
@@ -0,0 +1,149 @@
+#ifndef _COMPRESS_HPP_
+#define _COMPRESS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Compression of the BLE payload.
+ *
+ * @details OFF sends the data as is. LZ sends every notification, and expects every write,
+ *          as one block of an LZSS stream:
+ *
+ *            header | group | group | ...
+ *            group = flags | token x up to 8
+ *
+ *          Bit 0 of the header tells the decoder to clear its window first. Bit n of flags
+ *          is 0 when token n is a literal byte and 1 when it is a match of two bytes, the
+ *          distance minus 1 and the length minus LZ_MIN_MATCH. Matches reach back over the
+ *          previous blocks, up to the window size. Tokens never span blocks.
+*/
+enum class CompressMode : uint8_t {
+  OFF = 0,
+  LZ = 1,
+};
+
+constexpr uint8_t LZ_BLOCK_RESET = 0x01;
+constexpr size_t LZ_MIN_MATCH = 3;
+constexpr size_t LZ_MAX_MATCH = LZ_MIN_MATCH + UINT8_MAX;
+
+#if defined(CONFIG_APP_COMPRESS)
+
+constexpr size_t LZ_WINDOW = CONFIG_APP_COMPRESS_WINDOW;
+constexpr size_t LZ_HASH_BITS = 6;
+
+static_assert((LZ_WINDOW & (LZ_WINDOW - 1)) == 0, "LZ window size must be a power of two");
+static_assert(LZ_WINDOW <= 256, "LZ distances are encoded in one byte");
+
+/**
+ * @brief Snapshot of the compression counters.
+ *
+ * @details in and out are before and after the codec, so out/in is the compression ratio
+ *          for TX and its inverse for RX. The CPU time includes handing the decoded data on.
+*/
+struct CompressStats {
+  uint32_t tx_in_bytes;
+  uint32_t tx_out_bytes;
+  uint32_t tx_cpu_us;
+  uint32_t rx_in_bytes;
+  uint32_t rx_out_bytes;
+  uint32_t rx_cpu_us;
+  uint32_t rx_errors;
+};
+
+/**
+ * @brief Streaming LZSS encoder.
+ *
+ * @details Keeps the last LZ_WINDOW bytes and a small hash table of 3 byte prefixes, about
+ *          LZ_WINDOW + 256 bytes in all. The blocks are built in a buffer owned by the caller.
+*/
+class LzEncoder {
+public:
+  LzEncoder() {
+    reset();
+  }
+
+  // Start a block in out. size must be at least 4: the header and one token group.
+  void begin(uint8_t *out, size_t size);
+
+  // Compress in into the block. Returns the bytes consumed, fewer than len once it is full.
+  size_t write(const uint8_t *in, size_t len);
+
+  // Finish the block. Returns its length, header included.
+  size_t end();
+
+  // True between begin() and end().
+  bool started() const {
+    return out != nullptr;
+  }
+
+  // True once the next token may not fit.
+  bool full() const {
+    return out_size - out_len < 3;
+  }
+
+  // Forget the history. The next block tells the decoder to do the same. Not within a block.
+  void reset();
+
+private:
+  uint8_t window[LZ_WINDOW];
+  uint32_t hash[1 << LZ_HASH_BITS];
+  // Bytes compressed since the last reset.
+  uint32_t pos{0};
+  bool reset_pending{true};
+
+  uint8_t *out{nullptr};
+  size_t out_size{0};
+  size_t out_len{0};
+  size_t flags_pos{0};
+  uint8_t flags_bit{0};
+
+  void token(bool match);
+  void push(const uint8_t *in, size_t len);
+};
+
+/**
+ * @brief Streaming LZSS decoder.
+ *
+ * @details Decodes into its window and passes the output to a sink in chunks.
+*/
+class LzDecoder {
+public:
+  using Sink = void (*)(const uint8_t *data, size_t len);
+
+  // Decode one block. Returns 0, or -EINVAL if it is corrupt. The window is cleared then.
+  int decode(const uint8_t *in, size_t len, Sink sink);
+
+  void reset();
+
+private:
+  uint8_t window[LZ_WINDOW];
+  // Bytes decoded since the last reset, and how many of them went to the sink.
+  uint32_t pos{0};
+  uint32_t flushed{0};
+
+  void put(uint8_t byte, Sink sink);
+  void flush(Sink sink);
+};
+
+// Compression of a connection, by bt_conn_index(). Safe to call from any context.
+CompressMode compress_get_mode(size_t conn);
+void compress_set_mode(size_t conn, CompressMode mode);
+
+// Start a new stream in both directions of a connection. Called when it connects, when its
+// mode changes and when it misses a block.
+void compress_new_session(size_t conn);
+
+// Changes whenever a new stream of the connection starts, so its codecs know when to reset.
+uint32_t compress_session(size_t conn);
+
+// Update the counters. cycles is the CPU time spent in the codec.
+void compress_count_tx(size_t in_bytes, size_t out_bytes, uint32_t cycles);
+void compress_count_rx(size_t in_bytes, size_t out_bytes, uint32_t cycles, bool error);
+
+// Read the compression counters.
+CompressStats compress_get_stats();
+
+#endif // CONFIG_APP_COMPRESS
+
+#endif // _COMPRESS_HPP_
@@ -0,0 +1,76 @@
+#ifndef _CONN_POLICY_HPP_
+#define _CONN_POLICY_HPP_
+
+#include <cstdint>
+
+/**
+ * @brief Choice between the fast and the idle connection parameters.
+ *
+ * @details Fed with the fill level of the queues between the UART and BLE at a fixed period.
+ *          It switches to FAST as soon as the fill reaches busy_pct, and back to IDLE once the
+ *          fill has stayed at or below idle_pct for idle_ms. The gap between the two levels
+ *          and the idle time keep short bursts from flapping the link. A new connection starts
+ *          in CENTRAL, with the parameters the central chose, and leaves it the same way.
+*/
+class ConnPolicy {
+public:
+  enum class Mode : uint8_t {
+    CENTRAL,
+    FAST,
+    IDLE,
+  };
+
+  struct Config {
+    uint32_t busy_pct;
+    uint32_t idle_pct;
+    uint32_t idle_ms;
+  };
+
+  explicit constexpr ConnPolicy(const Config &config) : config_(config) {}
+
+  // Start over for a new connection.
+  void reset(int64_t now_ms) {
+    mode_ = Mode::CENTRAL;
+    busy_at_ = now_ms;
+  }
+
+  /**
+   * @brief Take one sample of the queue fill.
+   *
+   * @param fill_pct The fill of the fullest queue in percent.
+   * @param now_ms The uptime in milliseconds.
+   *
+   * @return True if the mode changed and the new parameters should be requested.
+  */
+  bool update(uint32_t fill_pct, int64_t now_ms) {
+    if (fill_pct > config_.idle_pct) {
+      busy_at_ = now_ms;
+    }
+
+    Mode next = mode_;
+    if (fill_pct >= config_.busy_pct) {
+      next = Mode::FAST;
+    } else if ((now_ms - busy_at_) >= config_.idle_ms) {
+      next = Mode::IDLE;
+    }
+
+    if (next == mode_) {
+      return false;
+    }
+    mode_ = next;
+    return true;
+  }
+
+  Mode mode() const {
+    return mode_;
+  }
+
+private:
+  Config config_;
+  Mode mode_{Mode::CENTRAL};
+
+  // Last sample above idle_pct.
+  int64_t busy_at_{0};
+};
+
+#endif // _CONN_POLICY_HPP_
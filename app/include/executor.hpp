@@ -0,0 +1,459 @@
+#ifndef _EXECUTOR_HPP_
+#define _EXECUTOR_HPP_
+
+#include <errno.h>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/slist.h>
+
+/**
+ * @brief Memory for the frames of the coroutines a task awaits.
+ *
+ * @details A coroutine completes before the one awaiting it goes on, so the frames of a task
+ *          come and go like a stack and are taken from the top of a fixed buffer: no search,
+ *          no fragmentation, and the same use for the same path every time. The tasks
+ *          interleave, so each one that awaits coroutines has an arena of its own.
+*/
+class FrameArena {
+public:
+  FrameArena(uint8_t *buf, size_t size) : buf_(buf), size_(size) {
+  }
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  // A frame of at least size bytes, or nullptr if the arena is full.
+  void *alloc(size_t size);
+
+  // Release the newest frame. Returns false, and keeps the frame, for any other.
+  bool free(void *ptr);
+
+  bool owns(const void *ptr) const {
+    return (ptr >= buf_) && (ptr < buf_ + size_);
+  }
+
+  // The most bytes in use at once, frame headers included.
+  size_t high_water() const {
+    return high_water_;
+  }
+
+private:
+  static constexpr size_t NO_FRAME = SIZE_MAX;
+
+  uint8_t *buf_;
+  size_t size_;
+  size_t used_{0};
+  // Offset of the newest frame.
+  size_t top_{NO_FRAME};
+  size_t high_water_{0};
+};
+
+/**
+ * @brief A FrameArena with its buffer.
+ *
+ * @tparam Size The size of the buffer in bytes.
+*/
+template<size_t Size>
+class StaticFrameArena : public FrameArena {
+public:
+  StaticFrameArena() : FrameArena(storage_, Size) {
+  }
+
+private:
+  alignas(std::max_align_t) uint8_t storage_[Size];
+};
+
+/**
+ * @brief Cooperative executor for the application tasks.
+ *
+ * @details Every task is a C++20 coroutine resumed by one executor thread, so all tasks
+ *          share its stack instead of owning a thread each. A task that waits co_awaits
+ *          one of the awaitables below. The executor then k_polls the objects its tasks
+ *          wait on and resumes each task once its object is ready or its timeout expires.
+ *
+ *          The frames of the tasks are made once, when they start, from a dedicated heap of
+ *          CONFIG_APP_TASK_HEAP_SIZE bytes. The frames of the coroutines a task awaits come
+ *          from the FrameArena it was spawned with. A frame that does not fit is reported,
+ *          and the coroutine is not run: see Task.
+ *          Tasks must not block in kernel calls: one blocked task stalls them all.
+*/
+class Executor {
+public:
+  /**
+   * @brief Queue a task to be resumed by the executor.
+   *
+   * @details The task object must outlive the coroutine. Safe to call from any thread.
+   *
+   * @param handle The coroutine to resume.
+   * @param arena The arena of the coroutines it awaits, or nullptr if it awaits none.
+   *
+   * @return 0, or -ENOMEM if too many tasks are queued.
+  */
+  static int spawn(std::coroutine_handle<> handle, FrameArena *arena);
+
+  /**
+   * @brief Allocate and free coroutine frames.
+   *
+   * @details On the executor thread the frames come from the arena of the running task,
+   *          elsewhere from the task heap.
+   *
+   * @return The frame, or nullptr if it does not fit.
+  */
+  static void *alloc_frame(size_t size) noexcept;
+  static void free_frame(void *ptr) noexcept;
+
+  /**
+   * @brief Run the tasks on the calling thread. Never returns.
+   *
+   * @details Called by the executor thread.
+  */
+  static void run();
+
+private:
+  friend class Waiter;
+
+  static void wait(class Waiter *waiter);
+};
+
+template<typename T = void>
+class Task;
+
+namespace task_detail {
+
+/**
+ * @brief Promise parts common to every Task.
+ *
+ * @details Tasks start suspended. When one completes, the coroutine awaiting it, if any,
+ *          resumes in its place.
+*/
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+
+  static void *operator new(size_t size) noexcept {
+    return Executor::alloc_frame(size);
+  }
+
+  static void operator delete(void *ptr) noexcept {
+    Executor::free_frame(ptr);
+  }
+
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      std::coroutine_handle<> next = handle.promise().continuation;
+      return next ? next : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {
+    }
+  };
+
+  std::suspend_always initial_suspend() const noexcept {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() const noexcept {
+    return {};
+  }
+
+  void unhandled_exception() const noexcept {
+    k_panic();
+  }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+  T value{};
+
+  Task<T> get_return_object() noexcept;
+
+  static Task<T> get_return_object_on_allocation_failure() noexcept;
+
+  void return_value(T result) noexcept {
+    value = std::move(result);
+  }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object() noexcept;
+
+  static Task<void> get_return_object_on_allocation_failure() noexcept;
+
+  void return_void() const noexcept {
+  }
+};
+
+} // namespace task_detail
+
+/**
+ * @brief A coroutine run by the Executor.
+ *
+ * @details Owns the coroutine frame. A task is either spawned on the executor or
+ *          co_awaited by another task, which resumes when it completes. If there was no
+ *          memory for its frame, the coroutine never runs: spawn() fails, and co_await
+ *          completes at once with -ENOMEM for a Task<int> or a value-initialized T otherwise.
+ *
+ * @tparam T The type returned by co_return.
+*/
+template<typename T>
+class [[nodiscard]] Task {
+public:
+  using promise_type = task_detail::Promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+
+  explicit Task(handle_type handle) : handle(handle) {
+  }
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {
+  }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    destroy();
+  }
+
+  /**
+   * @brief Queue the task on the executor.
+   *
+   * @param arena The arena of the coroutines the task awaits, or nullptr if it awaits none.
+   *
+   * @return True if the task was queued.
+  */
+  bool spawn(FrameArena *arena = nullptr) {
+    return handle && (Executor::spawn(handle, arena) == 0);
+  }
+
+  bool done() const {
+    return !handle || handle.done();
+  }
+
+  bool await_ready() const noexcept {
+    return done();
+  }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+
+  T await_resume() noexcept {
+    if constexpr (std::is_same_v<T, int>) {
+      return handle ? handle.promise().value : -ENOMEM;
+    } else if constexpr (!std::is_void_v<T>) {
+      return handle ? std::move(handle.promise().value) : T{};
+    }
+  }
+
+private:
+  handle_type handle;
+
+  void destroy() {
+    if (handle) {
+      handle.destroy();
+      handle = nullptr;
+    }
+  }
+};
+
+template<typename T>
+Task<T> task_detail::Promise<T>::get_return_object() noexcept {
+  return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> task_detail::Promise<void>::get_return_object() noexcept {
+  return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+template<typename T>
+Task<T> task_detail::Promise<T>::get_return_object_on_allocation_failure() noexcept {
+  return Task<T>();
+}
+
+inline Task<void> task_detail::Promise<void>::get_return_object_on_allocation_failure() noexcept {
+  return Task<void>();
+}
+
+/**
+ * @brief Base of the awaitables.
+ *
+ * @details A waiter lives in the frame of the suspended task until the executor resumes it,
+ *          so nothing is allocated per wait. The derived class tries its operation without
+ *          waiting first and only suspends when that fails. Once its object is signalled the
+ *          executor tries the operation again through complete(). If another context took
+ *          the object first, the task keeps waiting until its timeout, so a wait without
+ *          timeout only ends once the operation succeeded.
+*/
+class Waiter {
+public:
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> caller) noexcept {
+    handle = caller;
+    Executor::wait(this);
+  }
+
+protected:
+  /**
+   * @param type The K_POLL_TYPE_* event to wait for, or K_POLL_TYPE_IGNORE for a plain timeout.
+   * @param obj The kernel object polled for the event.
+   * @param timeout How long to wait.
+  */
+  Waiter(uint32_t type, void *obj, k_timeout_t timeout) : wait_time(timeout), type(type), obj(obj) {
+  }
+
+  /**
+   * @brief Try the operation without waiting.
+   *
+   * @details Called on the executor thread before the task is resumed.
+   *
+   * @return True once it succeeded, or if there is no operation to try.
+  */
+  virtual bool complete() {
+    return true;
+  }
+
+  k_timeout_t wait_time;
+
+private:
+  friend class Executor;
+
+  sys_snode_t node{};
+  uint32_t type;
+  void *obj;
+  // Arena of the waiting task, for the coroutines it awaits once resumed.
+  FrameArena *arena{nullptr};
+  int64_t deadline{0};
+  bool ready{false};
+  std::coroutine_handle<> handle;
+};
+
+/**
+ * @brief Get the next item of a k_fifo.
+ *
+ * @details co_await yields the item, or nullptr on timeout. Never nullptr with K_FOREVER.
+*/
+class FifoGet : public Waiter {
+public:
+  explicit FifoGet(struct k_fifo *fifo, k_timeout_t timeout = K_FOREVER)
+    : Waiter(K_POLL_TYPE_FIFO_DATA_AVAILABLE, fifo, timeout), fifo(fifo) {
+  }
+
+  bool await_ready() noexcept {
+    return complete() || K_TIMEOUT_EQ(wait_time, K_NO_WAIT);
+  }
+
+  void *await_resume() noexcept {
+    return item;
+  }
+
+protected:
+  bool complete() override {
+    item = k_fifo_get(fifo, K_NO_WAIT);
+    return item != nullptr;
+  }
+
+private:
+  struct k_fifo *fifo;
+  void *item{nullptr};
+};
+
+/**
+ * @brief Take a k_sem.
+ *
+ * @details co_await yields 0 once taken, or -EAGAIN on timeout. Like k_sem_take(), it only
+ *          returns once taken with K_FOREVER. The SPSC rings are awaited this way, through the
+ *          semaphore their producer gives after every write.
+*/
+class SemTake : public Waiter {
+public:
+  explicit SemTake(struct k_sem *sem, k_timeout_t timeout = K_FOREVER)
+    : Waiter(K_POLL_TYPE_SEM_AVAILABLE, sem, timeout), sem(sem) {
+  }
+
+  bool await_ready() noexcept {
+    return complete() || K_TIMEOUT_EQ(wait_time, K_NO_WAIT);
+  }
+
+  int await_resume() noexcept {
+    return (err == 0) ? 0 : -EAGAIN;
+  }
+
+protected:
+  bool complete() override {
+    err = k_sem_take(sem, K_NO_WAIT);
+    return err == 0;
+  }
+
+private:
+  struct k_sem *sem;
+  int err{0};
+};
+
+/**
+ * @brief Get the next message of a k_msgq.
+ *
+ * @details co_await yields 0 once the message is copied to data, or -EAGAIN on timeout.
+ *          Like k_msgq_get(), it only returns once a message was copied with K_FOREVER.
+*/
+class MsgqGet : public Waiter {
+public:
+  MsgqGet(struct k_msgq *msgq, void *data, k_timeout_t timeout = K_FOREVER)
+    : Waiter(K_POLL_TYPE_MSGQ_DATA_AVAILABLE, msgq, timeout), msgq(msgq), data(data) {
+  }
+
+  bool await_ready() noexcept {
+    return complete() || K_TIMEOUT_EQ(wait_time, K_NO_WAIT);
+  }
+
+  int await_resume() noexcept {
+    return (err == 0) ? 0 : -EAGAIN;
+  }
+
+protected:
+  bool complete() override {
+    err = k_msgq_get(msgq, data, K_NO_WAIT);
+    return err == 0;
+  }
+
+private:
+  struct k_msgq *msgq;
+  void *data;
+  int err{0};
+};
+
+/**
+ * @brief Let the other tasks run for a while.
+*/
+class Sleep : public Waiter {
+public:
+  explicit Sleep(k_timeout_t timeout) : Waiter(K_POLL_TYPE_IGNORE, nullptr, timeout) {
+  }
+
+  void await_resume() const noexcept {
+  }
+};
+
+#endif // _EXECUTOR_HPP_
@@ -0,0 +1,36 @@
+#ifndef _FLOW_CONTROL_HPP_
+#define _FLOW_CONTROL_HPP_
+
+#include <cstdint>
+
+/**
+ * @brief Flow control of the BLE writes.
+ *
+ * @details Sent out of band, on a characteristic of its own rather than in the NUS data, so
+ *          no UART byte is ever taken for it. The characteristic reads, and notifies when it
+ *          changes, FLOW_XOFF while the central must hold its writes back and FLOW_XON once
+ *          it may go on. Each central has its own state.
+*/
+constexpr uint8_t FLOW_XON = 0x11;
+constexpr uint8_t FLOW_XOFF = 0x13;
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+
+struct bt_conn;
+
+/**
+ * @brief Set the flow control state of a central and notify it.
+ *
+ * @details The state is kept for reads even when the central has not enabled the
+ *          notifications. Called from the system workqueue.
+ *
+ * @param conn The connection of the central.
+ * @param paused True for XOFF, false for XON.
+ *
+ * @return 0, -ENOMEM if the controller is out of buffers, or another error of bt_gatt_notify.
+*/
+int flow_control_notify(struct bt_conn *conn, bool paused);
+
+#endif // CONFIG_APP_NUS_RX_FLOW_CONTROL
+
+#endif // _FLOW_CONTROL_HPP_
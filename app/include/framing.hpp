@@ -0,0 +1,130 @@
+#ifndef _FRAMING_HPP_
+#define _FRAMING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Transport framing of a connection.
+ *
+ * @details LINE is the default: the UART data is cut into lines and a LF is appended to
+ *          BLE writes ending with CR. COBS carries binary frames unchanged in both directions:
+ *
+ *            COBS(len | payload | crc) 0x00
+ *
+ *          len is the payload length and crc the CRC-16/CCITT-FALSE of len and payload, both
+ *          little endian. The UART to BLE path only forwards frames that pass both checks.
+ *          Several frames may share one notification or one UART transfer, and a frame may
+ *          span several.
+*/
+enum class FrameMode : uint8_t {
+  LINE = 0,
+  COBS = 1,
+};
+
+constexpr uint8_t FRAME_DELIMITER = 0x00;
+
+// Length and CRC around the payload.
+constexpr size_t FRAME_HEADER_SIZE = sizeof(uint16_t);
+constexpr size_t FRAME_TRAILER_SIZE = sizeof(uint16_t);
+
+/**
+ * @brief Largest COBS encoding of n bytes, delimiter excluded.
+ *
+ * @details COBS adds one code byte per started run of 254 bytes.
+*/
+constexpr size_t cobs_max_encoded_size(size_t n) {
+  return n + (n / 254) + 1;
+}
+
+#if defined(CONFIG_APP_FRAMING)
+
+constexpr size_t FRAME_MAX_PAYLOAD = CONFIG_APP_FRAME_MAX_PAYLOAD;
+constexpr size_t FRAME_MAX_DECODED = FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_TRAILER_SIZE;
+constexpr size_t FRAME_MAX_ENCODED = cobs_max_encoded_size(FRAME_MAX_DECODED) + 1;
+
+/**
+ * @brief Snapshot of the framing counters.
+*/
+struct FrameStats {
+  uint32_t frames;
+  uint32_t crc_errors;
+  uint32_t length_errors;
+  uint32_t overruns;
+};
+
+/**
+ * @brief Streaming decoder for COBS frames.
+ *
+ * @details Fed one byte at a time from the raw UART stream. Frames that fail the length or
+ *          CRC check, or grow past FRAME_MAX_ENCODED, are dropped at their delimiter and
+ *          counted in the framing stats.
+*/
+class FrameDecoder {
+public:
+  enum class Result {
+    MORE,
+    FRAME,
+    CRC_ERROR,
+    LENGTH_ERROR,
+    OVERRUN,
+  };
+
+  // Decode one byte. Returns FRAME when it completes a valid frame.
+  Result feed(uint8_t byte);
+
+  // Drop the frame in progress.
+  void reset();
+
+  // Payload of the last valid frame. Valid until the next call to feed().
+  const uint8_t *payload() const {
+    return &decoded[FRAME_HEADER_SIZE];
+  }
+
+  size_t payload_len() const {
+    return frame_len - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE;
+  }
+
+private:
+  uint8_t decoded[FRAME_MAX_DECODED];
+  size_t decoded_len{0};
+  size_t encoded_len{0};
+  // Decoded length of the last complete frame.
+  size_t frame_len{0};
+  // Data bytes left in the current COBS block, and the code that started it.
+  uint8_t block_left{0};
+  uint8_t block_code{0};
+  bool overrun{false};
+
+  void append(uint8_t byte);
+  Result finish();
+};
+
+/**
+ * @brief Encode a frame.
+ *
+ * @param payload The payload, at most FRAME_MAX_PAYLOAD bytes.
+ * @param len The payload length.
+ * @param out The encoded frame, delimiter included.
+ * @param size The size of out. FRAME_MAX_ENCODED always fits.
+ *
+ * @return The encoded length, or 0 if the frame does not fit.
+*/
+size_t frame_encode(const uint8_t *payload, size_t len, uint8_t *out, size_t size);
+
+// Framing of the UART data, shared by the connections. Safe to call from any context.
+FrameMode framing_get_mode();
+void framing_set_mode(FrameMode mode);
+
+// Read the framing counters.
+FrameStats framing_get_stats();
+
+#else
+
+static inline FrameMode framing_get_mode() {
+  return FrameMode::LINE;
+}
+
+#endif // CONFIG_APP_FRAMING
+
+#endif // _FRAMING_HPP_
@@ -0,0 +1,33 @@
+#ifndef _GATT_HPP_
+#define _GATT_HPP_
+
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+
+/**
+ * @brief GATT declarations that build as C++.
+ *
+ * @details The BT_UUID_DECLARE_*, BT_GATT_PRIMARY_SERVICE, BT_GATT_CHARACTERISTIC and
+ *          BT_GATT_CCC helpers use compound literals, which C++ does not allow. The services of
+ *          the application spell their attributes out with the macros below instead, which
+ *          share the UUIDs of the declarations. The value of a characteristic, and its
+ *          struct bt_gatt_chrc made with BT_GATT_CHRC_INIT, are still declared by the service.
+*/
+inline const struct bt_uuid_16 gatt_primary_uuid = BT_UUID_INIT_16(BT_UUID_GATT_PRIMARY_VAL);
+inline const struct bt_uuid_16 gatt_chrc_uuid = BT_UUID_INIT_16(BT_UUID_GATT_CHRC_VAL);
+inline const struct bt_uuid_16 gatt_ccc_uuid = BT_UUID_INIT_16(BT_UUID_GATT_CCC_VAL);
+
+// Primary service declaration. _service is the struct bt_uuid of the service.
+#define GATT_PRIMARY_SERVICE(_service) \
+  BT_GATT_ATTRIBUTE(&gatt_primary_uuid.uuid, BT_GATT_PERM_READ, bt_gatt_attr_read_service, NULL, (_service))
+
+// Characteristic declaration, followed by the attribute of its value. _chrc is its struct bt_gatt_chrc.
+#define GATT_CHRC_DECLARATION(_chrc) \
+  BT_GATT_ATTRIBUTE(&gatt_chrc_uuid.uuid, BT_GATT_PERM_READ, bt_gatt_attr_read_chrc, NULL, (_chrc))
+
+// Client characteristic configuration of the characteristic before it. _ccc is its struct _bt_gatt_ccc.
+#define GATT_CCC(_ccc) \
+  BT_GATT_ATTRIBUTE(&gatt_ccc_uuid.uuid, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, bt_gatt_attr_read_ccc, \
+                    bt_gatt_attr_write_ccc, (_ccc))
+
+#endif // _GATT_HPP_
@@ -0,0 +1,225 @@
+#ifndef _SPSC_RING_HPP_
+#define _SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Alignment used to keep the producer and consumer indices apart.
+ *
+ * @details On targets with a data cache each index gets its own cache line so the producer
+ *          and the consumer do not invalidate each other's line on every update.
+*/
+#if defined(CONFIG_DCACHE_LINE_SIZE) && (CONFIG_DCACHE_LINE_SIZE > 0)
+constexpr size_t SPSC_RING_ALIGN = CONFIG_DCACHE_LINE_SIZE;
+#elif defined(CONFIG_ARCH_POSIX)
+constexpr size_t SPSC_RING_ALIGN = 64;
+#else
+constexpr size_t SPSC_RING_ALIGN = alignof(size_t);
+#endif
+
+/**
+ * @brief Lock-free single-producer/single-consumer byte ring.
+ *
+ * @details The producer only writes head_ and the consumer only writes tail_. Each side reads
+ *          the other's index with acquire ordering and publishes its own with release ordering,
+ *          so no lock is taken and both sides may run in interrupt context.
+ *
+ *          Besides the copying read()/write(), the claim/commit calls expose the ring memory
+ *          directly so a DMA transfer or a send call can work in place:
+ *          - write_claim() returns the next contiguous free span. Several claims may be made;
+ *            nothing is visible to the consumer until write_commit().
+ *          - read_claim() returns the next contiguous span of data. It stays valid until
+ *            read_commit() releases it.
+ *          A span never wraps, so up to two claims are needed to reach the whole ring.
+ *
+ * @tparam Capacity The ring size in bytes. Must be a power of two.
+*/
+template<size_t Capacity>
+class SpscRing {
+  static_assert((Capacity >= 2) && ((Capacity & (Capacity - 1)) == 0), "SpscRing capacity must be a power of two");
+
+public:
+  /**
+   * @brief A contiguous run of bytes inside the ring.
+  */
+  struct Span {
+    uint8_t *data;
+    size_t len;
+  };
+
+  static constexpr size_t capacity = Capacity;
+
+  SpscRing() = default;
+
+  // Copying or moving would duplicate the indices.
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  /**
+   * @brief Number of bytes committed and not yet read. Any context.
+   *
+   * @details Exact for the producer and the consumer. From elsewhere both indices may move
+   *          between the loads, so the result is a snapshot somewhere in between. The tail is
+   *          loaded first so the head is never behind it, and the result is capped to the
+   *          capacity in case the consumer and the producer both moved on in between.
+  */
+  size_t size() const {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t used = head_.load(std::memory_order_acquire) - tail;
+    return (used < Capacity) ? used : Capacity;
+  }
+
+  /**
+   * @brief Number of bytes that can still be written. Any context.
+  */
+  size_t space() const {
+    return Capacity - size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /**
+   * @brief Claim the next contiguous free span. Producer only.
+   *
+   * @param max The largest span wanted.
+   *
+   * @return The span. Its length is 0 when the ring is full.
+  */
+  Span write_claim(size_t max = Capacity) {
+    size_t head = head_.load(std::memory_order_relaxed) + write_claimed_;
+    size_t free = Capacity - (head - tail_.load(std::memory_order_acquire));
+    size_t offset = head & MASK;
+    size_t len = min3(max, free, Capacity - offset);
+
+    write_claimed_ += len;
+    return Span{&buf_[offset], len};
+  }
+
+  /**
+   * @brief Publish the first len claimed bytes to the consumer. Producer only.
+   *
+   * @details Claims beyond len are dropped.
+   *
+   * @param len The number of bytes to publish.
+  */
+  void write_commit(size_t len) {
+    head_.store(head_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    write_claimed_ = 0;
+  }
+
+  /**
+   * @brief Copy data into the ring and publish it. Producer only.
+   *
+   * @param data The data to copy.
+   * @param len The number of bytes to copy.
+   *
+   * @return The number of bytes written, less than len if the ring filled up.
+  */
+  size_t write(const uint8_t *data, size_t len) {
+    size_t done = stage(data, len);
+    write_commit(write_claimed_);
+    return done;
+  }
+
+  /**
+   * @brief Copy data into claimed space without publishing it. Producer only.
+   *
+   * @details Use with write_commit() to publish several pieces at once.
+   *
+   * @param data The data to copy.
+   * @param len The number of bytes to copy.
+   *
+   * @return The number of bytes copied, less than len if the ring filled up.
+  */
+  size_t stage(const uint8_t *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+      Span span = write_claim(len - done);
+      if (span.len == 0) {
+        break;
+      }
+      memcpy(span.data, &data[done], span.len);
+      done += span.len;
+    }
+
+    return done;
+  }
+
+  /**
+   * @brief Claim the next contiguous span of data. Consumer only.
+   *
+   * @param max The largest span wanted.
+   *
+   * @return The span. Its length is 0 when the ring is empty.
+  */
+  Span read_claim(size_t max = Capacity) {
+    size_t tail = tail_.load(std::memory_order_relaxed) + read_claimed_;
+    size_t used = head_.load(std::memory_order_acquire) - tail;
+    size_t offset = tail & MASK;
+    size_t len = min3(max, used, Capacity - offset);
+
+    read_claimed_ += len;
+    return Span{&buf_[offset], len};
+  }
+
+  /**
+   * @brief Release the first len claimed bytes back to the producer. Consumer only.
+   *
+   * @details Claims beyond len are dropped and will be returned again by the next claim.
+   *
+   * @param len The number of bytes to release.
+  */
+  void read_commit(size_t len) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    read_claimed_ = 0;
+  }
+
+  /**
+   * @brief Copy data out of the ring and release it. Consumer only.
+   *
+   * @param data The destination.
+   * @param len The largest number of bytes to copy.
+   *
+   * @return The number of bytes read.
+  */
+  size_t read(uint8_t *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+      Span span = read_claim(len - done);
+      if (span.len == 0) {
+        break;
+      }
+      memcpy(&data[done], span.data, span.len);
+      done += span.len;
+    }
+
+    read_commit(done);
+    return done;
+  }
+
+private:
+  static constexpr size_t MASK = Capacity - 1;
+
+  static constexpr size_t min3(size_t a, size_t b, size_t c) {
+    size_t m = (a < b) ? a : b;
+    return (m < c) ? m : c;
+  }
+
+  // Free-running indices. Only the low bits address the buffer.
+  alignas(SPSC_RING_ALIGN) std::atomic<size_t> head_{0};
+  size_t write_claimed_{0};
+
+  alignas(SPSC_RING_ALIGN) std::atomic<size_t> tail_{0};
+  size_t read_claimed_{0};
+
+  alignas(SPSC_RING_ALIGN) uint8_t buf_[Capacity];
+};
+
+#endif // _SPSC_RING_HPP_
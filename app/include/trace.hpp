@@ -0,0 +1,111 @@
+#ifndef _TRACE_HPP_
+#define _TRACE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Data path trace points.
+ *
+ * @details The data is stamped where it enters the bridge and carries the stamp from point to
+ *          point. Each trace point adds the time since the stamp to the histogram of the stage
+ *          it closes and restamps the data.
+ *
+ *          UART to BLE, stamped at UART_RX_RDY in the UART callback:
+ *          - UART_RX_BUF_RELEASED: since the first UART_RX_RDY of the buffer, i.e. how long its
+ *            oldest byte sat in the DMA buffer.
+ *          - UART_RX_GET: since UART_RX_RDY (legacy mode: since the release), the wait in
+ *            RX queue of the UART.
+ *          - UART_NUS_PUT: since UART_RX_GET, line assembly including the line idle timeout.
+ *          - NUS_GET: since UART_NUS_PUT, the wait in uart_nus_fifo or uart_nus_rings. For a
+ *            ring it is measured from the write that found the ring empty.
+ *          - NUS_SEND: since NUS_GET or the previous notification, at the bt_nus_send return,
+ *            including the wait for a TX credit.
+ *
+ *          BLE to UART, stamped in the NUS received callback:
+ *          - NUS_UART_GET: since the NUS write was received, the wait in the ring of its stream
+ *            until the TX engine takes the record.
+ *          - UART_TX_START: since the TX buffer was filled, the wait for the UART.
+ *          - UART_TX_DONE: since UART_TX_START, the time on the wire.
+*/
+enum class TracePoint : uint8_t {
+  UART_RX_BUF_RELEASED,
+  UART_RX_GET,
+  UART_NUS_PUT,
+  NUS_GET,
+  NUS_SEND,
+  NUS_UART_GET,
+  UART_TX_START,
+  UART_TX_DONE,
+  COUNT,
+};
+
+constexpr size_t TRACE_POINT_COUNT = static_cast<size_t>(TracePoint::COUNT);
+
+// Bucket b counts stages that took [2^(b-1), 2^b) timing cycles. Bucket 0 counts 0 cycles.
+constexpr size_t TRACE_BUCKETS = 33;
+
+using trace_stamp_t = uint32_t;
+
+/**
+ * @brief Snapshot of the histogram of one stage.
+*/
+struct TraceStats {
+  uint32_t count;
+  uint32_t max_cycles;
+  uint32_t buckets[TRACE_BUCKETS];
+};
+
+#if defined(CONFIG_APP_TRACE)
+
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+
+// Read the timing counter, or the kernel cycle counter where the timing API is not available.
+static inline trace_stamp_t trace_now() {
+#if defined(CONFIG_TIMING_FUNCTIONS)
+  return static_cast<trace_stamp_t>(timing_counter_get());
+#else
+  return k_cycle_get_32();
+#endif
+}
+
+// Add the time since stamp to the histogram of point and restamp. Safe to call from any context.
+void trace_point(TracePoint point, trace_stamp_t *stamp);
+
+// Name of a trace point.
+const char *trace_point_name(TracePoint point);
+
+// Read the histogram of a trace point.
+void trace_get(TracePoint point, TraceStats *stats);
+
+// Clear all histograms.
+void trace_reset();
+
+// Convert trace cycles to nanoseconds.
+uint64_t trace_cycles_to_ns(uint64_t cycles);
+
+// Upper bound in cycles of the bucket holding the pct percentile. 0 if the stage is empty.
+uint32_t trace_percentile_cycles(const TraceStats *stats, uint32_t pct);
+
+/**
+ * @brief Trace point macros.
+ *
+ * @details Use these instead of the functions so the stamps and the calls disappear when
+ *          CONFIG_APP_TRACE is disabled. Arguments are not evaluated then.
+*/
+#define TRACE_STAMP_FIELD(name) trace_stamp_t name;
+#define TRACE_STAMP(stamp) ((stamp) = trace_now())
+#define TRACE_COPY(dst, src) ((dst) = (src))
+#define TRACE_POINT(point, stamp) trace_point(TracePoint::point, &(stamp))
+
+#else
+
+#define TRACE_STAMP_FIELD(name)
+#define TRACE_STAMP(stamp) do { } while (0)
+#define TRACE_COPY(dst, src) do { } while (0)
+#define TRACE_POINT(point, stamp) do { } while (0)
+
+#endif
+
+#endif // _TRACE_HPP_
@@ -0,0 +1,82 @@
+#include "boot_prof.hpp"
+
+#if defined(CONFIG_APP_BOOT_PROFILE)
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+#if defined(CONFIG_HWINFO)
+#include <zephyr/drivers/hwinfo.h>
+#endif
+
+LOG_MODULE_REGISTER(boot_prof);
+
+static const char *const stage_names[BOOT_STAGE_COUNT] = {
+  "main",
+  "bt_enabled",
+  "settings_loaded",
+  "advertising",
+  "uart_rx",
+  "nus_ready",
+};
+
+constexpr atomic_val_t ALL_STAGES = BIT(BOOT_STAGE_COUNT) - 1;
+
+/**
+ * @brief Time of each stage in microseconds.
+ *
+ * @details A stage is claimed before its time is written and reached after, so a time is
+ *          written once and only read once complete.
+*/
+static uint32_t stage_us[BOOT_STAGE_COUNT];
+static atomic_t claimed;
+static atomic_t reached;
+
+/**
+ * @brief Log the time of every stage and the cause of the reset.
+*/
+static void boot_report() {
+  uint32_t cause = 0;
+  bool watchdog = false;
+
+#if defined(CONFIG_HWINFO)
+  // The cause accumulates over resets until it is cleared.
+  if (hwinfo_get_reset_cause(&cause) == 0) {
+    (void)hwinfo_clear_reset_cause();
+  }
+  watchdog = (cause & RESET_WATCHDOG) != 0;
+#endif
+
+  LOG_INF("Boot profile, reset cause 0x%08x%s", cause, watchdog ? " (watchdog)" : "");
+  for (size_t i = 0; i < BOOT_STAGE_COUNT; ++i) {
+    LOG_INF("  %-16s %u us", stage_names[i], stage_us[i]);
+  }
+}
+
+void boot_mark(BootStage stage) {
+  int bit = static_cast<int>(stage);
+
+  if (atomic_test_and_set_bit(&claimed, bit)) {
+    return;
+  }
+
+  stage_us[bit] = static_cast<uint32_t>(k_ticks_to_us_floor64(k_uptime_ticks()));
+  atomic_val_t old = atomic_or(&reached, BIT(bit));
+
+  // Only the last stage sees all the others reached.
+  if ((old | BIT(bit)) == ALL_STAGES) {
+    boot_report();
+  }
+}
+
+int64_t boot_stage_us(BootStage stage) {
+  int bit = static_cast<int>(stage);
+
+  if (!atomic_test_bit(&reached, bit)) {
+    return -1;
+  }
+  return stage_us[bit];
+}
+
+#endif // CONFIG_APP_BOOT_PROFILE
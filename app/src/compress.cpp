@@ -0,0 +1,459 @@
+#include "compress.hpp"
+
+#if defined(CONFIG_APP_COMPRESS)
+
+#include <errno.h>
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#if defined(CONFIG_APP_COMPRESS_GATT)
+#include "gatt.hpp"
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/sys/byteorder.h>
+#endif
+
+#if defined(CONFIG_APP_COMPRESS_DEFAULT_ON)
+constexpr CompressMode COMPRESS_MODE_DEFAULT = CompressMode::LZ;
+#else
+constexpr CompressMode COMPRESS_MODE_DEFAULT = CompressMode::OFF;
+#endif
+
+constexpr uint32_t LZ_WINDOW_MASK = LZ_WINDOW - 1;
+
+// Hash table slot without a position.
+constexpr uint32_t LZ_HASH_EMPTY = UINT32_MAX;
+
+// Bits of the flags byte, one per token.
+constexpr uint8_t LZ_GROUP_TOKENS = 8;
+
+// Connections with a mode and a stream of their own, by bt_conn_index().
+#if defined(CONFIG_BT_MAX_CONN)
+constexpr size_t COMPRESS_CONNS = CONFIG_BT_MAX_CONN;
+#else
+constexpr size_t COMPRESS_CONNS = 1;
+#endif
+
+struct compress_conn_t {
+  atomic_t mode{static_cast<atomic_val_t>(COMPRESS_MODE_DEFAULT)};
+  atomic_t session{0};
+};
+
+static compress_conn_t compress_conns[COMPRESS_CONNS];
+
+/**
+ * @brief Compression counters.
+ *
+ * @details Updated by the NUS task and the BT RX thread. The cycles are converted on read.
+*/
+static struct k_spinlock stats_lock;
+static uint32_t tx_in_bytes;
+static uint32_t tx_out_bytes;
+static uint64_t tx_cycles;
+static uint32_t rx_in_bytes;
+static uint32_t rx_out_bytes;
+static uint64_t rx_cycles;
+static uint32_t rx_errors;
+
+static inline uint32_t lz_hash(const uint8_t *p) {
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief Start a block.
+ *
+ * @param out The buffer of the block.
+ * @param size The size of out, at least 4.
+*/
+void LzEncoder::begin(uint8_t *out, size_t size) {
+  this->out = out;
+  out_size = size;
+  out_len = 0;
+  flags_bit = LZ_GROUP_TOKENS;
+
+  out[out_len++] = reset_pending ? LZ_BLOCK_RESET : 0;
+  reset_pending = false;
+}
+
+/**
+ * @brief Compress data into the block.
+ *
+ * @details Matches start at a position whose first 3 bytes hash like those of the current
+ *          position and are only searched within this call, so data written in small pieces
+ *          compresses a little worse.
+ *
+ * @param in The data.
+ * @param len The length of the data.
+ *
+ * @return The number of bytes consumed. Less than len once the block is full.
+*/
+size_t LzEncoder::write(const uint8_t *in, size_t len) {
+  size_t done = 0;
+
+  while ((done < len) && !full()) {
+    size_t left = len - done;
+    size_t match_len = 0;
+    uint32_t dist = 0;
+
+    if (left >= LZ_MIN_MATCH) {
+      uint32_t &slot = hash[lz_hash(&in[done])];
+      uint32_t cand = slot;
+      slot = pos;
+
+      if ((cand != LZ_HASH_EMPTY) && (pos - cand <= LZ_WINDOW)) {
+        dist = pos - cand;
+        size_t max = MIN(left, LZ_MAX_MATCH);
+        // Bytes past the window are the ones being matched, so a match may overlap itself.
+        while (match_len < max) {
+          uint8_t byte = (match_len < dist) ? window[(cand + match_len) & LZ_WINDOW_MASK]
+                                            : in[done + match_len - dist];
+          if (byte != in[done + match_len]) {
+            break;
+          }
+          match_len++;
+        }
+      }
+    }
+
+    if (match_len >= LZ_MIN_MATCH) {
+      token(true);
+      out[out_len++] = static_cast<uint8_t>(dist - 1);
+      out[out_len++] = static_cast<uint8_t>(match_len - LZ_MIN_MATCH);
+
+      // Index the positions inside the match too, they are likely to repeat.
+      push(&in[done], 1);
+      for (size_t i = 1; i < match_len; ++i) {
+        if (left - i >= LZ_MIN_MATCH) {
+          hash[lz_hash(&in[done + i])] = pos;
+        }
+        push(&in[done + i], 1);
+      }
+      done += match_len;
+    } else {
+      token(false);
+      out[out_len++] = in[done];
+      push(&in[done], 1);
+      done++;
+    }
+  }
+
+  return done;
+}
+
+/**
+ * @brief Finish the block.
+ *
+ * @return The length of the block, header included.
+*/
+size_t LzEncoder::end() {
+  size_t len = out_len;
+
+  out = nullptr;
+  out_size = 0;
+  out_len = 0;
+  return len;
+}
+
+/**
+ * @brief Forget the history.
+ *
+ * @details The next block tells the decoder to clear its window as well.
+*/
+void LzEncoder::reset() {
+  memset(hash, 0xFF, sizeof(hash));
+  pos = 0;
+  reset_pending = true;
+}
+
+void LzEncoder::token(bool match) {
+  if (flags_bit == LZ_GROUP_TOKENS) {
+    flags_pos = out_len;
+    out[out_len++] = 0;
+    flags_bit = 0;
+  }
+
+  if (match) {
+    out[flags_pos] |= BIT(flags_bit);
+  }
+  flags_bit++;
+}
+
+void LzEncoder::push(const uint8_t *in, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    window[pos++ & LZ_WINDOW_MASK] = in[i];
+  }
+}
+
+/**
+ * @brief Decode one block.
+ *
+ * @param in The block.
+ * @param len The length of the block.
+ * @param sink Called with the decoded data, possibly several times.
+ *
+ * @return 0, or -EINVAL if the block is corrupt. The decoder is reset then and the data
+ *         decoded from the block but not yet passed to the sink is dropped.
+*/
+int LzDecoder::decode(const uint8_t *in, size_t len, Sink sink) {
+  if ((len == 0) || (in[0] & ~LZ_BLOCK_RESET)) {
+    reset();
+    return -EINVAL;
+  }
+
+  if (in[0] & LZ_BLOCK_RESET) {
+    reset();
+  }
+
+  size_t i = 1;
+  while (i < len) {
+    uint8_t flags = in[i++];
+
+    for (uint8_t bit = 0; bit < LZ_GROUP_TOKENS; ++bit) {
+      if (i == len) {
+        // The block ends within the group. The unused flags must be clear.
+        if (flags >> bit) {
+          reset();
+          return -EINVAL;
+        }
+        break;
+      }
+
+      if (!(flags & BIT(bit))) {
+        put(in[i++], sink);
+        continue;
+      }
+
+      if (i + 2 > len) {
+        reset();
+        return -EINVAL;
+      }
+
+      uint32_t dist = in[i] + 1U;
+      size_t match_len = in[i + 1] + LZ_MIN_MATCH;
+      i += 2;
+
+      if ((dist > LZ_WINDOW) || (dist > pos)) {
+        reset();
+        return -EINVAL;
+      }
+
+      for (size_t n = 0; n < match_len; ++n) {
+        put(window[(pos - dist) & LZ_WINDOW_MASK], sink);
+      }
+    }
+  }
+
+  flush(sink);
+  return 0;
+}
+
+/**
+ * @brief Clear the window.
+*/
+void LzDecoder::reset() {
+  pos = 0;
+  flushed = 0;
+}
+
+void LzDecoder::put(uint8_t byte, Sink sink) {
+  // Pass the window on before the oldest byte not yet passed is overwritten.
+  if (pos - flushed == LZ_WINDOW) {
+    flush(sink);
+  }
+  window[pos++ & LZ_WINDOW_MASK] = byte;
+}
+
+void LzDecoder::flush(Sink sink) {
+  while (flushed != pos) {
+    uint32_t start = flushed & LZ_WINDOW_MASK;
+    size_t len = MIN(pos - flushed, LZ_WINDOW - start);
+
+    sink(&window[start], len);
+    flushed += len;
+  }
+}
+
+/**
+ * @brief Get the compression of a connection.
+ *
+ * @param conn The index of the connection.
+ *
+ * @return The compression mode.
+*/
+CompressMode compress_get_mode(size_t conn) {
+  return static_cast<CompressMode>(atomic_get(&compress_conns[conn].mode));
+}
+
+/**
+ * @brief Set the compression of a connection.
+ *
+ * @param conn The index of the connection.
+ * @param mode The compression mode.
+*/
+void compress_set_mode(size_t conn, CompressMode mode) {
+  atomic_set(&compress_conns[conn].mode, static_cast<atomic_val_t>(mode));
+}
+
+/**
+ * @brief Start a new stream in both directions of a connection.
+ *
+ * @param conn The index of the connection.
+*/
+void compress_new_session(size_t conn) {
+  atomic_inc(&compress_conns[conn].session);
+}
+
+/**
+ * @brief Get the current stream of a connection.
+ *
+ * @param conn The index of the connection.
+ *
+ * @return A number that changes whenever a new stream of the connection starts.
+*/
+uint32_t compress_session(size_t conn) {
+  return static_cast<uint32_t>(atomic_get(&compress_conns[conn].session));
+}
+
+/**
+ * @brief Count a compressed block.
+ *
+ * @param in_bytes The bytes compressed.
+ * @param out_bytes The length of the block.
+ * @param cycles The cycles spent compressing.
+*/
+void compress_count_tx(size_t in_bytes, size_t out_bytes, uint32_t cycles) {
+  k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+  tx_in_bytes += in_bytes;
+  tx_out_bytes += out_bytes;
+  tx_cycles += cycles;
+
+  k_spin_unlock(&stats_lock, key);
+}
+
+/**
+ * @brief Count a decompressed block.
+ *
+ * @param in_bytes The length of the block.
+ * @param out_bytes The bytes decompressed.
+ * @param cycles The cycles spent decompressing.
+ * @param error Whether the block was corrupt.
+*/
+void compress_count_rx(size_t in_bytes, size_t out_bytes, uint32_t cycles, bool error) {
+  k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+  rx_in_bytes += in_bytes;
+  rx_out_bytes += out_bytes;
+  rx_cycles += cycles;
+  if (error) {
+    rx_errors++;
+  }
+
+  k_spin_unlock(&stats_lock, key);
+}
+
+/**
+ * @brief Get the compression counters.
+ *
+ * @return A snapshot of the counters.
+*/
+CompressStats compress_get_stats() {
+  k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+  CompressStats stats = {
+    .tx_in_bytes = tx_in_bytes,
+    .tx_out_bytes = tx_out_bytes,
+    .tx_cpu_us = static_cast<uint32_t>(k_cyc_to_us_floor64(tx_cycles)),
+    .rx_in_bytes = rx_in_bytes,
+    .rx_out_bytes = rx_out_bytes,
+    .rx_cpu_us = static_cast<uint32_t>(k_cyc_to_us_floor64(rx_cycles)),
+    .rx_errors = rx_errors,
+  };
+
+  k_spin_unlock(&stats_lock, key);
+  return stats;
+}
+
+#if defined(CONFIG_APP_COMPRESS_GATT)
+#define BT_UUID_COMPRESS_SERVICE_VAL BT_UUID_128_ENCODE(0x8e7f1a40, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_COMPRESS_MODE_VAL BT_UUID_128_ENCODE(0x8e7f1a41, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_COMPRESS_STATS_VAL BT_UUID_128_ENCODE(0x8e7f1a42, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+
+static struct bt_uuid_128 compress_service_uuid = BT_UUID_INIT_128(BT_UUID_COMPRESS_SERVICE_VAL);
+static struct bt_uuid_128 compress_mode_uuid = BT_UUID_INIT_128(BT_UUID_COMPRESS_MODE_VAL);
+static struct bt_uuid_128 compress_stats_uuid = BT_UUID_INIT_128(BT_UUID_COMPRESS_STATS_VAL);
+
+static struct bt_gatt_chrc compress_mode_chrc = BT_GATT_CHRC_INIT(&compress_mode_uuid.uuid, 0U,
+                                                                  BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE);
+static struct bt_gatt_chrc compress_stats_chrc = BT_GATT_CHRC_INIT(&compress_stats_uuid.uuid, 0U,
+                                                                   BT_GATT_CHRC_READ);
+
+static ssize_t compress_mode_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                                  uint16_t len, uint16_t offset) {
+  uint8_t mode = static_cast<uint8_t>(compress_get_mode(bt_conn_index(conn)));
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, &mode, sizeof(mode));
+}
+
+static ssize_t compress_mode_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+                                   uint16_t len, uint16_t offset, uint8_t flags) {
+  ARG_UNUSED(attr);
+  ARG_UNUSED(flags);
+
+  if ((offset != 0) || (len != 1)) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+
+  uint8_t mode = *static_cast<const uint8_t *>(buf);
+  if (mode > static_cast<uint8_t>(CompressMode::LZ)) {
+    return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+  }
+
+  // Both sides start from an empty window after the switch. The writes that follow are
+  // handled on this thread, so they are all decoded in the new mode. The other centrals
+  // keep their own mode and stream.
+  compress_set_mode(bt_conn_index(conn), static_cast<CompressMode>(mode));
+  compress_new_session(bt_conn_index(conn));
+  return len;
+}
+
+static ssize_t compress_stats_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                                   uint16_t len, uint16_t offset) {
+  CompressStats stats = compress_get_stats();
+  uint8_t value[7 * sizeof(uint32_t)];
+
+  // Little endian, in the order of CompressStats.
+  sys_put_le32(stats.tx_in_bytes, &value[0]);
+  sys_put_le32(stats.tx_out_bytes, &value[4]);
+  sys_put_le32(stats.tx_cpu_us, &value[8]);
+  sys_put_le32(stats.rx_in_bytes, &value[12]);
+  sys_put_le32(stats.rx_out_bytes, &value[16]);
+  sys_put_le32(stats.rx_cpu_us, &value[20]);
+  sys_put_le32(stats.rx_errors, &value[24]);
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+BT_GATT_SERVICE_DEFINE(compress_svc,
+  GATT_PRIMARY_SERVICE(&compress_service_uuid.uuid),
+  GATT_CHRC_DECLARATION(&compress_mode_chrc),
+  BT_GATT_ATTRIBUTE(&compress_mode_uuid.uuid, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, compress_mode_read, compress_mode_write, NULL),
+  GATT_CHRC_DECLARATION(&compress_stats_chrc),
+  BT_GATT_ATTRIBUTE(&compress_stats_uuid.uuid, BT_GATT_PERM_READ, compress_stats_read, NULL, NULL),
+);
+
+static void compress_disconnected(struct bt_conn *conn, uint8_t reason) {
+  ARG_UNUSED(reason);
+
+  // Every connection starts in the default mode, so plain clients keep working.
+  compress_set_mode(bt_conn_index(conn), COMPRESS_MODE_DEFAULT);
+}
+
+BT_CONN_CB_DEFINE(compress_conn_callbacks) = {
+  .disconnected = compress_disconnected,
+};
+#endif
+
+#endif // CONFIG_APP_COMPRESS
@@ -0,0 +1,244 @@
+#include "executor.hpp"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(executor);
+
+// Deadline of a waiter without timeout.
+constexpr int64_t NO_DEADLINE = INT64_MAX;
+
+// Frames in an arena start with the offset of the frame before them, padded to keep the frames aligned.
+constexpr size_t FRAME_ALIGN = alignof(std::max_align_t);
+constexpr size_t FRAME_HEADER_SIZE = ROUND_UP(sizeof(size_t), FRAME_ALIGN);
+
+/**
+ * @brief Memory for the frames of the tasks.
+*/
+K_HEAP_DEFINE(task_heap, CONFIG_APP_TASK_HEAP_SIZE);
+
+/**
+ * @brief A task queued by spawn().
+*/
+struct ready_task_t {
+  void *address;
+  FrameArena *arena;
+};
+
+K_MSGQ_DEFINE(task_ready_msgq, sizeof(ready_task_t), CONFIG_APP_EXECUTOR_MAX_TASKS, sizeof(void *));
+
+/**
+ * @brief Suspended waiters, in the order they started waiting.
+ *
+ * @details Only used by the executor thread, so no locking is needed.
+*/
+static sys_slist_t waiters = SYS_SLIST_STATIC_INIT(&waiters);
+
+/**
+ * @brief Arena of the task being resumed.
+ *
+ * @details Only used by the executor thread.
+*/
+static FrameArena *current_arena;
+
+static void executor_thread_function(void *arg0, void *arg1, void *arg2);
+
+K_THREAD_DEFINE(executor_thread_id, CONFIG_APP_EXECUTOR_STACK_SIZE, executor_thread_function, NULL, NULL, NULL,
+                CONFIG_APP_EXECUTOR_PRIORITY, 0, 0);
+
+void *FrameArena::alloc(size_t size) {
+  size_t need = FRAME_HEADER_SIZE + ROUND_UP(size, FRAME_ALIGN);
+
+  if (need > size_ - used_) {
+    return nullptr;
+  }
+
+  *reinterpret_cast<size_t *>(buf_ + used_) = top_;
+  top_ = used_;
+  used_ += need;
+  high_water_ = MAX(high_water_, used_);
+
+  return buf_ + top_ + FRAME_HEADER_SIZE;
+}
+
+bool FrameArena::free(void *ptr) {
+  if ((top_ == NO_FRAME) || (static_cast<uint8_t *>(ptr) != buf_ + top_ + FRAME_HEADER_SIZE)) {
+    return false;
+  }
+
+  used_ = top_;
+  top_ = *reinterpret_cast<size_t *>(buf_ + top_);
+  return true;
+}
+
+int Executor::spawn(std::coroutine_handle<> handle, FrameArena *arena) {
+  ready_task_t task = {handle.address(), arena};
+
+  if (k_msgq_put(&task_ready_msgq, &task, K_NO_WAIT) != 0) {
+    LOG_ERR("Too many tasks queued, increase CONFIG_APP_EXECUTOR_MAX_TASKS");
+    return -ENOMEM;
+  }
+  return 0;
+}
+
+/**
+ * @details Tasks are created outside the executor, once, so their frames come from the heap.
+ *          The coroutines a task awaits are created while it runs, on every call, so theirs
+ *          come from its arena. A task without an arena cannot await coroutines.
+*/
+void *Executor::alloc_frame(size_t size) noexcept {
+  void *ptr;
+
+  if (k_current_get() != executor_thread_id) {
+    ptr = k_heap_alloc(&task_heap, size, K_NO_WAIT);
+    if (!ptr) {
+      LOG_ERR("Out of task frame memory (%u bytes), increase CONFIG_APP_TASK_HEAP_SIZE",
+              static_cast<unsigned int>(size));
+    }
+    return ptr;
+  }
+
+  ptr = current_arena ? current_arena->alloc(size) : nullptr;
+  if (!ptr) {
+    LOG_ERR("No room for a coroutine frame (%u bytes) in the arena of the task",
+            static_cast<unsigned int>(size));
+  }
+  return ptr;
+}
+
+void Executor::free_frame(void *ptr) noexcept {
+  if (current_arena && current_arena->owns(ptr)) {
+    if (!current_arena->free(ptr)) {
+      LOG_ERR("Coroutine frame freed out of order");
+    }
+    return;
+  }
+  k_heap_free(&task_heap, ptr);
+}
+
+/**
+ * @brief Resume a task with its arena.
+*/
+static void resume(void *address, FrameArena *arena) {
+  current_arena = arena;
+  std::coroutine_handle<>::from_address(address).resume();
+  current_arena = nullptr;
+}
+
+/**
+ * @brief Suspend a task until its waiter is ready.
+ *
+ * @details Called on the executor thread by the awaitables. Only relative timeouts are supported.
+ *
+ * @param waiter The waiter of the suspending task.
+*/
+void Executor::wait(Waiter *waiter) {
+  waiter->ready = false;
+  waiter->arena = current_arena;
+  waiter->deadline = K_TIMEOUT_EQ(waiter->wait_time, K_FOREVER) ? NO_DEADLINE
+                                                                  : k_uptime_ticks() + waiter->wait_time.ticks;
+  sys_slist_append(&waiters, &waiter->node);
+}
+
+/**
+ * @brief Run the tasks. Never returns.
+ *
+ * @details Polls the ready queue and the objects the suspended tasks wait on in one k_poll,
+ *          bounded by the nearest deadline. Tasks whose object is ready or whose deadline
+ *          passed are resumed in the order they started waiting, then the newly spawned ones.
+ *          A task whose object another context took first keeps waiting until its deadline.
+ *
+ *          More waiters than CONFIG_APP_EXECUTOR_MAX_TASKS are not lost: those that do not
+ *          fit in the poll are tried every tick, and those that do not fit in a round of
+ *          resumes are resumed in the next one.
+*/
+void Executor::run() {
+  struct k_poll_event events[CONFIG_APP_EXECUTOR_MAX_TASKS + 1];
+  Waiter *polled[CONFIG_APP_EXECUTOR_MAX_TASKS];
+  Waiter *wake[CONFIG_APP_EXECUTOR_MAX_TASKS];
+  bool overflow_logged = false;
+  Waiter *waiter;
+  Waiter *next;
+
+  while (true) {
+    size_t count = 0;
+    bool overflow = false;
+    int64_t deadline = NO_DEADLINE;
+
+    k_poll_event_init(&events[0], K_POLL_TYPE_MSGQ_DATA_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY, &task_ready_msgq);
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&waiters, waiter, node) {
+      if (waiter->type != K_POLL_TYPE_IGNORE) {
+        if (count < ARRAY_SIZE(polled)) {
+          k_poll_event_init(&events[count + 1], waiter->type, K_POLL_MODE_NOTIFY_ONLY, waiter->obj);
+          polled[count++] = waiter;
+        } else {
+          // Not polled: let it try its object after the poll.
+          waiter->ready = true;
+          overflow = true;
+        }
+      }
+      deadline = MIN(deadline, waiter->deadline);
+    }
+
+    if (overflow) {
+      if (!overflow_logged) {
+        LOG_ERR("Too many waiting tasks, increase CONFIG_APP_EXECUTOR_MAX_TASKS");
+        overflow_logged = true;
+      }
+      deadline = MIN(deadline, k_uptime_ticks() + 1);
+    }
+
+    k_timeout_t timeout = K_FOREVER;
+    if (deadline != NO_DEADLINE) {
+      timeout = K_TICKS(MAX(deadline - k_uptime_ticks(), 0));
+    }
+
+    // Returns early when any event is ready, so the result is in the event states.
+    (void)k_poll(events, count + 1, timeout);
+
+    for (size_t i = 0; i < count; ++i) {
+      if (events[i + 1].state != K_POLL_STATE_NOT_READY) {
+        polled[i]->ready = true;
+      }
+    }
+
+    // Resuming may suspend the tasks again, so take them off the list first.
+    int64_t now = k_uptime_ticks();
+    size_t woken = 0;
+
+    SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&waiters, waiter, next, node) {
+      if (woken == ARRAY_SIZE(wake)) {
+        // The rest are still ready or due, so the next poll returns at once.
+        break;
+      }
+
+      if (waiter->ready || (now >= waiter->deadline)) {
+        if (!waiter->complete() && (now < waiter->deadline)) {
+          waiter->ready = false;
+          continue;
+        }
+
+        sys_slist_find_and_remove(&waiters, &waiter->node);
+        wake[woken++] = waiter;
+      }
+    }
+
+    for (size_t i = 0; i < woken; ++i) {
+      resume(wake[i]->handle.address(), wake[i]->arena);
+    }
+
+    ready_task_t task;
+    while (k_msgq_get(&task_ready_msgq, &task, K_NO_WAIT) == 0) {
+      resume(task.address, task.arena);
+    }
+  }
+}
+
+static void executor_thread_function(void *arg0, void *arg1, void *arg2) {
+  ARG_UNUSED(arg0);
+  ARG_UNUSED(arg1);
+  ARG_UNUSED(arg2);
+
+  Executor::run();
+}
@@ -0,0 +1,71 @@
+#include "flow_control.hpp"
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+
+#include "gatt.hpp"
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+
+#define BT_UUID_FLOW_CONTROL_SERVICE_VAL BT_UUID_128_ENCODE(0x8e7f1a60, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_FLOW_CONTROL_STATE_VAL BT_UUID_128_ENCODE(0x8e7f1a61, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+
+// Flow control state of each central, by bt_conn_index(). 0 reads as XON.
+static atomic_t flow_states[CONFIG_BT_MAX_CONN];
+
+static struct bt_uuid_128 flow_control_service_uuid = BT_UUID_INIT_128(BT_UUID_FLOW_CONTROL_SERVICE_VAL);
+static struct bt_uuid_128 flow_control_state_uuid = BT_UUID_INIT_128(BT_UUID_FLOW_CONTROL_STATE_VAL);
+
+static struct bt_gatt_chrc flow_control_state_chrc = BT_GATT_CHRC_INIT(&flow_control_state_uuid.uuid, 0U,
+                                                                       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY);
+static struct _bt_gatt_ccc flow_control_ccc = BT_GATT_CCC_INITIALIZER(NULL, NULL, NULL);
+
+static ssize_t flow_control_state_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                                       uint16_t len, uint16_t offset) {
+  uint8_t code = atomic_get(&flow_states[bt_conn_index(conn)]) ? FLOW_XOFF : FLOW_XON;
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, &code, sizeof(code));
+}
+
+BT_GATT_SERVICE_DEFINE(flow_control_svc,
+  GATT_PRIMARY_SERVICE(&flow_control_service_uuid.uuid),
+  GATT_CHRC_DECLARATION(&flow_control_state_chrc),
+  BT_GATT_ATTRIBUTE(&flow_control_state_uuid.uuid, BT_GATT_PERM_READ, flow_control_state_read, NULL, NULL),
+  GATT_CCC(&flow_control_ccc),
+);
+
+/**
+ * @brief Set the flow control state of a central and notify it.
+ *
+ * @param conn The connection of the central.
+ * @param paused True for XOFF, false for XON.
+ *
+ * @return 0, or the error of bt_gatt_notify.
+*/
+int flow_control_notify(struct bt_conn *conn, bool paused) {
+  const struct bt_gatt_attr *attr = &flow_control_svc.attrs[2];
+  uint8_t code = paused ? FLOW_XOFF : FLOW_XON;
+
+  atomic_set(&flow_states[bt_conn_index(conn)], paused);
+
+  // A central without the notifications reads the state when it wants it.
+  if (!bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+    return 0;
+  }
+
+  return bt_gatt_notify(conn, attr, &code, sizeof(code));
+}
+
+static void flow_control_disconnected(struct bt_conn *conn, uint8_t reason) {
+  ARG_UNUSED(reason);
+
+  // The next central in the slot starts unpaused.
+  atomic_clear(&flow_states[bt_conn_index(conn)]);
+}
+
+BT_CONN_CB_DEFINE(flow_control_conn_callbacks) = {
+  .disconnected = flow_control_disconnected,
+};
+
+#endif // CONFIG_APP_NUS_RX_FLOW_CONTROL
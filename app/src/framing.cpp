@@ -0,0 +1,312 @@
+#include "framing.hpp"
+
+#if defined(CONFIG_APP_FRAMING)
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#if defined(CONFIG_APP_FRAMING_GATT)
+#include "gatt.hpp"
+#include <errno.h>
+#include <zephyr/bluetooth/conn.h>
+#endif
+
+#if defined(CONFIG_APP_FRAMING_DEFAULT_COBS)
+constexpr FrameMode FRAME_MODE_DEFAULT = FrameMode::COBS;
+#else
+constexpr FrameMode FRAME_MODE_DEFAULT = FrameMode::LINE;
+#endif
+
+// CRC-16/CCITT-FALSE starts from all ones.
+constexpr uint16_t FRAME_CRC_SEED = 0xFFFF;
+
+// A COBS block of this code holds 254 data bytes and no implied zero.
+constexpr uint8_t COBS_MAX_CODE = 0xFF;
+
+static atomic_t frame_mode = ATOMIC_INIT(static_cast<atomic_val_t>(FRAME_MODE_DEFAULT));
+
+/**
+ * @brief Framing counters.
+*/
+static atomic_t frames;
+static atomic_t crc_errors;
+static atomic_t length_errors;
+static atomic_t overruns;
+
+/**
+ * @brief Decode one byte of the raw stream.
+ *
+ * @param byte The received byte.
+ *
+ * @return FRAME when the byte is the delimiter of a valid frame, an error when it is the
+ *         delimiter of an invalid one, otherwise MORE.
+*/
+FrameDecoder::Result FrameDecoder::feed(uint8_t byte) {
+  if (byte == FRAME_DELIMITER) {
+    Result result = finish();
+    size_t len = decoded_len;
+    reset();
+    frame_len = len;
+    return result;
+  }
+
+  if (overrun) {
+    return Result::MORE;
+  }
+
+  if (++encoded_len >= FRAME_MAX_ENCODED) {
+    overrun = true;
+    return Result::MORE;
+  }
+
+  if (block_left == 0) {
+    // A code byte. The previous block ended with an implied zero unless it was a full run.
+    if ((encoded_len > 1) && (block_code != COBS_MAX_CODE)) {
+      append(0);
+    }
+    block_code = byte;
+    block_left = byte - 1;
+    return Result::MORE;
+  }
+
+  append(byte);
+  block_left--;
+  return Result::MORE;
+}
+
+/**
+ * @brief Drop the frame in progress.
+*/
+void FrameDecoder::reset() {
+  decoded_len = 0;
+  encoded_len = 0;
+  frame_len = 0;
+  block_left = 0;
+  block_code = 0;
+  overrun = false;
+}
+
+void FrameDecoder::append(uint8_t byte) {
+  if (decoded_len == sizeof(decoded)) {
+    overrun = true;
+    return;
+  }
+  decoded[decoded_len++] = byte;
+}
+
+/**
+ * @brief Check the frame ended by a delimiter.
+ *
+ * @return The result reported for the delimiter.
+*/
+FrameDecoder::Result FrameDecoder::finish() {
+  if (overrun) {
+    atomic_inc(&overruns);
+    return Result::OVERRUN;
+  }
+
+  if (encoded_len == 0) {
+    // Nothing between two delimiters. Senders may use them to resynchronize.
+    return Result::MORE;
+  }
+
+  if ((block_left != 0) || (decoded_len < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE) ||
+      (sys_get_le16(decoded) != decoded_len - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE)) {
+    atomic_inc(&length_errors);
+    return Result::LENGTH_ERROR;
+  }
+
+  size_t crc_pos = decoded_len - FRAME_TRAILER_SIZE;
+  if (crc16_itu_t(FRAME_CRC_SEED, decoded, crc_pos) != sys_get_le16(&decoded[crc_pos])) {
+    atomic_inc(&crc_errors);
+    return Result::CRC_ERROR;
+  }
+
+  atomic_inc(&frames);
+  return Result::FRAME;
+}
+
+/**
+ * @brief Encode a frame.
+ *
+ * @param payload The payload, at most FRAME_MAX_PAYLOAD bytes.
+ * @param len The payload length.
+ * @param out The encoded frame, delimiter included.
+ * @param size The size of out.
+ *
+ * @return The encoded length, or 0 if the frame does not fit.
+*/
+size_t frame_encode(const uint8_t *payload, size_t len, uint8_t *out, size_t size) {
+  if ((len > FRAME_MAX_PAYLOAD) ||
+      (size < cobs_max_encoded_size(FRAME_HEADER_SIZE + len + FRAME_TRAILER_SIZE) + 1)) {
+    return 0;
+  }
+
+  uint8_t header[FRAME_HEADER_SIZE];
+  uint8_t trailer[FRAME_TRAILER_SIZE];
+
+  sys_put_le16(static_cast<uint16_t>(len), header);
+  uint16_t crc = crc16_itu_t(FRAME_CRC_SEED, header, sizeof(header));
+  sys_put_le16(crc16_itu_t(crc, payload, len), trailer);
+
+  // Each block starts with the distance to the next zero. Its code byte is written once the
+  // block ends, at code_pos.
+  size_t code_pos = 0;
+  size_t pos = 1;
+  uint8_t code = 1;
+
+  auto put = [&](uint8_t byte) {
+    if (byte != 0) {
+      out[pos++] = byte;
+      code++;
+      if (code != COBS_MAX_CODE) {
+        return;
+      }
+    }
+    out[code_pos] = code;
+    code_pos = pos++;
+    code = 1;
+  };
+
+  for (uint8_t byte : header) {
+    put(byte);
+  }
+  for (size_t i = 0; i < len; ++i) {
+    put(payload[i]);
+  }
+  for (uint8_t byte : trailer) {
+    put(byte);
+  }
+
+  out[code_pos] = code;
+  out[pos++] = FRAME_DELIMITER;
+  return pos;
+}
+
+/**
+ * @brief Get the framing of the current connection.
+ *
+ * @return The framing mode.
+*/
+FrameMode framing_get_mode() {
+  return static_cast<FrameMode>(atomic_get(&frame_mode));
+}
+
+/**
+ * @brief Set the framing of the current connection.
+ *
+ * @param mode The framing mode.
+*/
+void framing_set_mode(FrameMode mode) {
+  atomic_set(&frame_mode, static_cast<atomic_val_t>(mode));
+}
+
+/**
+ * @brief Get the framing counters.
+ *
+ * @return A snapshot of the counters.
+*/
+FrameStats framing_get_stats() {
+  return FrameStats{
+    .frames = static_cast<uint32_t>(atomic_get(&frames)),
+    .crc_errors = static_cast<uint32_t>(atomic_get(&crc_errors)),
+    .length_errors = static_cast<uint32_t>(atomic_get(&length_errors)),
+    .overruns = static_cast<uint32_t>(atomic_get(&overruns)),
+  };
+}
+
+#if defined(CONFIG_APP_FRAMING_GATT)
+#define BT_UUID_FRAMING_SERVICE_VAL BT_UUID_128_ENCODE(0x8e7f1a30, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_FRAMING_MODE_VAL BT_UUID_128_ENCODE(0x8e7f1a31, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+
+static struct bt_uuid_128 framing_service_uuid = BT_UUID_INIT_128(BT_UUID_FRAMING_SERVICE_VAL);
+static struct bt_uuid_128 framing_mode_uuid = BT_UUID_INIT_128(BT_UUID_FRAMING_MODE_VAL);
+
+static struct bt_gatt_chrc framing_mode_chrc = BT_GATT_CHRC_INIT(&framing_mode_uuid.uuid, 0U,
+                                                                 BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE);
+
+struct framing_conn_count_t {
+  const struct bt_conn *skip;
+  size_t count;
+};
+
+static void framing_count_conn(struct bt_conn *conn, void *data) {
+  auto *count = static_cast<framing_conn_count_t *>(data);
+  struct bt_conn_info info;
+
+  if ((conn != count->skip) && (bt_conn_get_info(conn, &info) == 0) && (info.state == BT_CONN_STATE_CONNECTED)) {
+    count->count++;
+  }
+}
+
+/**
+ * @brief Count the centrals connected besides one.
+ *
+ * @param conn The connection to leave out.
+ *
+ * @return The number of other connected centrals.
+*/
+static size_t framing_other_centrals(const struct bt_conn *conn) {
+  framing_conn_count_t count = {conn, 0};
+
+  bt_conn_foreach(BT_CONN_TYPE_LE, framing_count_conn, &count);
+  return count.count;
+}
+
+static ssize_t framing_mode_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                                 uint16_t len, uint16_t offset) {
+  uint8_t mode = static_cast<uint8_t>(framing_get_mode());
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, &mode, sizeof(mode));
+}
+
+static ssize_t framing_mode_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+                                  uint16_t len, uint16_t offset, uint8_t flags) {
+  ARG_UNUSED(attr);
+  ARG_UNUSED(flags);
+
+  if ((offset != 0) || (len != 1)) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+
+  uint8_t mode = *static_cast<const uint8_t *>(buf);
+  if (mode > static_cast<uint8_t>(FrameMode::COBS)) {
+    return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+  }
+
+  // The mode applies to the UART data of every central, so only a central alone may
+  // change it.
+  if ((mode != static_cast<uint8_t>(framing_get_mode())) && (framing_other_centrals(conn) > 0)) {
+    return BT_GATT_ERR(BT_ATT_ERR_WRITE_REQ_REJECTED);
+  }
+
+  // Writes are handled on the BT RX thread like the NUS writes, so the data written before
+  // the switch is still handled in the old mode.
+  framing_set_mode(static_cast<FrameMode>(mode));
+  return len;
+}
+
+BT_GATT_SERVICE_DEFINE(framing_svc,
+  GATT_PRIMARY_SERVICE(&framing_service_uuid.uuid),
+  GATT_CHRC_DECLARATION(&framing_mode_chrc),
+  BT_GATT_ATTRIBUTE(&framing_mode_uuid.uuid, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, framing_mode_read, framing_mode_write, NULL),
+);
+
+static void framing_disconnected(struct bt_conn *conn, uint8_t reason) {
+  ARG_UNUSED(reason);
+
+  // The next central starts in the default mode, so line based clients keep working. The
+  // centrals still connected keep the mode they share.
+  if (framing_other_centrals(conn) == 0) {
+    framing_set_mode(FRAME_MODE_DEFAULT);
+  }
+}
+
+BT_CONN_CB_DEFINE(framing_conn_callbacks) = {
+  .disconnected = framing_disconnected,
+};
+#endif
+
+#endif // CONFIG_APP_FRAMING
@@ -47,6 +47,10 @@ void Auth::auth_passkey_display(struct bt_conn *conn, unsigned int passkey) {
 void Auth::auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey) {
   char addr[BT_ADDR_LE_STR_LEN];
 
+  // Only one pairing at a time can be confirmed with the buttons. The latest one wins.
+  if (auth_instance->auth_conn) {
+    bt_conn_unref(auth_instance->auth_conn);
+  }
   auth_instance->auth_conn = bt_conn_ref(conn);
 
   bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
@@ -105,10 +109,13 @@ void Auth::pairing_failed(struct bt_conn *conn, enum bt_security_err reason) {
 /**
  * @brief Unreference the connection object.
  * 
- * @details This function unreferences the connection object.
+ * @details This function unreferences the connection object if it is the one waiting for
+ *          a passkey confirmation.
+ * 
+ * @param conn The connection that went down.
 */
-void Auth::unref() {
-  if (this->auth_conn) {
+void Auth::unref(struct bt_conn *conn) {
+  if (this->auth_conn && (this->auth_conn == conn)) {
     bt_conn_unref(this->auth_conn);
     this->auth_conn = nullptr;
   }
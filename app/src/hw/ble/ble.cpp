@@ -8,6 +8,8 @@
 */
 #include "ble.hpp"
 #include "auth.hpp"
+#include "ble_events.h"
+#include "boot_prof.hpp"
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/bluetooth/bluetooth.h>
@@ -23,6 +25,10 @@ LOG_MODULE_REGISTER(ble_hw);
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN	(sizeof(DEVICE_NAME) - 1)
 
+// Delay before trying again when the stack refuses to advertise, e.g. while the connection
+// object is still in use.
+#define ADV_RETRY_DELAY K_MSEC(1000)
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -38,6 +44,17 @@ static const struct bt_data sd[] = {
 BT_CONN_CB_DEFINE(conn_callbacks) = {
   .connected = Ble::connected,
   .disconnected = Ble::disconnected,
+  .recycled = Ble::recycled,
+  .le_param_updated = Ble::param_updated,
+  .le_phy_updated = Ble::phy_updated,
+  .le_data_len_updated = Ble::data_len_updated,
+};
+
+/**
+ * @brief Callbacks for GATT events.
+*/
+static struct bt_gatt_cb gatt_callbacks = {
+  .att_mtu_updated = Ble::mtu_updated,
 };
 
 /**
@@ -46,17 +63,158 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 static Ble *ble_instance;
 
 /**
- * @brief Advertisement parameters.
+ * @brief Guards the connection of each link against the threads that read it.
+*/
+static struct k_spinlock conn_lock;
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+/**
+ * @brief Connection parameters requested by the policy.
+ * 
+ * @details Peripheral latency is 0 under load so every connection event can carry data.
+*/
+static const struct bt_le_conn_param fast_conn_param = BT_LE_CONN_PARAM_INIT(
+  CONFIG_APP_CONN_FAST_INTERVAL_MIN, CONFIG_APP_CONN_FAST_INTERVAL_MAX, 0, CONFIG_APP_CONN_TIMEOUT);
+
+static const struct bt_le_conn_param idle_conn_param = BT_LE_CONN_PARAM_INIT(
+  CONFIG_APP_CONN_IDLE_INTERVAL_MIN, CONFIG_APP_CONN_IDLE_INTERVAL_MAX, CONFIG_APP_CONN_IDLE_LATENCY,
+  CONFIG_APP_CONN_TIMEOUT);
+
+BUILD_ASSERT(CONFIG_APP_CONN_FAST_INTERVAL_MIN <= CONFIG_APP_CONN_FAST_INTERVAL_MAX, "Fast connection interval range is empty");
+BUILD_ASSERT(CONFIG_APP_CONN_IDLE_INTERVAL_MIN <= CONFIG_APP_CONN_IDLE_INTERVAL_MAX, "Idle connection interval range is empty");
+BUILD_ASSERT(CONFIG_APP_CONN_IDLE_PERCENT < CONFIG_APP_CONN_BUSY_PERCENT, "Idle queue fill must be below the busy fill");
+// The supervision timeout must cover two intervals of the longest peripheral latency.
+BUILD_ASSERT(CONFIG_APP_CONN_TIMEOUT * 4 > (1 + CONFIG_APP_CONN_IDLE_LATENCY) * CONFIG_APP_CONN_IDLE_INTERVAL_MAX,
+             "Supervision timeout too short for the idle connection parameters");
+#endif
+
+/**
+ * @brief The bonded central, the target of directed advertising.
+*/
+static bt_addr_le_t bonded_peer;
+
+/**
+ * @brief Advertisement parameters of each phase.
+ * 
+ * @details Advertising stops on a connection and is restarted by the Ble class, hence ONE_TIME.
+ *          The controller ends high duty directed advertising after 1.28 s, and ignores its
+ *          intervals.
  * 
  * @Note Compiler complains about taking address of temporary array if BT_LE_ADV_CONN is used directly.
 */
-static struct bt_le_adv_param *adv_param = BT_LE_ADV_CONN;
+static const struct bt_le_adv_param directed_adv_param = BT_LE_ADV_PARAM_INIT(
+  BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME, 0, 0, &bonded_peer);
+
+static const struct bt_le_adv_param fast_adv_param = BT_LE_ADV_PARAM_INIT(
+  BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME, CONFIG_APP_ADV_FAST_INTERVAL_MIN,
+  CONFIG_APP_ADV_FAST_INTERVAL_MAX, NULL);
+
+static const struct bt_le_adv_param slow_adv_param = BT_LE_ADV_PARAM_INIT(
+  BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME, CONFIG_APP_ADV_SLOW_INTERVAL_MIN,
+  CONFIG_APP_ADV_SLOW_INTERVAL_MAX, NULL);
+
+BUILD_ASSERT(CONFIG_APP_ADV_FAST_INTERVAL_MIN <= CONFIG_APP_ADV_FAST_INTERVAL_MAX, "Fast advertising interval range is empty");
+BUILD_ASSERT(CONFIG_APP_ADV_SLOW_INTERVAL_MIN <= CONFIG_APP_ADV_SLOW_INTERVAL_MAX, "Slow advertising interval range is empty");
+
+#if defined(CONFIG_APP_ADV_DIRECTED)
+static void bond_found(const struct bt_bond_info *info, void *user_data) {
+  bool *found = static_cast<bool *>(user_data);
+
+  // A central that is connected already needs no advertising.
+  struct bt_conn *conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, &info->addr);
+  if (conn) {
+    bt_conn_unref(conn);
+    return;
+  }
+
+  // Advertise to the first bonded central that is not connected.
+  if (!*found) {
+    bt_addr_le_copy(&bonded_peer, &info->addr);
+    *found = true;
+  }
+}
+#endif
+
+/**
+ * @brief Look up the bonded central for directed advertising.
+ * 
+ * @return True if there is one, in bonded_peer.
+*/
+static bool find_bonded_peer() {
+  bool found = false;
+
+#if defined(CONFIG_APP_ADV_DIRECTED)
+  bt_foreach_bond(BT_ID_DEFAULT, bond_found, &found);
+#endif
+
+  return found;
+}
+
+/**
+ * @brief Link parameters requested on every connection.
+ * 
+ * @details Maximum LL payload and time for data length extension, and 2M PHY in both directions.
+*/
+static const struct bt_conn_le_data_len_param data_len_param = {
+  .tx_max_len = BT_GAP_DATA_LEN_MAX,
+  .tx_max_time = BT_GAP_DATA_TIME_MAX,
+};
+
+static const struct bt_conn_le_phy_param phy_param = {
+  .options = BT_CONN_LE_PHY_OPT_NONE,
+  .pref_tx_phy = BT_GAP_LE_PHY_2M,
+  .pref_rx_phy = BT_GAP_LE_PHY_2M,
+};
+
+/**
+ * @brief MTU exchange parameters of each link. Must stay valid until the exchange completes.
+*/
+static struct bt_gatt_exchange_params exchange_params[CONFIG_BT_MAX_CONN];
+
+/**
+ * @brief A callback for when the MTU exchange completes.
+ * 
+ * @param conn The connection object.
+ * @param att_err The ATT error code, 0 on success.
+ * @param params The exchange parameters.
+*/
+static void mtu_exchange_cb(struct bt_conn *conn, uint8_t att_err, struct bt_gatt_exchange_params *params) {
+  ARG_UNUSED(params);
+
+  if (att_err) {
+    LOG_WRN("MTU exchange failed (err %u)", att_err);
+    return;
+  }
+
+  LOG_INF("MTU exchange done, MTU %u", bt_gatt_get_mtu(conn));
+}
+
+/**
+ * @brief Tell the rest of the application that a connection changed.
+ * 
+ * @param conn The connection.
+ * @param connected Whether the central is connected now.
+ * @param reason The reason for disconnection, 0 when connected.
+*/
+static void publish_conn_event(struct bt_conn *conn, bool connected, uint8_t reason) {
+  const struct ble_conn_event evt = {
+    .conn = conn,
+    .connected = connected,
+    .reason = reason,
+  };
+
+  // The listeners run right here, so nothing holds the channel for long.
+  int err = zbus_chan_pub(&ble_conn_chan, &evt, K_MSEC(100));
+  if (err) {
+    LOG_ERR("Failed to publish the connection event (err %d)", err);
+  }
+}
 
 /**
  * @brief A callback for when a connection is established.
  * 
  * @details This function is called when a connection is established. It starts the MTU exchange
- *          and sets the security level to L2.
+ *          and sets the security level to L2. Advertising goes on while a link is free.
  * 
  * @param conn The connection object.
  * @param conn_err The connection error code.
@@ -65,7 +223,15 @@ void Ble::connected(struct bt_conn *conn, uint8_t conn_err) {
   char addr[BT_ADDR_LE_STR_LEN];
 
   if (conn_err) {
-    LOG_ERR("Connection failed (err %u)", conn_err);
+    // Advertising has stopped either way.
+    ble_instance->state.is_advertising = false;
+    if (conn_err == BT_HCI_ERR_ADV_TIMEOUT) {
+      LOG_INF("Directed advertising timed out");
+      ble_instance->adv.next();
+    } else {
+      LOG_ERR("Connection failed (err %u)", conn_err);
+    }
+    k_work_reschedule(&ble_instance->adv_work, K_NO_WAIT);
     return;
   }
 
@@ -73,20 +239,49 @@ void Ble::connected(struct bt_conn *conn, uint8_t conn_err) {
   LOG_INF("Connected %s", addr);
 
   // Update the internal state
-  ble_instance->current_conn = bt_conn_ref(conn);
-  ble_instance->state = {
-    .is_initialized = ble_instance->state.is_initialized,
-    .is_advertising = false,
-    .is_connected = true,
-  };
+  Link &link = ble_instance->link_of(conn);
+  k_spinlock_key_t key = k_spin_lock(&conn_lock);
+  link.conn = bt_conn_ref(conn);
+  k_spin_unlock(&conn_lock, key);
+  ble_instance->state.is_advertising = false;
+  ble_instance->state.connections++;
+
+  struct bt_conn_info info;
+  if (bt_conn_get_info(conn, &info) == 0) {
+    link.params.interval = info.le.interval;
+    link.params.latency = info.le.latency;
+    link.params.timeout = info.le.timeout;
+  }
+
+  // Stop the fast advertising timer and count the time the link was down.
+  k_work_cancel_delayable(&ble_instance->adv_work);
+  int64_t latency = ble_instance->adv.connected(k_uptime_get());
+  if (latency >= 0) {
+    ble_instance->count_reconnect(latency);
+  }
+
+  // Advertising stopped with the connection. Start over for the next central.
+  if (ble_instance->state.connections < CONFIG_BT_MAX_CONN) {
+    ble_instance->adv.start(find_bonded_peer());
+    k_work_reschedule(&ble_instance->adv_work, K_NO_WAIT);
+  }
 
-  // todo: post connection event to zbus
+  ble_instance->negotiate_link(conn);
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+  // Keep the central's parameters until the queues show how busy the link is.
+  link.policy.reset(k_uptime_get());
+  k_work_reschedule(&link.policy_work, K_MSEC(CONFIG_APP_CONN_SAMPLE_MS));
+#endif
+
+  publish_conn_event(conn, true, 0);
 }
 
 /**
  * @brief A callback for when a connection is disconnected.
  * 
- * @details This function is called when a connection is disconnected. It starts scanning again.
+ * @details This function is called when a connection is disconnected. Advertising starts over
+ *          from its first phase once the connection object is recycled.
  * 
  * @param conn The connection object.
  * @param reason The reason for disconnection.
@@ -100,46 +295,402 @@ void Ble::disconnected(struct bt_conn *conn, uint8_t reason) {
   LOG_INF("Disconnected: %s (reason %u)", addr, reason);
 
   // Update the internal state
-  ble_instance->state.is_connected = false;
+  Link &link = ble_instance->link_of(conn);
+  ble_instance->state.connections--;
+  ble_instance->adv.disconnected(k_uptime_get());
+  ble_instance->adv.start(find_bonded_peer());
+  // Advertising for another central in a later phase starts over.
+  ble_instance->adv_restart = ble_instance->state.is_advertising;
+  link.params = {};
+  atomic_set(&link.max_payload, NUS_MIN_PAYLOAD);
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+  k_work_cancel_delayable(&link.policy_work);
+#endif
 
   // Unreference the connection object
-  ble_instance->auth.unref();
-  if (ble_instance->current_conn) {
-    bt_conn_unref(ble_instance->current_conn);
-    ble_instance->current_conn = nullptr;
+  ble_instance->auth.unref(conn);
+  k_spinlock_key_t key = k_spin_lock(&conn_lock);
+  struct bt_conn *old_conn = link.conn;
+  link.conn = nullptr;
+  k_spin_unlock(&conn_lock, key);
+  if (old_conn) {
+    bt_conn_unref(old_conn);
+  }
+
+  publish_conn_event(conn, false, reason);
+}
+
+/**
+ * @brief A callback for when a connection object is back in the pool.
+ * 
+ * @details Advertising can restart now that a connection object is free for the next central.
+*/
+void Ble::recycled() {
+  if (!ble_instance->state.is_advertising || ble_instance->adv_restart) {
+    k_work_reschedule(&ble_instance->adv_work, K_NO_WAIT);
+  }
+}
+
+/**
+ * @brief A callback for when the PHY is updated.
+ * 
+ * @param conn The connection object.
+ * @param param The new PHY.
+*/
+void Ble::phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param) {
+  Link &link = ble_instance->link_of(conn);
+
+  LOG_INF("PHY updated, tx %u rx %u", param->tx_phy, param->rx_phy);
+  link.params.tx_phy = param->tx_phy;
+  link.params.rx_phy = param->rx_phy;
+}
+
+/**
+ * @brief A callback for when the data length is updated.
+ * 
+ * @param conn The connection object.
+ * @param info The new data length.
+*/
+void Ble::data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info) {
+  Link &link = ble_instance->link_of(conn);
+
+  LOG_INF("Data length updated, tx %u rx %u octets", info->tx_max_len, info->rx_max_len);
+  link.params.tx_octets = info->tx_max_len;
+  link.params.rx_octets = info->rx_max_len;
+}
+
+/**
+ * @brief A callback for when the ATT MTU is updated.
+ * 
+ * @details The NUS payload follows the MTU so the NUS task can fill each notification.
+ * 
+ * @param conn The connection object.
+ * @param tx The TX MTU.
+ * @param rx The RX MTU.
+*/
+void Ble::mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx) {
+  Link &link = ble_instance->link_of(conn);
+
+  LOG_INF("MTU updated, tx %u rx %u", tx, rx);
+  link.params.mtu = MIN(tx, rx);
+
+  size_t payload = MIN(bt_nus_get_mtu(conn), NUS_MAX_PAYLOAD);
+  atomic_set(&link.max_payload, MAX(payload, NUS_MIN_PAYLOAD));
+}
+
+/**
+ * @brief A callback for when the connection parameters are updated.
+ * 
+ * @param conn The connection object.
+ * @param interval The connection interval (1.25 ms units).
+ * @param latency The peripheral latency.
+ * @param timeout The supervision timeout (10 ms units).
+*/
+void Ble::param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+  Link &link = ble_instance->link_of(conn);
+
+  LOG_INF("Connection parameters updated, interval %u latency %u timeout %u", interval, latency, timeout);
+  link.params.interval = interval;
+  link.params.latency = latency;
+  link.params.timeout = timeout;
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+  atomic_inc(&ble_instance->param_updates);
+#endif
+}
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+/**
+ * @brief Connection parameter policy work handler.
+ * 
+ * @details Samples the fullest queue of one link and requests new parameters when its
+ *          policy changes mode. Runs every CONFIG_APP_CONN_SAMPLE_MS while the link is connected.
+ * 
+ * @param item The work item.
+*/
+void Ble::policy_work_handler(struct k_work *item) {
+  Ble *ble = ble_instance;
+  Link *link = CONTAINER_OF(k_work_delayable_from_work(item), Link, policy_work);
+
+  k_spinlock_key_t key = k_spin_lock(&conn_lock);
+  struct bt_conn *conn = link->conn ? bt_conn_ref(link->conn) : nullptr;
+  k_spin_unlock(&conn_lock, key);
+  if (!conn) {
+    return;
+  }
+
+  uint32_t fill = 0;
+  if (ble->levels) {
+    fill = MAX(ble->levels->uart_to_ble(conn), ble->levels->ble_to_uart(conn));
   }
 
-  // todo: post disconnection event to zbus
+  if (link->policy.update(fill, k_uptime_get())) {
+    ble->request_conn_params(conn, link->policy.mode());
+  }
+  bt_conn_unref(conn);
+
+  k_work_reschedule(&link->policy_work, K_MSEC(CONFIG_APP_CONN_SAMPLE_MS));
 }
 
 /**
- * @brief Start scanning for BLE devices.
+ * @brief Ask the central for the parameters of a policy mode.
  * 
- * @details This function starts scanning for BLE devices.
+ * @details The central may refuse or adjust them. What it applies arrives through
+ *          param_updated().
+ * 
+ * @param conn The connection.
+ * @param mode The policy mode.
+*/
+void Ble::request_conn_params(struct bt_conn *conn, ConnPolicy::Mode mode) {
+  bool fast = (mode == ConnPolicy::Mode::FAST);
+
+  atomic_inc(fast ? &this->fast_requests : &this->idle_requests);
+  int err = bt_conn_le_param_update(conn, fast ? &fast_conn_param : &idle_conn_param);
+
+  if (err) {
+    LOG_WRN("Connection parameter update failed (err %d)", err);
+    atomic_inc(&this->request_errors);
+    return;
+  }
+  LOG_INF("Requested %s connection parameters", fast ? "fast" : "idle");
+}
+
+/**
+ * @brief Set the queues the connection parameter policy watches.
+ * 
+ * @param levels The queue fill levels. Must stay valid.
+*/
+void Ble::set_queue_levels(const QueueLevels *levels) {
+  this->levels = levels;
+}
+
+/**
+ * @brief Get the connection parameter policy counters.
+ * 
+ * @return A snapshot of the counters.
+*/
+Ble::ConnParamStats Ble::get_conn_param_stats() const {
+  return ConnParamStats{
+    .fast_requests = static_cast<uint32_t>(atomic_get(&this->fast_requests)),
+    .idle_requests = static_cast<uint32_t>(atomic_get(&this->idle_requests)),
+    .request_errors = static_cast<uint32_t>(atomic_get(&this->request_errors)),
+    .updates = static_cast<uint32_t>(atomic_get(&this->param_updates)),
+  };
+}
+#endif
+
+/**
+ * @brief Request the fastest link parameters.
+ * 
+ * @details Starts the ATT MTU exchange, data length extension and the 2M PHY update. The peer
+ *          may refuse or reduce each of them; the results arrive through the update callbacks.
+ * 
+ * @param conn The connection object.
+*/
+void Ble::negotiate_link(struct bt_conn *conn) {
+  struct bt_gatt_exchange_params *params = &exchange_params[bt_conn_index(conn)];
+
+  this->link_of(conn).params.mtu = BT_ATT_DEFAULT_LE_MTU;
+
+  params->func = mtu_exchange_cb;
+  int err = bt_gatt_exchange_mtu(conn, params);
+  if (err) {
+    LOG_WRN("MTU exchange failed to start (err %d)", err);
+  }
+
+  err = bt_conn_le_data_len_update(conn, &data_len_param);
+  if (err) {
+    LOG_WRN("Data length update failed (err %d)", err);
+  }
+
+  err = bt_conn_le_phy_update(conn, &phy_param);
+  if (err) {
+    LOG_WRN("PHY update failed (err %d)", err);
+  }
+}
+
+/**
+ * @brief Get the parameters negotiated for a connection.
+ * 
+ * @param conn The connection object.
+ * 
+ * @return The link parameters. All zero when not connected.
+*/
+Ble::LinkParams Ble::get_link_params(struct bt_conn *conn) const {
+  return this->link_of(conn).params;
+}
+
+/**
+ * @brief Get the largest NUS notification payload for a connection.
+ * 
+ * @param conn The connection object.
+ * 
+ * @return The payload size in bytes.
+*/
+size_t Ble::get_max_payload(struct bt_conn *conn) const {
+  return static_cast<size_t>(atomic_get(&this->link_of(conn).max_payload));
+}
+
+/**
+ * @brief Check whether a central enabled the NUS notifications.
+ * 
+ * @details The NUS send_enabled callback only reports the notifications of all the
+ *          connections together, so each one is checked on its CCC.
+ * 
+ * @param conn The connection object.
+ * 
+ * @return True if notifications can be sent on the connection.
+*/
+bool Ble::nus_subscribed(struct bt_conn *conn) const {
+  static const struct bt_gatt_attr *nus_tx_attr;
+
+  if (!nus_tx_attr) {
+    nus_tx_attr = bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX);
+  }
+
+  return nus_tx_attr && bt_gatt_is_subscribed(conn, nus_tx_attr, BT_GATT_CCC_NOTIFY);
+}
+
+/**
+ * @brief Start advertising the BLE device.
+ * 
+ * @details Starts with directed advertising toward the bonded central, if there is one. The
+ *          next phases and the restart after each disconnection follow by themselves.
  * 
  * @return 0 if successful, negative errno otherwise.
 */
 int Ble::start_advertising() {
   LOG_INF("Starting BLE advertising");
 
+  this->adv.start(find_bonded_peer());
+  return this->advertise();
+}
+
+/**
+ * @brief Start advertising in the current phase.
+ * 
+ * @details Fast advertising is stopped by adv_work after its time. A directed advertising
+ *          start that fails falls back to fast advertising. Any other failure is retried
+ *          by adv_work after ADV_RETRY_DELAY.
+ * 
+ * @return 0 if successful, negative errno otherwise.
+*/
+int Ble::advertise() {
+  int err;
+
+  if (this->adv.phase() == AdvPolicy::Phase::DIRECTED) {
+    // Directed advertising carries no data.
+    err = bt_le_adv_start(&directed_adv_param, NULL, 0, NULL, 0);
+    if (err == 0) {
+      this->state.is_advertising = true;
+      boot_mark(BootStage::ADVERTISING);
+      LOG_INF("Directed advertising started");
+      return 0;
+    }
+
+    LOG_WRN("Directed advertising failed to start (err %d)", err);
+    atomic_inc(&this->adv_errors);
+    this->adv.next();
+  }
+
+  bool fast = (this->adv.phase() == AdvPolicy::Phase::FAST);
+
   // Start advertising, set advertisement data, scan response data, advertisement parameters, and start advertising.
-	int err = bt_le_adv_start(adv_param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
-	if (err) {
-		LOG_ERR("Advertising failed to start (err %d)", err);
-		return err;
-	}
+  err = bt_le_adv_start(fast ? &fast_adv_param : &slow_adv_param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+  if (err) {
+    LOG_ERR("Advertising failed to start (err %d)", err);
+    atomic_inc(&this->adv_errors);
+    k_work_reschedule(&this->adv_work, ADV_RETRY_DELAY);
+    return err;
+  }
+
+  if (fast) {
+    k_work_reschedule(&this->adv_work, K_MSEC(this->adv.fast_ms()));
+  }
 
   // Update the internal state
   this->state.is_advertising = true;
-  LOG_INF("Advertising successfully started");
+  boot_mark(BootStage::ADVERTISING);
+  LOG_INF("%s advertising started", fast ? "Fast" : "Slow");
   return 0;
 }
 
+/**
+ * @brief Advertising work handler.
+ * 
+ * @details Ends fast advertising after its time, and starts advertising again after a
+ *          connection or disconnection, a directed advertising timeout or a failed start, as
+ *          long as a connection slot is free. Runs on the system workqueue, cooperative like
+ *          the Bluetooth callbacks that share the state.
+ * 
+ * @param item The work item.
+*/
+void Ble::adv_work_handler(struct k_work *item) {
+  ARG_UNUSED(item);
+
+  Ble *ble = ble_instance;
+
+  if (ble->state.connections >= CONFIG_BT_MAX_CONN) {
+    return;
+  }
+
+  if (ble->state.is_advertising) {
+    if (!ble->adv_restart && (ble->adv.phase() != AdvPolicy::Phase::FAST)) {
+      return;
+    }
+
+    int err = bt_le_adv_stop();
+    if (err) {
+      LOG_WRN("Advertising failed to stop (err %d)", err);
+    }
+    ble->state.is_advertising = false;
+    if (!ble->adv_restart) {
+      ble->adv.next();
+    }
+  }
+
+  ble->adv_restart = false;
+  (void)ble->advertise();
+}
+
+/**
+ * @brief Count a connection made after a disconnection.
+ * 
+ * @param latency_ms The time since the disconnection.
+*/
+void Ble::count_reconnect(int64_t latency_ms) {
+  atomic_val_t ms = static_cast<atomic_val_t>(MIN(latency_ms, INT32_MAX));
+
+  LOG_INF("Reconnected after %d ms", static_cast<int>(ms));
+  atomic_inc(&this->reconnects);
+  atomic_set(&this->last_reconnect_ms, ms);
+  atomic_add(&this->total_reconnect_ms, ms);
+  if (ms > atomic_get(&this->max_reconnect_ms)) {
+    atomic_set(&this->max_reconnect_ms, ms);
+  }
+}
+
+/**
+ * @brief Get the reconnection counters.
+ * 
+ * @return A snapshot of the counters.
+*/
+Ble::AdvStats Ble::get_adv_stats() const {
+  return AdvStats{
+    .reconnects = static_cast<uint32_t>(atomic_get(&this->reconnects)),
+    .last_reconnect_ms = static_cast<uint32_t>(atomic_get(&this->last_reconnect_ms)),
+    .max_reconnect_ms = static_cast<uint32_t>(atomic_get(&this->max_reconnect_ms)),
+    .total_reconnect_ms = static_cast<uint32_t>(atomic_get(&this->total_reconnect_ms)),
+    .errors = static_cast<uint32_t>(atomic_get(&this->adv_errors)),
+  };
+}
+
 /**
  * @brief Initialize the BLE device.
  * 
  * @details This function initializes the BLE device. It registers the authorization and authorization
- *          info callbacks, enables the BLE device, and starts scanning.
+ *          info callbacks and enables the BLE device. It returns without waiting for the stack:
+ *          bt_ready() loads the settings and starts advertising once it is up.
  * 
  * @return 0 if successful, negative errno otherwise.
 */
@@ -149,6 +700,14 @@ int Ble::init() {
   // Make the BLE instance available to the static methods.
   ble_instance = this;
 
+  k_work_init_delayable(&this->adv_work, adv_work_handler);
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+  for (Link &link : this->links) {
+    k_work_init_delayable(&link.policy_work, policy_work_handler);
+  }
+#endif
+
   // Use the singleton instance of the Auth class to initialize it.
   err = ble_instance->auth.init();
   if (err) {
@@ -156,22 +715,45 @@ int Ble::init() {
     return -1;
   }
 
-  // Enable the BLE device
-  err = bt_enable(NULL);
+  // Track MTU changes to size the NUS notifications.
+  bt_gatt_cb_register(&gatt_callbacks);
+
+  // Enable the BLE device. The stack comes up on the system workqueue and calls bt_ready.
+  err = bt_enable(bt_ready);
   if (err) {
     LOG_ERR("Bluetooth init failed (err %d)", err);
     return -2;
   }
 
+  return 0;
+}
+
+/**
+ * @brief A callback for when the Bluetooth stack is ready.
+ * 
+ * @details Loads the bonds and the other settings, then starts advertising. Runs on the
+ *          system workqueue while the rest of the application starts up.
+ * 
+ * @param err The error of the stack initialization.
+*/
+void Ble::bt_ready(int err) {
+  if (err) {
+    LOG_ERR("Bluetooth init failed (err %d)", err);
+    return;
+  }
+  boot_mark(BootStage::BT_ENABLED);
+
   // note: call to settings_load be after bt_enable
   // See https://developer.nordicsemi.com/nRF_Connect_SDK/doc/latest/zephyr/connectivity/bluetooth/bluetooth-arch.html#persistent-storage
   if (IS_ENABLED(CONFIG_SETTINGS)) {
     settings_load();
   }
+  boot_mark(BootStage::SETTINGS_LOADED);
 
   // Update the internal state
-  this->state.is_initialized = true;
+  ble_instance->state.is_initialized = true;
   LOG_INF("Bluetooth initialized");
 
-  return 0;
+  // Advertise to the bonded central just loaded. A failed start is retried by adv_work.
+  (void)ble_instance->start_advertising();
 }
\ No newline at end of file
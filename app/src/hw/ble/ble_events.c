@@ -0,0 +1,24 @@
+/**
+ * @file ble_events.c
+ *
+ * @brief Channel of the BLE connection events.
+ *
+ * @note This file needs to be C for ZBUS_CHAN_DEFINE, whose observer list is a compound literal.
+ */
+#include "ble_events.h"
+
+#include <zephyr/zbus/zbus.h>
+
+/**
+ * @brief Observers of the connection events.
+ *
+ * @details nus_conn_listener tracks the NUS peers and parks the sender while none is connected.
+*/
+ZBUS_OBS_DECLARE(nus_conn_listener);
+
+ZBUS_CHAN_DEFINE(ble_conn_chan,
+                 struct ble_conn_event,
+                 NULL,
+                 NULL,
+                 ZBUS_OBSERVERS(nus_conn_listener),
+                 ZBUS_MSG_INIT(.conn = NULL, .connected = false, .reason = 0));
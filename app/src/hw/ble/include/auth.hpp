@@ -21,7 +21,7 @@ public:
 
   // Insance methods
   int init();
-  void unref();
+  void unref(struct bt_conn *conn);
 
   // Public static callbacks
   // \todo: in order to use and register these callbacks, I have to set CONFIG_BT_SMP=y
@@ -3,10 +3,24 @@
 
 #include "hw_base.hpp"
 #include "auth.hpp"
+#include "adv_policy.hpp"
+#include "conn_policy.hpp"
 #include <errno.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
 #include <bluetooth/services/nus.h>
 
+/**
+ * @brief NUS payload limits.
+ * 
+ * @details A notification carries the ATT MTU minus the 3-byte ATT header. The default
+ *          MTU of 23 applies until the exchange completes.
+*/
+constexpr size_t NUS_MIN_PAYLOAD = BT_ATT_DEFAULT_LE_MTU - 3;
+constexpr size_t NUS_MAX_PAYLOAD = CONFIG_BT_L2CAP_TX_MTU - 3;
+
 /**
  * @brief BLE device.
  * 
@@ -27,32 +41,172 @@ public:
     Ble(const Ble&) = delete;
     Ble& operator=(const Ble&) = delete;
 
-    // Initialize the BLE device.
+    // Initialize the BLE device. Advertising starts once the stack is ready, then goes on by
+    // itself while a connection slot is free.
     int init() override;
 
     // Start advertising BLE device.
     int start_advertising();
 
+    /**
+     * @brief Reconnection counters.
+     * 
+     * @details A reconnection is the first connection after a disconnection. Its time runs
+     *          from the disconnection to the connection.
+    */
+    struct AdvStats {
+      uint32_t reconnects;
+      uint32_t last_reconnect_ms;
+      uint32_t max_reconnect_ms;
+      uint32_t total_reconnect_ms;
+      // Advertising starts the stack refused.
+      uint32_t errors;
+    };
+
+    // Read the reconnection counters. Safe to call from any thread.
+    AdvStats get_adv_stats() const;
+
+    /**
+     * @brief Parameters negotiated for a connection.
+    */
+    struct LinkParams {
+      uint16_t mtu;
+      uint16_t tx_octets;
+      uint16_t rx_octets;
+      uint8_t tx_phy;
+      uint8_t rx_phy;
+      // Connection interval (1.25 ms units), peripheral latency and supervision timeout (10 ms units).
+      uint16_t interval;
+      uint16_t latency;
+      uint16_t timeout;
+    };
+
+    // Read the parameters negotiated for a connection.
+    LinkParams get_link_params(struct bt_conn *conn) const;
+
+    // Largest NUS notification payload for a connection. Safe to call from any thread.
+    size_t get_max_payload(struct bt_conn *conn) const;
+
+    // Whether a central enabled the NUS notifications. Safe to call from any thread.
+    bool nus_subscribed(struct bt_conn *conn) const;
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+    /**
+     * @brief Fill levels watched by the connection parameter policy.
+     * 
+     * @details Each function returns the fill of one queue in percent, as seen by one
+     *          connection. They are called from the system workqueue.
+    */
+    struct QueueLevels {
+      uint32_t (*uart_to_ble)(struct bt_conn *conn);
+      uint32_t (*ble_to_uart)(struct bt_conn *conn);
+    };
+
+    /**
+     * @brief Counters of the connection parameter policy.
+    */
+    struct ConnParamStats {
+      uint32_t fast_requests;
+      uint32_t idle_requests;
+      // Requests the stack refused to send.
+      uint32_t request_errors;
+      // Parameter changes applied by the central.
+      uint32_t updates;
+    };
+
+    // Set the queues the connection parameter policy watches. They must stay valid.
+    void set_queue_levels(const QueueLevels *levels);
+
+    // Read the connection parameter policy counters. Safe to call from any thread.
+    ConnParamStats get_conn_param_stats() const;
+#endif
+
     // Public callbacks
     static void connected(struct bt_conn *conn, uint8_t conn_err);
     static void disconnected(struct bt_conn *conn, uint8_t reason);
+    static void recycled();
+    static void phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param);
+    static void data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info);
+    static void mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx);
+    static void param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout);
 
 private:
     // Private constructor for singleton pattern.
-    Ble() : current_conn(nullptr), state{false, false, false}, auth(Auth::get_instance()) {};
+    Ble() : state{false, false, 0}, adv(CONFIG_APP_ADV_FAST_MS), auth(Auth::get_instance()) {};
+
+    // Finish the initialization once the stack is up.
+    static void bt_ready(int err);
+
+    // Request a larger MTU, data length extension and the 2M PHY on a new connection.
+    void negotiate_link(struct bt_conn *conn);
+
+    /**
+     * @brief State of one connection, in the slot of bt_conn_index().
+    */
+    struct Link {
+      // Referenced while connected. Guarded by conn_lock, it is read from other threads.
+      struct bt_conn *conn{nullptr};
+      // Negotiated link parameters. max_payload is read by the NUS task.
+      LinkParams params{};
+      atomic_t max_payload{ATOMIC_INIT(NUS_MIN_PAYLOAD)};
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+      // Connection parameter policy, run on the system workqueue while connected.
+      ConnPolicy policy{{CONFIG_APP_CONN_BUSY_PERCENT, CONFIG_APP_CONN_IDLE_PERCENT, CONFIG_APP_CONN_IDLE_MS}};
+      struct k_work_delayable policy_work;
+#endif
+    };
+
+    Link& link_of(struct bt_conn *conn) {
+      return this->links[bt_conn_index(conn)];
+    }
 
-    // The BLE connection object
-    struct bt_conn *current_conn;
+    const Link& link_of(struct bt_conn *conn) const {
+      return this->links[bt_conn_index(conn)];
+    }
 
     // Internal states for the BLE device
     struct BleState {
       bool is_initialized;
       bool is_advertising;
-      bool is_connected;
+      uint8_t connections;
     };
 
     BleState state;
 
+    Link links[CONFIG_BT_MAX_CONN];
+
+    // Advertising phases, moved on by the connection callbacks and adv_work.
+    AdvPolicy adv;
+    struct k_work_delayable adv_work;
+    // Advertising must start over from the current phase, which changed while it ran.
+    bool adv_restart{false};
+    atomic_t reconnects;
+    atomic_t last_reconnect_ms;
+    atomic_t max_reconnect_ms;
+    atomic_t total_reconnect_ms;
+    atomic_t adv_errors;
+
+    // Start advertising in the current phase.
+    int advertise();
+
+    // Count a connection made after a disconnection.
+    void count_reconnect(int64_t latency_ms);
+
+    static void adv_work_handler(struct k_work *item);
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+    const QueueLevels *levels{nullptr};
+    atomic_t fast_requests;
+    atomic_t idle_requests;
+    atomic_t request_errors;
+    atomic_t param_updates;
+
+    // Ask a central for the parameters of a policy mode.
+    void request_conn_params(struct bt_conn *conn, ConnPolicy::Mode mode);
+
+    static void policy_work_handler(struct k_work *item);
+#endif
+
     // A reference to the auth instance
     Auth& auth;
 };
@@ -0,0 +1,42 @@
+/**
+ * @file ble_events.h
+ *
+ * @brief Connection events published by the BLE device.
+ */
+#ifndef _BLE_EVENTS_H_
+#define _BLE_EVENTS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/zbus/zbus.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bt_conn;
+
+/**
+ * @brief A connection came up or went down.
+*/
+struct ble_conn_event {
+  // Only valid while the listeners run. Take a reference to keep it.
+  struct bt_conn *conn;
+  bool connected;
+  // HCI reason of the disconnection, 0 when connected.
+  uint8_t reason;
+};
+
+/**
+ * @brief Channel of the ble_conn_event messages.
+ *
+ * @details Published from the Bluetooth stack's connection callbacks. Its listeners run
+ *          there too, so they must not block.
+*/
+ZBUS_CHAN_DECLARE(ble_conn_chan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BLE_EVENTS_H_ */
@@ -0,0 +1,382 @@
+/**
+ * @file flash_log.cpp
+ *
+ * @brief Persistent append-only log on a flash partition.
+ *
+ * @details A block in flash is a Hdr followed by its data, padded to 4 bytes. The data is
+ *          written before the first 12 bytes of the header, so a write cut short by a reset
+ *          leaves no valid block. The last word of the header, sent, is left erased and
+ *          programmed to 0 once the block was sent.
+*/
+#include "flash_log.hpp"
+#include <errno.h>
+#include <cstring>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(flash_log);
+
+constexpr uint32_t FLASH_LOG_MAGIC = 0x31474f4c; // "LOG1"
+constexpr uint32_t FLASH_LOG_ERASED = 0xffffffff;
+constexpr uint16_t FLASH_LOG_CRC_SEED = 0xffff;
+
+// Flash writes are made of whole 4 byte words, which the nRF52 NVMC requires.
+constexpr size_t FLASH_LOG_ALIGN = 4;
+
+// The header up to sent, written together with the block.
+constexpr size_t FLASH_LOG_HDR_WRITE = 12;
+constexpr size_t FLASH_LOG_HDR_SIZE = 16;
+
+static_assert(FLASH_LOG_BLOCK_SIZE % FLASH_LOG_ALIGN == 0, "Flash log block size must be a multiple of 4");
+static_assert(FLASH_LOG_BLOCK_SIZE <= UINT16_MAX, "Flash log block size must fit the 16-bit length");
+
+static size_t block_stride(size_t len) {
+  return FLASH_LOG_HDR_SIZE + ROUND_UP(len, FLASH_LOG_ALIGN);
+}
+
+static uint16_t block_crc(uint32_t seq, uint16_t len) {
+  uint16_t crc = crc16_itu_t(FLASH_LOG_CRC_SEED, reinterpret_cast<const uint8_t *>(&seq), sizeof(seq));
+  return crc16_itu_t(crc, reinterpret_cast<const uint8_t *>(&len), sizeof(len));
+}
+
+int FlashLog::init(uint8_t area_id) {
+  int err = flash_area_open(area_id, &fa_);
+  if (err) {
+    LOG_ERR("Failed to open the flash area %u (err %d)", area_id, err);
+    return err;
+  }
+
+  const struct device *dev = flash_area_get_device(fa_);
+  struct flash_pages_info info;
+  err = flash_get_page_info_by_offs(dev, fa_->fa_off, &info);
+  if (err) {
+    return err;
+  }
+
+  page_size_ = info.size;
+  pages_ = fa_->fa_size / page_size_;
+  size_t write_block_size = flash_get_write_block_size(dev);
+  if ((pages_ < 2) || (write_block_size == 0) || (FLASH_LOG_ALIGN % write_block_size != 0) ||
+      (flash_area_erased_val(fa_) != 0xff)) {
+    LOG_ERR("Flash area %u does not fit the log", area_id);
+    return -ENOTSUP;
+  }
+
+  scan();
+  LOG_INF("Flash log of %u pages, %u blocks to send", static_cast<unsigned int>(pages_),
+          static_cast<unsigned int>(atomic_get(&pending_blocks_)));
+  return 0;
+}
+
+/**
+ * @brief Find the newest block and the oldest one not sent yet.
+ *
+ * @details Writing carries on in the page after the newest block, since the rest of its
+ *          page may hold a write cut short.
+*/
+void FlashLog::scan() {
+  bool found = false;
+  bool found_pending = false;
+  uint32_t newest = 0;
+  uint32_t oldest = 0;
+  size_t newest_page = pages_ - 1;
+
+  atomic_clear(&pending_blocks_);
+  atomic_clear(&pending_bytes_);
+
+  for (size_t page = 0; page < pages_; ++page) {
+    Hdr hdr;
+    for (size_t off = 0;; off += block_stride(hdr.len)) {
+      int err = check(page, off, &hdr, nullptr);
+      if (err == -EBADMSG) {
+        // Its length can still be trusted, the blocks after it are checked on their own.
+        // Never counted as pending, so the readers skip it without touching the counts.
+        atomic_inc(&corrupt_blocks_);
+        continue;
+      }
+      if (err) {
+        break;
+      }
+
+      if (!found || (hdr.seq > newest)) {
+        found = true;
+        newest = hdr.seq;
+        newest_page = page;
+      }
+
+      if (hdr.sent != FLASH_LOG_ERASED) {
+        continue;
+      }
+
+      atomic_inc(&pending_blocks_);
+      atomic_add(&pending_bytes_, hdr.len);
+      if (!found_pending || (hdr.seq < oldest)) {
+        found_pending = true;
+        oldest = hdr.seq;
+        read_page_ = page;
+        read_off_ = off;
+      }
+    }
+  }
+
+  next_seq_ = found ? newest + 1 : 0;
+  write_page_ = newest_page;
+  write_off_ = page_size_;
+}
+
+/**
+ * @brief Check the block at a position.
+ *
+ * @param page The page.
+ * @param off The offset of the block in the page.
+ * @param hdr The header read.
+ * @param buf Where to read the data, of FLASH_LOG_BLOCK_SIZE bytes. With nullptr the data
+ *            is only read to check the CRC.
+ *
+ * @return 0, -ENOENT if there is no block, -EBADMSG if its CRC does not match, or the
+ *         error of the flash read.
+*/
+int FlashLog::check(size_t page, size_t off, Hdr *hdr, uint8_t *buf) {
+  if (off + FLASH_LOG_HDR_SIZE > page_size_) {
+    return -ENOENT;
+  }
+
+  int err = flash_area_read(fa_, offset(page, off), hdr, sizeof(*hdr));
+  if (err) {
+    return err;
+  }
+  if ((hdr->magic != FLASH_LOG_MAGIC) || (hdr->len == 0) || (hdr->len > FLASH_LOG_BLOCK_SIZE) ||
+      (off + block_stride(hdr->len) > page_size_)) {
+    return -ENOENT;
+  }
+
+  uint16_t crc = block_crc(hdr->seq, hdr->len);
+  off_t data_off = offset(page, off + FLASH_LOG_HDR_SIZE);
+  if (buf) {
+    err = flash_area_read(fa_, data_off, buf, hdr->len);
+    if (err) {
+      return err;
+    }
+    crc = crc16_itu_t(crc, buf, hdr->len);
+  } else {
+    uint8_t chunk[32];
+    for (size_t pos = 0; pos < hdr->len; pos += sizeof(chunk)) {
+      size_t len = MIN(sizeof(chunk), hdr->len - pos);
+      err = flash_area_read(fa_, data_off + pos, chunk, len);
+      if (err) {
+        return err;
+      }
+      crc = crc16_itu_t(crc, chunk, len);
+    }
+  }
+
+  return (crc == hdr->crc) ? 0 : -EBADMSG;
+}
+
+size_t FlashLog::append(const uint8_t *data, size_t len) {
+  size_t dropped = 0;
+
+  for (size_t pos = 0; pos < len;) {
+    size_t chunk = MIN(len - pos, sizeof(batch_) - batch_len_);
+    memcpy(&batch_[batch_len_], &data[pos], chunk);
+    batch_len_ += chunk;
+    pos += chunk;
+
+    if (batch_len_ == sizeof(batch_)) {
+      dropped += flush_batch();
+    }
+  }
+
+  return dropped;
+}
+
+size_t FlashLog::sync() {
+  return flush_batch();
+}
+
+/**
+ * @brief Write the batch as one block.
+ *
+ * @return The number of bytes dropped, new or old.
+*/
+size_t FlashLog::flush_batch() {
+  size_t dropped = 0;
+
+  if (batch_len_ == 0) {
+    return 0;
+  }
+
+  int err = write_block(&dropped);
+  if (err) {
+    if (err != -ENOSPC) {
+      LOG_WRN("Failed to write a flash log block (err %d)", err);
+    }
+    dropped += batch_len_;
+  }
+  batch_len_ = 0;
+
+  if (dropped > 0) {
+    atomic_add(&dropped_bytes_, dropped);
+  }
+  return dropped;
+}
+
+/**
+ * @brief Write the batch at the end of the log.
+ *
+ * @param dropped Incremented by the bytes of the blocks erased to make room.
+ *
+ * @return 0, -ENOSPC if the log is full and keeps its oldest data, or the flash error.
+*/
+int FlashLog::write_block(size_t *dropped) {
+  size_t stride = block_stride(batch_len_);
+
+  if (write_off_ + stride > page_size_) {
+    // Move on to the next page, erasing whatever was sent from it.
+    size_t next = (write_page_ + 1) % pages_;
+    if (!empty() && (read_page_ == next)) {
+      if (policy_ == Policy::DROP_NEWEST) {
+        return -ENOSPC;
+      }
+      *dropped += discard_read_page();
+    }
+
+    int err = flash_area_erase(fa_, offset(next, 0), page_size_);
+    if (err) {
+      return err;
+    }
+    atomic_inc(&erases_);
+    write_page_ = next;
+    write_off_ = 0;
+  }
+
+  // Pad the data to whole words with the erased value.
+  size_t padded = ROUND_UP(batch_len_, FLASH_LOG_ALIGN);
+  memset(&batch_[batch_len_], 0xff, padded - batch_len_);
+
+  int err = flash_area_write(fa_, offset(write_page_, write_off_ + FLASH_LOG_HDR_SIZE), batch_, padded);
+  if (err) {
+    return err;
+  }
+
+  Hdr hdr = {
+    .magic = FLASH_LOG_MAGIC,
+    .seq = next_seq_,
+    .len = static_cast<uint16_t>(batch_len_),
+    .crc = 0,
+    .sent = FLASH_LOG_ERASED,
+  };
+  hdr.crc = crc16_itu_t(block_crc(hdr.seq, hdr.len), batch_, batch_len_);
+  err = flash_area_write(fa_, offset(write_page_, write_off_), &hdr, FLASH_LOG_HDR_WRITE);
+  if (err) {
+    return err;
+  }
+
+  if (empty()) {
+    read_page_ = write_page_;
+    read_off_ = write_off_;
+  }
+  next_seq_++;
+  write_off_ += stride;
+  atomic_inc(&pending_blocks_);
+  atomic_add(&pending_bytes_, batch_len_);
+  return 0;
+}
+
+/**
+ * @brief Give up the blocks left in the page being read.
+ *
+ * @return The number of data bytes given up.
+*/
+size_t FlashLog::discard_read_page() {
+  size_t dropped = 0;
+  Hdr hdr;
+
+  for (size_t off = read_off_;; off += block_stride(hdr.len)) {
+    int err = check(read_page_, off, &hdr, nullptr);
+    if ((err != 0) && (err != -EBADMSG)) {
+      break;
+    }
+    if ((err == 0) && (hdr.sent == FLASH_LOG_ERASED) && !empty()) {
+      atomic_dec(&pending_blocks_);
+      atomic_sub(&pending_bytes_, hdr.len);
+      dropped += hdr.len;
+    }
+  }
+
+  next_read_page();
+  return dropped;
+}
+
+void FlashLog::next_read_page() {
+  read_page_ = (read_page_ + 1) % pages_;
+  read_off_ = 0;
+  peek_len_ = 0;
+}
+
+int FlashLog::peek(uint8_t *buf) {
+  // Each page is visited at most once before the blocks run out.
+  for (size_t pages = 0; !empty() && (pages <= pages_);) {
+    Hdr hdr;
+    int err = check(read_page_, read_off_, &hdr, buf);
+
+    if (err == -ENOENT) {
+      // The writer moved on to the next page here.
+      next_read_page();
+      pages++;
+      continue;
+    }
+    if (err == -EBADMSG) {
+      LOG_WRN("Skipped a corrupt flash log block of %u bytes", hdr.len);
+      atomic_inc(&corrupt_blocks_);
+    } else if (err) {
+      return err;
+    }
+
+    if (err || (hdr.sent != FLASH_LOG_ERASED)) {
+      read_off_ += block_stride(hdr.len);
+      continue;
+    }
+
+    peek_len_ = hdr.len;
+    peek_stride_ = block_stride(hdr.len);
+    return hdr.len;
+  }
+
+  // Whatever was counted is out of reach.
+  atomic_clear(&pending_blocks_);
+  atomic_clear(&pending_bytes_);
+  return 0;
+}
+
+int FlashLog::pop() {
+  // Kept in RAM, the NVMC cannot write from flash.
+  uint32_t sent = 0;
+
+  if (peek_len_ == 0) {
+    return -ENOENT;
+  }
+
+  int err = flash_area_write(fa_, offset(read_page_, read_off_ + FLASH_LOG_HDR_WRITE), &sent, sizeof(sent));
+  if (err) {
+    return err;
+  }
+
+  atomic_dec(&pending_blocks_);
+  atomic_sub(&pending_bytes_, peek_len_);
+  read_off_ += peek_stride_;
+  peek_len_ = 0;
+  return 0;
+}
+
+FlashLog::Stats FlashLog::get_stats() const {
+  return Stats{
+    .pending_blocks = static_cast<uint32_t>(atomic_get(&pending_blocks_)),
+    .pending_bytes = static_cast<uint32_t>(atomic_get(&pending_bytes_)),
+    .erases = static_cast<uint32_t>(atomic_get(&erases_)),
+    .dropped_bytes = static_cast<uint32_t>(atomic_get(&dropped_bytes_)),
+    .corrupt_blocks = static_cast<uint32_t>(atomic_get(&corrupt_blocks_)),
+  };
+}
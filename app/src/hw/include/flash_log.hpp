@@ -0,0 +1,165 @@
+#ifndef _FLASH_LOG_HPP_
+#define _FLASH_LOG_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/storage/flash_map.h>
+
+/**
+ * @brief Largest block of the log, and the size of its RAM batch. Must be a multiple of 4.
+*/
+constexpr size_t FLASH_LOG_BLOCK_SIZE = 256;
+
+/**
+ * @brief Persistent append-only log of data blocks on a flash partition.
+ *
+ * @details Appended data is batched in RAM and written in blocks of FLASH_LOG_BLOCK_SIZE,
+ *          each behind a header with a sequence number and a CRC. Blocks are written one
+ *          after the other and never span a page, so a page is erased only when the log
+ *          wraps around to it. Sending a block programs a word of its header to 0, which
+ *          the flash allows without an erase. init() scans the partition, so the blocks not
+ *          sent yet survive a reset. The batch does not.
+ *
+ *          Once every page holds blocks not sent yet, the log either erases the oldest page
+ *          or refuses the new data, see Policy.
+ *
+ *          Not thread safe, except for get_stats(). The flash calls block, an erase for
+ *          tens of milliseconds on the nRF52.
+*/
+class FlashLog {
+public:
+  enum class Policy : uint8_t {
+    DROP_OLDEST,
+    DROP_NEWEST,
+  };
+
+  /**
+   * @brief Snapshot of the log counters.
+  */
+  struct Stats {
+    // Blocks written and not sent yet, and their data bytes. The batch is not included.
+    uint32_t pending_blocks;
+    uint32_t pending_bytes;
+    uint32_t erases;
+    // Bytes lost to a full log or a flash error.
+    uint32_t dropped_bytes;
+    // Blocks skipped because their CRC did not match.
+    uint32_t corrupt_blocks;
+  };
+
+  explicit FlashLog(Policy policy) : policy_(policy) {}
+
+  FlashLog(const FlashLog&) = delete;
+  FlashLog& operator=(const FlashLog&) = delete;
+
+  /**
+   * @brief Open the partition and find the blocks not sent yet.
+   *
+   * @param area_id The flash area, e.g. FIXED_PARTITION_ID(spill_partition).
+   *
+   * @return 0, -ENOTSUP if the partition has fewer than two pages or a write block size
+   *         that does not divide 4, or the error of the flash map.
+  */
+  int init(uint8_t area_id);
+
+  /**
+   * @brief Add data at the end of the log.
+   *
+   * @details The data is batched and written once a block is full.
+   *
+   * @return The number of bytes dropped, new or old.
+  */
+  size_t append(const uint8_t *data, size_t len);
+
+  /**
+   * @brief Write the batch, even if the block is not full.
+   *
+   * @return The number of bytes dropped, new or old.
+  */
+  size_t sync();
+
+  /**
+   * @brief Read the oldest block not sent yet.
+   *
+   * @details The block stays in the log until pop().
+   *
+   * @param buf The destination, of at least FLASH_LOG_BLOCK_SIZE bytes.
+   *
+   * @return The length of the block, 0 if the log is empty, or a negative error.
+  */
+  int peek(uint8_t *buf);
+
+  /**
+   * @brief Mark the block returned by the last peek() as sent.
+   *
+   * @return 0, -ENOENT without a peeked block, or the error of the flash write.
+  */
+  int pop();
+
+  // True when no written block is waiting. The batch may still hold data.
+  bool empty() const {
+    return atomic_get(&pending_blocks_) == 0;
+  }
+
+  // Data waiting in the batch.
+  size_t batched() const {
+    return batch_len_;
+  }
+
+  // Read the counters. Safe to call from any thread.
+  Stats get_stats() const;
+
+private:
+  struct Hdr {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t len;
+    // CRC-16/CCITT-FALSE of seq, len and the data.
+    uint16_t crc;
+    // Erased until the block was sent.
+    uint32_t sent;
+  };
+
+  // Offset in the partition of a position in a page.
+  off_t offset(size_t page, size_t off) const {
+    return static_cast<off_t>(page * page_size_ + off);
+  }
+
+  void scan();
+  int check(size_t page, size_t off, Hdr *hdr, uint8_t *buf);
+  size_t flush_batch();
+  int write_block(size_t *dropped);
+  size_t discard_read_page();
+  void next_read_page();
+
+  Policy policy_;
+  const struct flash_area *fa_{nullptr};
+  size_t page_size_{0};
+  size_t pages_{0};
+
+  // Where the next block goes. A write_off_ of page_size_ starts a new page first.
+  size_t write_page_{0};
+  size_t write_off_{0};
+  uint32_t next_seq_{0};
+
+  // The oldest block not sent yet.
+  size_t read_page_{0};
+  size_t read_off_{0};
+  // Length and size in flash of the block returned by peek(), 0 when there is none.
+  size_t peek_len_{0};
+  size_t peek_stride_{0};
+
+  uint8_t batch_[FLASH_LOG_BLOCK_SIZE];
+  size_t batch_len_{0};
+
+  // Read by get_stats() from other threads.
+  atomic_t pending_blocks_{ATOMIC_INIT(0)};
+  atomic_t pending_bytes_{ATOMIC_INIT(0)};
+  atomic_t erases_{ATOMIC_INIT(0)};
+  atomic_t dropped_bytes_{ATOMIC_INIT(0)};
+  atomic_t corrupt_blocks_{ATOMIC_INIT(0)};
+};
+
+#endif // _FLASH_LOG_HPP_
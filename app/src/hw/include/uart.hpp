@@ -2,33 +2,258 @@
 #define _UART_HPP_
 
 #include "hw_base.hpp"
+#include "trace.hpp"
 #include <cstdint>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/drivers/uart.h>
 
-constexpr size_t UART_BUF_SIZE = 20;
+/**
+ * @brief UART data buffer.
+ * 
+ * @details The first word is reserved for k_fifo so buffers can be queued without copying.
+ *          The payload size bounds every DMA transfer, ring chunk and BLE notification made
+ *          from one buffer. Buffers are reference counted by UartBufPool, so parts of one
+ *          can be handed on while the UART still receives into the rest.
+ * 
+ * @tparam N The payload size in bytes.
+*/
+template<size_t N>
+struct uart_buffer {
+  static_assert((N > 0) && (N <= UINT16_MAX), "UART buffer size must fit the 16-bit length");
+
+  static constexpr size_t capacity = N;
 
-struct uart_data_t {
   void *fifo_reserved;
-  uint8_t data[UART_BUF_SIZE] {};
+  uint8_t data[N] {};
   uint16_t len{0};
+  // Stream of the UART it was received on, see Uart::id().
+  uint8_t stream{0};
+  TRACE_STAMP_FIELD(stamp)
+  // Holders of the buffer, see UartBufPool.
+  atomic_t refs{0};
 };
 
-// \todo: this should only be exposed to the uart thread
+constexpr size_t UART_BUF_SIZE = CONFIG_APP_UART_BUF_SIZE;
+constexpr size_t UART_PIPE_SIZE = CONFIG_APP_UART_PIPE_SIZE;
+
+// The buffer type used throughout the application.
+using uart_data_t = uart_buffer<UART_BUF_SIZE>;
+
+static_assert(UART_PIPE_SIZE >= 2 * UART_BUF_SIZE, "UART/NUS rings must hold at least two UART buffers");
+static_assert(CONFIG_APP_UART_TX_BUF_SIZE >= UART_BUF_SIZE, "UART TX buffer must hold at least one UART buffer");
+
+/**
+ * @brief A run of bytes received into a UART RX buffer.
+ * 
+ * @details In continuous reception mode the UART callback posts one segment per
+ *          UART_RX_RDY event. The bytes live at buf->data[offset] and stay valid until
+ *          the consumer returns buf to the pool. A segment with len 0 marks that the
+ *          UART released buf and no more data will be written to it.
+*/
+struct uart_rx_segment_t {
+  uart_data_t *buf;
+  uint16_t offset;
+  uint16_t len;
+  TRACE_STAMP_FIELD(stamp)
+};
+
+/**
+ * @brief The UARTs bridged to BLE.
+ * 
+ * @details Listed in the bridge-uarts property of the zephyr,user node, for example
+ *          bridge-uarts = <&uart0 &uart1>. The UART at index i carries stream i. Without the
+ *          property uart0 is bridged alone.
+*/
+#define UART_BRIDGE_NODE DT_PATH(zephyr_user)
+
+#if DT_NODE_HAS_PROP(UART_BRIDGE_NODE, bridge_uarts)
+constexpr size_t UART_COUNT = DT_PROP_LEN(UART_BRIDGE_NODE, bridge_uarts);
+#else
+constexpr size_t UART_COUNT = 1;
+#endif
+
+static_assert(UART_COUNT <= UINT8_MAX, "UART stream ids must fit in a byte");
+
+// \todo: this should only be exposed to the uart task
 class Uart : public HwBase<Uart> {
   friend class HwBase<Uart>;
 
 public:
-  Uart() : dev_(DEVICE_DT_GET(DT_NODELABEL(uart0))) {}
+  /**
+   * @brief Snapshot of the UART RX counters.
+  */
+  struct RxStats {
+    uint32_t bytes;
+    uint32_t dropped_bytes;
+    uint32_t restarts;
+    // Reception stopped by an overrun, framing or parity error.
+    uint32_t line_errors;
+  };
+
+  /**
+   * @brief Snapshot of the UART TX counters.
+  */
+  struct TxStats {
+    uint32_t bytes;
+    uint32_t transfers;
+    uint32_t idle_ms;
+    uint32_t queue_depth;
+    uint32_t queue_high_water;
+    // Transfers aborted after being held by CTS for CONFIG_APP_UART_TX_TIMEOUT_MS.
+    uint32_t stalls;
+    // Bytes dropped because the driver did not take a transfer.
+    uint32_t lost_bytes;
+  };
+
+  /**
+   * @brief Source of the data sent by the TX engine.
+   * 
+   * @details fill() copies up to size bytes of the data queued for uart into buf and returns
+   *          the number of bytes copied. It runs in the TX work context. depth() returns the
+   *          number of bytes queued for uart and may be called from any context.
+  */
+  struct TxSource {
+    size_t (*fill)(const Uart &uart, uint8_t *buf, size_t size);
+    size_t (*depth)(const Uart &uart);
+  };
+
+  // The UART at index id of the bridged UARTs, see UART_COUNT.
+  explicit Uart(uint8_t id);
   int init() override;
 
+  // Index among the bridged UARTs, which is also the stream it carries.
+  uint8_t id() const {
+    return id_;
+  }
+
+  // The UART with the given index, or nullptr until it is initialized.
+  static Uart *get(size_t id);
+
+  // Read the UART RX counters.
+  RxStats get_rx_stats() const;
+
+  // Wake the TX engine after data was queued for the UART. Safe to call from any context.
+  void tx_kick();
+
+  // Read the UART TX counters.
+  TxStats get_tx_stats();
+
+  // Set the queue the TX engine takes its data from.
+  void set_tx_source(const TxSource *source);
+
+  // Change the line settings at runtime. They are applied once the UART is idle.
+  int reconfigure(const struct uart_config *cfg);
+
+  // Read the line settings in use.
+  int get_config(struct uart_config *cfg) const;
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  // The segments received, as uart_rx_segment_t, for the UART task.
+  struct k_msgq *rx_queue() {
+    return &rx_msgq_;
+  }
+#else
+  // The filled RX buffers, as uart_data_t, for the UART task.
+  struct k_fifo *rx_queue() {
+    return &rx_fifo_;
+  }
+#endif
+
 private:
+  /**
+   * @brief A work item that knows its UART.
+   * 
+   * @details The handlers are shared by the instances and find theirs through uart.
+  */
+  template<typename W>
+  struct Work {
+    W work;
+    Uart *uart;
+  };
+
+  /**
+   * @brief UART TX DMA buffer.
+  */
+  struct TxBuf {
+    uint8_t data[CONFIG_APP_UART_TX_BUF_SIZE];
+    size_t len;
+    TRACE_STAMP_FIELD(stamp)
+  };
+
   const struct device *dev_;
-  struct k_work_delayable uart_work_;
+  uint8_t id_;
+  Work<struct k_work_delayable> uart_work_;
+  Work<struct k_work> tx_work_;
+  Work<struct k_work> reconfig_work_;
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  struct k_msgq rx_msgq_;
+  uart_rx_segment_t rx_msgq_buf_[CONFIG_APP_UART_RX_SEGMENT_COUNT];
+
+  // Last RX buffer the UART task has been told about.
+  uint8_t *posted_buf_{nullptr};
+#else
+  struct k_fifo rx_fifo_;
+
+  // Reception is being disabled at an end of line.
+  bool disable_req_{false};
+#endif
+
+  // RX counters, updated from the UART callback and read from threads.
+  atomic_t rx_bytes_{0};
+  atomic_t rx_dropped_bytes_{0};
+  atomic_t rx_restarts_{0};
+  atomic_t rx_line_errors_{0};
+
+  // Two DMA buffers are used in turn. While tx_active_ is being transmitted, the TX work
+  // fills the other one from the TX source and parks it in tx_next_ so the UART callback
+  // can start it as soon as the current transfer is done. Guarded by tx_lock_.
+  TxBuf tx_bufs_[2];
+  TxBuf *tx_active_{nullptr};
+  TxBuf *tx_next_{nullptr};
+  struct k_spinlock tx_lock_;
+
+  // TX counters.
+  uint32_t tx_bytes_{0};
+  uint32_t tx_transfers_{0};
+  uint64_t tx_idle_cycles_{0};
+  uint32_t tx_idle_since_{0};
+  uint32_t tx_stalls_{0};
+  uint32_t tx_lost_bytes_{0};
+
+  // Raised by tx_kick(), which may run in any context.
+  atomic_t tx_queue_high_water_{0};
+
+  const TxSource *tx_source_{nullptr};
+
+  // How long CTS may hold a transfer before it is aborted and resumed. Without flow control
+  // a transfer always completes.
+  int32_t tx_timeout_{SYS_FOREVER_MS};
+
+  // While a reconfiguration is pending, the TX engine finishes the transfer in flight and
+  // holds the next one, and reception is stopped rather than restarted. The new settings are
+  // applied once both are idle. Guarded by tx_lock_.
+  struct uart_config reconfig_cfg_;
+  bool reconfig_pending_{false};
+  bool reconfig_rx_stopping_{false};
+  bool reconfig_rx_off_{false};
+
+  int configure();
+  int apply_config(const struct uart_config &cfg);
+  void handle_event(struct uart_event *evt);
+  void tx_done();
+  void tx_start(TxBuf *buf);
+  void tx_failed(const TxBuf *buf, int err);
+  void rx_restart();
+  void tx_fill();
+  void reconfig_step();
   static void uart_callback(const struct device *dev, struct uart_event *evt, void *user_data);
   static void uart_work_handler(struct k_work *item);
+  static void tx_work_handler(struct k_work *item);
+  static void reconfig_work_handler(struct k_work *item);
 };
 
 #endif // _UART_HPP_
\ No newline at end of file
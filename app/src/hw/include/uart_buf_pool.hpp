@@ -0,0 +1,43 @@
+#ifndef _UART_BUF_POOL_HPP_
+#define _UART_BUF_POOL_HPP_
+
+#include "uart.hpp"
+#include <cstdint>
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Fixed-block pool for UART data buffers.
+ *
+ * @details All uart_data_t buffers on the data path are taken from a statically sized
+ *          k_mem_slab instead of the system heap. Allocation and release are O(1) and
+ *          never block, so both are safe to call from the UART interrupt context.
+ *          The pool size is set with CONFIG_APP_UART_BUF_COUNT.
+*/
+class UartBufPool {
+public:
+  /**
+   * @brief Snapshot of the pool usage counters.
+  */
+  struct Stats {
+    uint32_t capacity;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t alloc_failures;
+  };
+
+  // Get a cleared buffer with one reference from the pool. Returns nullptr if the pool is exhausted.
+  static uart_data_t* alloc();
+
+  // Take another reference to a buffer.
+  static void ref(uart_data_t *buf);
+
+  // Drop a reference to a buffer, which goes back to the pool with the last. Passing nullptr is a no-op.
+  static void free(uart_data_t *buf);
+
+  // Read the live usage counters.
+  static Stats get_stats();
+
+  UartBufPool() = delete;
+};
+
+#endif // _UART_BUF_POOL_HPP_
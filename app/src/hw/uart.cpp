@@ -1,96 +1,221 @@
 #include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "boot_prof.hpp"
 #include <memory>
+#include <cstdlib>
+#include <cstring>
 #include <errno.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/logging/log.h>
 
+#if defined(CONFIG_APP_UART_CONFIG_GATT)
+#include "gatt.hpp"
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/sys/byteorder.h>
+#endif
+
 LOG_MODULE_REGISTER(uart_hw);
 
 constexpr size_t UART_WAIT_FOR_BUF_DELAY = 50;
 constexpr size_t UART_RX_TIMEOUT = 50;
 
+
+/**
+ * @brief The devices of the bridged UARTs, in stream order.
+*/
+#if DT_NODE_HAS_PROP(UART_BRIDGE_NODE, bridge_uarts)
+#define UART_BRIDGE_DEVICE(node_id, prop, idx) DEVICE_DT_GET(DT_PHANDLE_BY_IDX(node_id, prop, idx)),
+
+static const struct device *const uart_devices[] = {
+  DT_FOREACH_PROP_ELEM(UART_BRIDGE_NODE, bridge_uarts, UART_BRIDGE_DEVICE)
+};
+#else
+static const struct device *const uart_devices[] = {
+  DEVICE_DT_GET(DT_NODELABEL(uart0)),
+};
+#endif
+
 /**
- * @brief FIFO buffer for UART data.
+ * @brief The initialized UARTs, for Uart::get().
 */
-K_FIFO_DEFINE(uart_rx_fifo);
+static Uart *uart_instances[UART_COUNT];
 
+#if defined(CONFIG_SETTINGS)
 /**
- * @brief Pipe used by the UART/NUS.
+ * @brief Line settings last chosen at runtime for each UART, loaded from the settings.
  * 
- * @details This pipe is used to pass data from the UART to the NUS.
+ * @details Saved as uart/cfg for the first UART, which keeps the key of a single UART, and as
+ *          uart/<id>/cfg for the others.
 */
-extern struct k_pipe nus_uart_pipe;
+static struct uart_config saved_cfg[UART_COUNT];
+static bool saved_cfg_valid[UART_COUNT];
+
+static int uart_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+  const char *next;
+  size_t id = 0;
+
+  if (!settings_name_steq(name, "cfg", &next) || next) {
+    // uart/<id>/cfg
+    char *end;
+    id = strtoul(name, &end, 10);
+    if ((end == name) || (*end != SETTINGS_NAME_SEPARATOR) ||
+        !settings_name_steq(end + 1, "cfg", &next) || next) {
+      return -ENOENT;
+    }
+  }
+  if (id >= UART_COUNT) {
+    return -ENOENT;
+  }
+  if (len != sizeof(saved_cfg[id])) {
+    return -EINVAL;
+  }
+
+  ssize_t rc = read_cb(cb_arg, &saved_cfg[id], sizeof(saved_cfg[id]));
+  if (rc < 0) {
+    return rc;
+  }
+  saved_cfg_valid[id] = true;
+  return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(uart_hw, "uart", NULL, uart_settings_set, NULL, NULL);
+#endif
 
 /**
- * @brief Make the UART instance available to the callback/handler.
+ * @brief Set up the UART at index id of the bridged UARTs.
+ * 
+ * @details The UART is only used once init() has been called.
+ * 
+ * @param id The index, below UART_COUNT.
 */
-static Uart* uart_instance;
+Uart::Uart(uint8_t id) : dev_(uart_devices[id]), id_(id) {
+  __ASSERT_NO_MSG(id < UART_COUNT);
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  k_msgq_init(&rx_msgq_, reinterpret_cast<char *>(rx_msgq_buf_), sizeof(uart_rx_segment_t),
+              CONFIG_APP_UART_RX_SEGMENT_COUNT);
+#else
+  k_fifo_init(&rx_fifo_);
+#endif
+}
 
 /**
- * @brief UART callback.
+ * @brief Get an initialized UART.
  * 
- * @param dev The UART device.
- * @param evt The UART event.
- * @param user_data User data.
+ * @param id The index among the bridged UARTs.
+ * 
+ * @return The UART, or nullptr if id is out of range or the UART is not initialized.
 */
-void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void *user_data) {
-  ARG_UNUSED(user_data);
+Uart *Uart::get(size_t id) {
+  return (id < UART_COUNT) ? uart_instances[id] : nullptr;
+}
 
-  static size_t aborted_len;
-  struct uart_data_t *buf;
-  static uint8_t *aborted_buf;
-  static bool disable_req;
+/**
+ * @brief Move on to the next TX buffer.
+ * 
+ * @details Called from the UART callback once the active buffer is out. Starts the buffer
+ *          the TX work has prepared, if any, and has the work refill the spare one.
+*/
+void Uart::tx_done() {
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  if (tx_active_) {
+    TRACE_POINT(UART_TX_DONE, tx_active_->stamp);
+  }
+  bool hold = reconfig_pending_;
+  if (hold) {
+    // Keep the next buffer for after the reconfiguration.
+    tx_active_ = nullptr;
+  } else {
+    tx_active_ = tx_next_;
+    tx_next_ = nullptr;
+  }
+  if (tx_active_) {
+    tx_bytes_ += tx_active_->len;
+    tx_transfers_++;
+    TRACE_POINT(UART_TX_START, tx_active_->stamp);
+  } else {
+    tx_idle_since_ = k_cycle_get_32();
+  }
+  TxBuf *start = tx_active_;
+  k_spin_unlock(&tx_lock_, key);
 
-  switch (evt->type) {
-    case UART_TX_DONE: {
-      // A UART TX finished. Fetch new or aborted data for next transmission.
-      LOG_DBG("UART_TX_DONE");
-      if ((evt->data.tx.len == 0) ||
-          (!evt->data.tx.buf)) {
-        // No data to send.
-        return;
-      }
+  // Send the next buffer straight away to keep the transmitter busy.
+  if (start) {
+    tx_start(start);
+  }
 
-      // get the uart data structure so we can free the memory so buf can be reused.
-      if (aborted_buf) {
-        buf = CONTAINER_OF(aborted_buf, uart_data_t, data);
-        aborted_buf = NULL;
-        aborted_len = 0;
-      } else {
-        buf = CONTAINER_OF(evt->data.tx.buf, uart_data_t, data);
-      }
+  if (hold) {
+    // The transmitter is idle. Go on with the reconfiguration.
+    k_work_submit(&reconfig_work_.work);
+    return;
+  }
 
-      // buf is freed to be used in the next transmission.
-      // \todo: use delete instead of k_free
-      k_free(buf);
+  // Refill the spare buffer from the TX source.
+  k_work_submit(&tx_work_.work);
+}
 
-      // Allocate more memory to get the next buffer from the pipe.
-      buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf))); 
-      if (!buf) {
-        LOG_WRN("Not able to allocate UART receive buffer on done");
-        return;
-      }
+/**
+ * @brief Hand the active buffer to the driver.
+ * 
+ * @param buf The buffer, already made tx_active_.
+*/
+void Uart::tx_start(TxBuf *buf) {
+  int err = uart_tx(dev_, buf->data, buf->len, tx_timeout_);
+  if (err) {
+    tx_failed(buf, err);
+  }
+}
 
-      // Put the data into the pipe.
-      buf->len = 0;
-      size_t bytes_read;
-      int err = k_pipe_get(&nus_uart_pipe, buf->data, UART_BUF_SIZE, &bytes_read, 0, K_NO_WAIT);
-      if (err < 0) {
-        LOG_WRN("nus get from nus_uart_pipe failed: %d", err);
-        k_free(buf);
-        return;
-      }
+/**
+ * @brief Drop a transfer the driver did not take.
+ * 
+ * @details No TX_DONE or TX_ABORTED follows a failed uart_tx(), so the engine moves on as if
+ *          the transfer had ended. Otherwise TX would stop for good, along with a pending
+ *          reconfiguration, which waits for TX to go idle.
+ * 
+ * @param buf The buffer that was not sent.
+ * @param err The error of uart_tx().
+*/
+void Uart::tx_failed(const TxBuf *buf, int err) {
+  LOG_WRN("Failed to send data over UART %u (err: %d), %u bytes lost", id_, err,
+          static_cast<unsigned int>(buf->len));
 
-      // Update the length based on actual bytes read
-      buf->len = bytes_read;
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  tx_bytes_ -= buf->len;
+  tx_transfers_--;
+  tx_lost_bytes_ += buf->len;
+  k_spin_unlock(&tx_lock_, key);
 
-      // Send the data over UART.
-      if (uart_tx(dev, buf->data, buf->len, SYS_FOREVER_MS)) {
-        LOG_WRN("Failed to send data over UART");
-        // Don't free buf here. UART is async: uart_tx returns immediately and event handler, set using 
-        // uart_callback_set (so this uart_callback f'n), is called after transfer is finished.
-      }
+  tx_done();
+}
 
+/**
+ * @brief UART callback.
+ * 
+ * @param dev The UART device.
+ * @param evt The UART event.
+ * @param user_data The Uart the device belongs to.
+*/
+void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void *user_data) {
+  ARG_UNUSED(dev);
+
+  static_cast<Uart *>(user_data)->handle_event(evt);
+}
+
+/**
+ * @brief Handle an event of the UART driver.
+ * 
+ * @param evt The UART event.
+*/
+void Uart::handle_event(struct uart_event *evt) {
+  uart_data_t *buf;
+
+  switch (evt->type) {
+    case UART_TX_DONE: {
+      // A UART TX finished.
+      LOG_DBG("UART_TX_DONE");
+      tx_done();
       break;
     }
     case UART_RX_RDY: {
@@ -99,9 +224,31 @@ void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void
 
       // Get the buffer from the event.
       buf = CONTAINER_OF(evt->data.rx.buf, uart_data_t, data);
+      if (buf->len == 0) {
+        // First bytes in this buffer.
+        TRACE_STAMP(buf->stamp);
+      }
       buf->len += evt->data.rx.len;
-
-      if (disable_req) {
+      atomic_add(&rx_bytes_, evt->data.rx.len);
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+      {
+        // Pass the new bytes to the UART task. The UART keeps receiving into the buffer chain.
+        struct uart_rx_segment_t seg = {
+          .buf = buf,
+          .offset = static_cast<uint16_t>(evt->data.rx.offset),
+          .len = static_cast<uint16_t>(evt->data.rx.len),
+        };
+        TRACE_STAMP(seg.stamp);
+
+        if (k_msgq_put(&rx_msgq_, &seg, K_NO_WAIT) == 0) {
+          posted_buf_ = evt->data.rx.buf;
+        } else {
+          atomic_add(&rx_dropped_bytes_, evt->data.rx.len);
+        }
+      }
+#else
+      if (disable_req_) {
         // RX is disabled so stop.
         return;
       }
@@ -109,32 +256,45 @@ void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void
       // Check for end of line. Disable RX if end of line is found.
       if ((evt->data.rx.buf[buf->len - 1] == '\n') ||
           (evt->data.rx.buf[buf->len - 1] == '\r')) {
-        disable_req = true;
-        uart_rx_disable(dev);
+        disable_req_ = true;
+        uart_rx_disable(dev_);
       }
+#endif
 
       break;
     }
     case UART_RX_DISABLED: {
       // The UART RX is disabled.
       LOG_DBG("UART_RX_DISABLED");
-      disable_req = false;
+#if !defined(CONFIG_APP_UART_RX_CONTINUOUS)
+      disable_req_ = false;
+#endif
+      atomic_inc(&rx_restarts_);
+
+      {
+        k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+        bool hold = reconfig_pending_;
+        reconfig_rx_off_ = hold;
+        k_spin_unlock(&tx_lock_, key);
+
+        if (hold) {
+          // Reception restarts with the new settings.
+          k_work_submit(&reconfig_work_.work);
+          return;
+        }
+      }
 
-      // Allocate a new buffer using new.
-      // \todo: Use make_unique for exception safety
-      buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
-      if (buf) {
-        buf->len = 0;
-      } else {
+      // Take a new buffer from the pool.
+      buf = UartBufPool::alloc();
+      if (!buf) {
         LOG_WRN("Not able to allocate UART receive buffer on disabled");
         // Reschedule the work to try again.
-        k_work_reschedule(&uart_instance->uart_work_, K_MSEC(UART_WAIT_FOR_BUF_DELAY));
+        k_work_reschedule(&uart_work_.work, K_MSEC(UART_WAIT_FOR_BUF_DELAY));
         return;
       }
 
       // Enable RX with the new buffer.
-      // \todo: why can't we use uart_instance->dev_ here? It's null. uart_instance->uart_work_ seems fine.
-      uart_rx_enable(dev, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
+      uart_rx_enable(dev_, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
 
       break;
     }
@@ -142,11 +302,10 @@ void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void
       // A UART RX buffer is requested. Allocate a buffer and send it to the UART.
       LOG_DBG("UART_RX_BUF_REQUEST");
 
-      // Allocate a new buffer and send it to the UART.
-      buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
+      // Take a new buffer from the pool and send it to the UART.
+      buf = UartBufPool::alloc();
       if (buf) {
-        buf->len = 0;
-        uart_rx_buf_rsp(dev, buf->data, sizeof(buf->data));
+        uart_rx_buf_rsp(dev_, buf->data, sizeof(buf->data));
       } else {
         LOG_WRN("Not able to allocate UART receive buffer on request");
       }
@@ -154,31 +313,72 @@ void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void
       break;
     }
     case UART_RX_BUF_RELEASED: {
-      // A UART buffer is released. Put buffer into FIFO (if not empty) or delete it.
       LOG_DBG("UART_RX_BUF_RELEASED");
       buf = CONTAINER_OF(evt->data.rx_buf.buf, uart_data_t, data);
+      if (buf->len > 0) {
+        TRACE_POINT(UART_RX_BUF_RELEASED, buf->stamp);
+      }
 
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+      // A UART buffer is released. If the UART task never saw it, return it to the pool here.
+      // Otherwise tell the thread it is complete so it can release it once its segments are consumed.
+      if (posted_buf_ != evt->data.rx_buf.buf) {
+        UartBufPool::free(buf);
+      } else {
+        struct uart_rx_segment_t seg = { .buf = buf, .offset = 0, .len = 0 };
+
+        // If the queue is full the UART task releases the buffer when data for the next one arrives.
+        (void)k_msgq_put(&rx_msgq_, &seg, K_NO_WAIT);
+        posted_buf_ = nullptr;
+      }
+#else
+      // A UART buffer is released. Put buffer into FIFO (if not empty) or return it to the pool.
       if (buf->len > 0) {
-        k_fifo_put(&uart_rx_fifo, buf);
+        k_fifo_put(&rx_fifo_, buf);
       } else {
-        // \todo: use delete instead of k_free
-        k_free(buf);
+        UartBufPool::free(buf);
       }
+#endif
 
       break;
     }
+    case UART_RX_STOPPED: {
+      // RX stopped because of a line error. UART_RX_DISABLED follows and restarts reception.
+      LOG_WRN("UART %u RX stopped (reason %d)", id_, evt->data.rx_stop.reason);
+      atomic_inc(&rx_line_errors_);
+      break;
+    }
     case UART_TX_ABORTED: {
-      // A UART TX was aborted. Save the buffer and length.
+      // CTS held the transfer past its timeout. Send the rest of the active buffer.
       LOG_DBG("UART_TX_ABORTED");
-      if (!aborted_buf) {
-        aborted_buf = const_cast<uint8_t *>(evt->data.tx.buf);
+
+      k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+      TxBuf *active = tx_active_;
+      if (active) {
+        tx_stalls_++;
       }
+      k_spin_unlock(&tx_lock_, key);
 
-      aborted_len += evt->data.tx.len;
-      buf = CONTAINER_OF(aborted_buf, uart_data_t, data);
+      if (!active) {
+        break;
+      }
 
-      // Send the rest of the aborted data over UART.
-      uart_tx(dev, &buf->data[aborted_len], buf->len - aborted_len, SYS_FOREVER_MS);
+      // The event covers the bytes sent since the last (re)start, which may be the rest of an
+      // earlier aborted transfer.
+      const uint8_t *rest = evt->data.tx.buf + evt->data.tx.len;
+      size_t rest_len = (active->data + active->len) - rest;
+
+      if (rest_len == 0) {
+        // Everything went out before the abort took effect.
+        tx_done();
+      } else if (uart_tx(dev_, rest, rest_len, tx_timeout_)) {
+        // Move on rather than leave the engine waiting for a transfer that never ends.
+        LOG_WRN("Failed to resume UART TX, %u bytes lost", static_cast<unsigned int>(rest_len));
+        key = k_spin_lock(&tx_lock_);
+        tx_lost_bytes_ += rest_len;
+        k_spin_unlock(&tx_lock_, key);
+        tx_done();
+      }
       break;
     }
     default: {
@@ -191,26 +391,378 @@ void Uart::uart_callback(const struct device *dev, struct uart_event *evt, void
  * @brief UART delayable work handler.
  * 
  * @details This handler is used with the delayable work structure.
- *          It allocates a new buffer and enables UART RX.
+ *          It takes a new buffer from the pool and enables UART RX.
  * 
  * @param item The work item.
 */
 void Uart::uart_work_handler(struct k_work *item) {
-	struct uart_data_t *buf;
-
-  // \todo: use unique_ptr to ensure it's deallocated properly when it goes out of...
-  // ...scope or an exception is thrown, preventing memory leaks.
-  buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
-	if (buf) {
-		buf->len = 0;
-	} else {
-		LOG_WRN("Not able to allocate UART receive buffer in handler");
-		k_work_reschedule(&uart_instance->uart_work_, K_MSEC(UART_WAIT_FOR_BUF_DELAY));
-		return;
-	}
+  auto work = CONTAINER_OF(k_work_delayable_from_work(item), Work<struct k_work_delayable>, work);
+  work->uart->rx_restart();
+}
+
+void Uart::rx_restart() {
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  bool hold = reconfig_pending_;
+  k_spin_unlock(&tx_lock_, key);
+  if (hold) {
+    // The reconfiguration restarts reception.
+    return;
+  }
+
+  uart_data_t *buf = UartBufPool::alloc();
+  if (!buf) {
+    LOG_WRN("Not able to allocate UART receive buffer in handler");
+    k_work_reschedule(&uart_work_.work, K_MSEC(UART_WAIT_FOR_BUF_DELAY));
+    return;
+  }
 
   // Enable RX. Pass it the raw pointer to the data buffer.
-	uart_rx_enable(uart_instance->dev_, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
+  uart_rx_enable(dev_, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
+}
+
+/**
+ * @brief UART TX work handler.
+ * 
+ * @details Fills the free TX buffer(s) with as much data as the TX source holds and starts
+ *          the transmission if the UART is idle. Runs whenever data is queued for the UART
+ *          and after every completed transfer.
+ * 
+ * @param item The work item.
+*/
+void Uart::tx_work_handler(struct k_work *item) {
+  CONTAINER_OF(item, Work<struct k_work>, work)->uart->tx_fill();
+}
+
+void Uart::tx_fill() {
+  while (true) {
+    // Pick the buffer that is neither being transmitted nor waiting.
+    k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+    TxBuf *spare = nullptr;
+    if (!tx_next_) {
+      spare = (tx_active_ == &tx_bufs_[0]) ? &tx_bufs_[1] : &tx_bufs_[0];
+    }
+    k_spin_unlock(&tx_lock_, key);
+
+    if (!spare) {
+      // Both buffers are in use. TX_DONE submits the work again.
+      return;
+    }
+
+    // Take the largest chunk the source can give.
+    size_t bytes_read = tx_source_ ? tx_source_->fill(*this, spare->data, sizeof(spare->data)) : 0;
+    if (bytes_read == 0) {
+      return;
+    }
+    spare->len = bytes_read;
+    TRACE_STAMP(spare->stamp);
+
+    // Start right away if the UART is idle, otherwise park it for the UART callback or the
+    // end of a reconfiguration.
+    bool start = false;
+    key = k_spin_lock(&tx_lock_);
+    if (!tx_active_ && !reconfig_pending_) {
+      tx_active_ = spare;
+      tx_bytes_ += spare->len;
+      tx_transfers_++;
+      tx_idle_cycles_ += k_cycle_get_32() - tx_idle_since_;
+      TRACE_POINT(UART_TX_START, spare->stamp);
+      start = true;
+    } else {
+      tx_next_ = spare;
+    }
+    k_spin_unlock(&tx_lock_, key);
+
+    if (start) {
+      // A failure moves the engine on, so the loop goes on with the next chunk.
+      tx_start(spare);
+    }
+  }
+}
+
+/**
+ * @brief Wake the TX engine.
+ * 
+ * @details Call after data was queued in the TX source. Safe to call from any context.
+*/
+void Uart::tx_kick() {
+  atomic_val_t depth = tx_source_ ? tx_source_->depth(*this) : 0;
+  atomic_val_t peak = atomic_get(&tx_queue_high_water_);
+  while (depth > peak) {
+    if (atomic_cas(&tx_queue_high_water_, peak, depth)) {
+      break;
+    }
+    peak = atomic_get(&tx_queue_high_water_);
+  }
+
+  k_work_submit(&tx_work_.work);
+}
+
+/**
+ * @brief Set the queue the TX engine takes its data from.
+ * 
+ * @details Set it before data is queued. The source must stay valid while the UART is in use.
+ * 
+ * @param source The TX source.
+*/
+void Uart::set_tx_source(const TxSource *source) {
+  tx_source_ = source;
+}
+
+/**
+ * @brief Get the UART TX counters.
+ * 
+ * @return A snapshot of the counters.
+*/
+Uart::TxStats Uart::get_tx_stats() {
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  uint64_t idle = tx_idle_cycles_;
+  if (!tx_active_) {
+    idle += k_cycle_get_32() - tx_idle_since_;
+  }
+  TxStats stats{
+    .bytes = tx_bytes_,
+    .transfers = tx_transfers_,
+    .idle_ms = static_cast<uint32_t>(k_cyc_to_ms_floor64(idle)),
+    .queue_depth = static_cast<uint32_t>(tx_source_ ? tx_source_->depth(*this) : 0),
+    .queue_high_water = static_cast<uint32_t>(atomic_get(&tx_queue_high_water_)),
+    .stalls = tx_stalls_,
+    .lost_bytes = tx_lost_bytes_,
+  };
+  k_spin_unlock(&tx_lock_, key);
+
+  return stats;
+}
+
+/**
+ * @brief Get the UART RX counters.
+ * 
+ * @return A snapshot of the counters.
+*/
+Uart::RxStats Uart::get_rx_stats() const {
+  return RxStats{
+    .bytes = static_cast<uint32_t>(atomic_get(&rx_bytes_)),
+    .dropped_bytes = static_cast<uint32_t>(atomic_get(&rx_dropped_bytes_)),
+    .restarts = static_cast<uint32_t>(atomic_get(&rx_restarts_)),
+    .line_errors = static_cast<uint32_t>(atomic_get(&rx_line_errors_)),
+  };
+}
+
+/**
+ * @brief Use a line configuration from here on.
+ * 
+ * @details Only call while nothing is being transmitted or received.
+ * 
+ * @param cfg The line configuration.
+ * 
+ * @return 0 if successful, otherwise negative error code.
+*/
+int Uart::apply_config(const struct uart_config &cfg) {
+  int err = uart_configure(dev_, &cfg);
+  if (err) {
+    return err;
+  }
+
+  tx_timeout_ = (cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS) ? CONFIG_APP_UART_TX_TIMEOUT_MS : SYS_FOREVER_MS;
+
+  LOG_INF("UART %u at %u baud, parity %u, flow control %s", id_, cfg.baudrate, cfg.parity,
+          (cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS) ? "RTS/CTS" : "off");
+  return 0;
+}
+
+/**
+ * @brief Apply the line settings saved at runtime, or else those chosen in Kconfig.
+ * 
+ * @return 0 if successful, otherwise negative error code.
+*/
+int Uart::configure() {
+  bool saved = false;
+
+#if defined(CONFIG_SETTINGS)
+  // Load only the UART settings, the BLE stack loads the rest once it is enabled. The first
+  // UART loads them for all.
+  if (id_ == 0) {
+    int load_err = settings_subsys_init();
+    if (!load_err) {
+      load_err = settings_load_subtree("uart");
+    }
+    if (load_err) {
+      LOG_WRN("Cannot load the UART settings (err: %d)", load_err);
+    }
+  }
+  saved = saved_cfg_valid[id_];
+#endif
+
+  if (!saved && (CONFIG_APP_UART_BAUDRATE == 0) && !IS_ENABLED(CONFIG_APP_UART_HW_FLOW_CONTROL)) {
+    // Keep the devicetree settings.
+    return 0;
+  }
+
+  struct uart_config cfg;
+  int err = uart_config_get(this->dev_, &cfg);
+  if (err) {
+    return err;
+  }
+
+  if (CONFIG_APP_UART_BAUDRATE > 0) {
+    cfg.baudrate = CONFIG_APP_UART_BAUDRATE;
+  }
+  if (IS_ENABLED(CONFIG_APP_UART_HW_FLOW_CONTROL)) {
+    cfg.flow_ctrl = UART_CFG_FLOW_CTRL_RTS_CTS;
+  }
+#if defined(CONFIG_SETTINGS)
+  if (saved) {
+    cfg = saved_cfg[id_];
+  }
+#endif
+
+  return apply_config(cfg);
+}
+
+/**
+ * @brief Change the line settings at runtime.
+ * 
+ * @details The UART finishes the transfer in flight and stops reception, then applies cfg,
+ *          saves it in the settings and restarts both directions. Data queued meanwhile is
+ *          sent with the new settings. If the driver rejects cfg, the UART restarts with the
+ *          old settings. Safe to call from any thread.
+ * 
+ * @param cfg The line configuration.
+ * 
+ * @return 0 if the reconfiguration started, -EINVAL for invalid settings, -EBUSY while a
+ *         reconfiguration is in progress, -ENODEV before the UART is initialized.
+*/
+int Uart::reconfigure(const struct uart_config *cfg) {
+  if ((cfg->baudrate == 0) || (cfg->parity > UART_CFG_PARITY_SPACE) ||
+      (cfg->stop_bits > UART_CFG_STOP_BITS_2) || (cfg->data_bits > UART_CFG_DATA_BITS_9) ||
+      ((cfg->flow_ctrl != UART_CFG_FLOW_CTRL_NONE) && (cfg->flow_ctrl != UART_CFG_FLOW_CTRL_RTS_CTS))) {
+    return -EINVAL;
+  }
+  if (get(id_) != this) {
+    return -ENODEV;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  if (reconfig_pending_) {
+    k_spin_unlock(&tx_lock_, key);
+    return -EBUSY;
+  }
+  reconfig_cfg_ = *cfg;
+  reconfig_pending_ = true;
+  reconfig_rx_stopping_ = false;
+  reconfig_rx_off_ = false;
+  k_spin_unlock(&tx_lock_, key);
+
+  // Stop reception from the work queue, where it cannot race the RX restart work.
+  k_work_submit(&reconfig_work_.work);
+  return 0;
+}
+
+/**
+ * @brief Read the line settings in use.
+ * 
+ * @param cfg Filled with the line configuration.
+ * 
+ * @return 0 if successful, otherwise negative error code.
+*/
+int Uart::get_config(struct uart_config *cfg) const {
+  if (get(id_) != this) {
+    return -ENODEV;
+  }
+
+  return uart_config_get(dev_, cfg);
+}
+
+/**
+ * @brief Reconfiguration work handler.
+ * 
+ * @details Runs when a reconfiguration starts, when the last transfer is done and when
+ *          reception has stopped. Applies the new settings once the UART is idle.
+ * 
+ * @param item The work item.
+*/
+void Uart::reconfig_work_handler(struct k_work *item) {
+  CONTAINER_OF(item, Work<struct k_work>, work)->uart->reconfig_step();
+}
+
+void Uart::reconfig_step() {
+  k_spinlock_key_t key = k_spin_lock(&tx_lock_);
+  bool pending = reconfig_pending_;
+  bool rx_off = reconfig_rx_off_;
+  bool rx_stopping = reconfig_rx_stopping_;
+  bool tx_busy = (tx_active_ != nullptr);
+  struct uart_config cfg = reconfig_cfg_;
+  k_spin_unlock(&tx_lock_, key);
+
+  if (!pending) {
+    return;
+  }
+
+  if (!rx_off) {
+    if (!rx_stopping && uart_rx_disable(dev_)) {
+      // Reception is already off, waiting for a buffer.
+      k_work_cancel_delayable(&uart_work_.work);
+      rx_off = true;
+    }
+
+    key = k_spin_lock(&tx_lock_);
+    reconfig_rx_stopping_ = true;
+    reconfig_rx_off_ |= rx_off;
+    k_spin_unlock(&tx_lock_, key);
+
+    if (!rx_off) {
+      // The received bytes are flushed to the UART task, then UART_RX_DISABLED submits
+      // the work again.
+      return;
+    }
+  }
+
+  if (tx_busy) {
+    // The end of the transfer submits the work again.
+    return;
+  }
+
+  int err = apply_config(cfg);
+  if (err) {
+    LOG_WRN("Cannot reconfigure UART %u (err: %d)", id_, err);
+  }
+#if defined(CONFIG_SETTINGS)
+  if (!err) {
+    char key_name[sizeof("uart/255/cfg")];
+    if (id_ == 0) {
+      strcpy(key_name, "uart/cfg");
+    } else {
+      snprintk(key_name, sizeof(key_name), "uart/%u/cfg", id_);
+    }
+
+    err = settings_save_one(key_name, &cfg, sizeof(cfg));
+    if (err) {
+      LOG_WRN("Cannot save the UART settings (err: %d)", err);
+    }
+  }
+#endif
+
+  // Resume transmission with the buffer held back, if any.
+  key = k_spin_lock(&tx_lock_);
+  reconfig_pending_ = false;
+  TxBuf *start = nullptr;
+  if (!tx_active_ && tx_next_) {
+    tx_active_ = tx_next_;
+    tx_next_ = nullptr;
+    tx_bytes_ += tx_active_->len;
+    tx_transfers_++;
+    tx_idle_cycles_ += k_cycle_get_32() - tx_idle_since_;
+    TRACE_POINT(UART_TX_START, tx_active_->stamp);
+    start = tx_active_;
+  }
+  k_spin_unlock(&tx_lock_, key);
+
+  if (start) {
+    tx_start(start);
+  }
+  k_work_submit(&tx_work_.work);
+
+  // Restart reception.
+  k_work_reschedule(&uart_work_.work, K_NO_WAIT);
 }
 
 /**
@@ -219,45 +771,151 @@ void Uart::uart_work_handler(struct k_work *item) {
  * @return int 0 if successful, otherwise negative error code.
 */
 int Uart::init() {
-  // Make the UART instance available to the static methods.
-  uart_instance = this;
-
   int err;
-  struct uart_data_t *rx;
+  uart_data_t *rx;
 
   // Check if the UART device is ready.
   if (!device_is_ready(this->dev_)) {
-    LOG_ERR("UART device not ready");
+    LOG_ERR("UART %u device not ready", id_);
     return -ENODEV;
   }
 
-  // Allocate a new buffer for the UART RX.
-  // \todo: convert to std::make_unique: Using malloc because other C bits are using malloc/free.
-  rx = static_cast<uart_data_t*>(k_malloc(sizeof(*rx)));
-  if (rx) {
-    rx->len = 0;
-  } else {
-    return -ENOMEM;
+  // Set the line up before anything is received or sent.
+  err = configure();
+  if (err) {
+    LOG_ERR("Cannot configure UART %u (err: %d)", id_, err);
+    return err;
   }
 
-  // Initialize the delayable work structure.
-  k_work_init_delayable(&this->uart_work_, uart_work_handler);
+  // Take the first buffer for the UART RX from the pool.
+  rx = UartBufPool::alloc();
+  if (!rx) {
+    return -ENOMEM;
+  }
 
-  // Set the UART callback.
-  err = uart_callback_set(this->dev_, uart_callback, nullptr);
+  // Initialize the work structures. The handlers find this instance through them.
+  k_work_init_delayable(&this->uart_work_.work, uart_work_handler);
+  this->uart_work_.uart = this;
+  k_work_init(&this->tx_work_.work, tx_work_handler);
+  this->tx_work_.uart = this;
+  k_work_init(&this->reconfig_work_.work, reconfig_work_handler);
+  this->reconfig_work_.uart = this;
+  tx_idle_since_ = k_cycle_get_32();
+
+  // Set the UART callback. It finds this instance through the user data.
+  err = uart_callback_set(this->dev_, uart_callback, this);
   if (err) {
-    k_free(rx);
+    UartBufPool::free(rx);
     return err;
   }
 
+  // Make the UART available to Uart::get().
+  uart_instances[id_] = this;
+
   // Enable UART RX. Pass it the raw pointer to the data buffer.
   err = uart_rx_enable(this->dev_, rx->data, sizeof(rx->data), UART_RX_TIMEOUT);  
   if (err) {
     LOG_ERR("Cannot enable uart reception (err: %d)", err);
-    k_free(rx);
+    uart_instances[id_] = nullptr;
+    UartBufPool::free(rx);
+    return err;
+  }
+  if (id_ == 0) {
+    boot_mark(BootStage::UART_RX);
   }
 
-  LOG_INF("UART initialized");
+  // Send anything that was queued before the UART was ready.
+  tx_kick();
+
+  LOG_INF("UART %u initialized", id_);
 
   return err;
-}
\ No newline at end of file
+}
+
+#if defined(CONFIG_APP_UART_CONFIG_GATT)
+#define BT_UUID_UART_CONFIG_SERVICE_VAL BT_UUID_128_ENCODE(0x8e7f1a50, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_UART_CONFIG_VAL BT_UUID_128_ENCODE(0x8e7f1a51, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+
+// Baud rate (le32), then parity, stop bits, data bits and flow control as in struct uart_config.
+// With several UARTs, a ninth byte selects the UART.
+constexpr size_t UART_CONFIG_VALUE_SIZE = 8;
+constexpr size_t UART_CONFIG_VALUE_MAX = (UART_COUNT > 1) ? UART_CONFIG_VALUE_SIZE + 1 : UART_CONFIG_VALUE_SIZE;
+
+// The UART read and written, chosen by the last write. The first one until then.
+static uint8_t uart_config_id;
+
+static struct bt_uuid_128 uart_config_service_uuid = BT_UUID_INIT_128(BT_UUID_UART_CONFIG_SERVICE_VAL);
+static struct bt_uuid_128 uart_config_uuid = BT_UUID_INIT_128(BT_UUID_UART_CONFIG_VAL);
+
+static struct bt_gatt_chrc uart_config_chrc = BT_GATT_CHRC_INIT(&uart_config_uuid.uuid, 0U,
+                                                                BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE);
+
+static ssize_t uart_config_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                                uint16_t len, uint16_t offset) {
+  struct uart_config cfg;
+  Uart *uart = Uart::get(uart_config_id);
+  if (!uart || uart->get_config(&cfg)) {
+    return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+  }
+
+  uint8_t value[UART_CONFIG_VALUE_MAX];
+  sys_put_le32(cfg.baudrate, &value[0]);
+  value[4] = cfg.parity;
+  value[5] = cfg.stop_bits;
+  value[6] = cfg.data_bits;
+  value[7] = cfg.flow_ctrl;
+  if constexpr (UART_CONFIG_VALUE_MAX > UART_CONFIG_VALUE_SIZE) {
+    value[UART_CONFIG_VALUE_SIZE] = uart_config_id;
+  }
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static ssize_t uart_config_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+                                 uint16_t len, uint16_t offset, uint8_t flags) {
+  ARG_UNUSED(conn);
+  ARG_UNUSED(attr);
+  ARG_UNUSED(flags);
+
+  if ((offset != 0) || (len < UART_CONFIG_VALUE_SIZE) || (len > UART_CONFIG_VALUE_MAX)) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+
+  const uint8_t *value = static_cast<const uint8_t *>(buf);
+  uint8_t id = (len > UART_CONFIG_VALUE_SIZE) ? value[UART_CONFIG_VALUE_SIZE] : 0;
+  Uart *uart = Uart::get(id);
+  if (!uart) {
+    return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+  }
+  uart_config_id = id;
+
+  struct uart_config cfg = {
+    .baudrate = sys_get_le32(&value[0]),
+    .parity = value[4],
+    .stop_bits = value[5],
+    .data_bits = value[6],
+    .flow_ctrl = value[7],
+  };
+
+  // The write is answered before the switch. Read the characteristic to see the settings
+  // in use.
+  switch (uart->reconfigure(&cfg)) {
+    case 0:
+      return len;
+    case -EINVAL:
+      return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    case -EBUSY:
+      return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    default:
+      return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+  }
+}
+
+BT_GATT_SERVICE_DEFINE(uart_config_svc,
+  GATT_PRIMARY_SERVICE(&uart_config_service_uuid.uuid),
+  GATT_CHRC_DECLARATION(&uart_config_chrc),
+  // Anyone in range could otherwise change the line settings and save them for good, so a
+  // write needs an encrypted link.
+  BT_GATT_ATTRIBUTE(&uart_config_uuid.uuid, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT, uart_config_read, uart_config_write, NULL),
+);
+#endif
@@ -0,0 +1,91 @@
+#include "uart_buf_pool.hpp"
+#include <new>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(uart_buf_pool);
+
+/**
+ * @brief Slab backing the UART data buffers.
+*/
+K_MEM_SLAB_DEFINE_STATIC(uart_buf_slab, sizeof(uart_data_t), CONFIG_APP_UART_BUF_COUNT, alignof(uart_data_t));
+
+/**
+ * @brief Live usage counters.
+ *
+ * @details Atomics are used because the pool is shared between the UART ISR and threads.
+*/
+static atomic_t in_use;
+static atomic_t high_water;
+static atomic_t alloc_failures;
+
+/**
+ * @brief Allocate a buffer from the pool.
+ *
+ * @details Never blocks, so it can be called from the UART callback.
+ *
+ * @return Pointer to a cleared buffer, or nullptr if the pool is exhausted.
+*/
+uart_data_t* UartBufPool::alloc() {
+  void *block;
+
+  if (k_mem_slab_alloc(&uart_buf_slab, &block, K_NO_WAIT) != 0) {
+    atomic_inc(&alloc_failures);
+    return nullptr;
+  }
+
+  // Track the current use and raise the high-water mark if needed.
+  atomic_val_t used = atomic_inc(&in_use) + 1;
+  atomic_val_t peak = atomic_get(&high_water);
+  while (used > peak) {
+    if (atomic_cas(&high_water, peak, used)) {
+      break;
+    }
+    peak = atomic_get(&high_water);
+  }
+
+  uart_data_t *buf = new (block) uart_data_t{};
+  atomic_set(&buf->refs, 1);
+  return buf;
+}
+
+/**
+ * @brief Take another reference to a buffer.
+ *
+ * @details Safe from any context, like free().
+ *
+ * @param buf The buffer, which the caller holds a reference to.
+*/
+void UartBufPool::ref(uart_data_t *buf) {
+  atomic_inc(&buf->refs);
+}
+
+/**
+ * @brief Drop a reference to a buffer.
+ *
+ * @details The buffer returns to the pool when its last reference is dropped.
+ *
+ * @param buf The buffer to release. May be nullptr.
+*/
+void UartBufPool::free(uart_data_t *buf) {
+  if (!buf || (atomic_dec(&buf->refs) != 1)) {
+    return;
+  }
+
+  k_mem_slab_free(&uart_buf_slab, static_cast<void*>(buf));
+  atomic_dec(&in_use);
+}
+
+/**
+ * @brief Get a snapshot of the pool usage counters.
+ *
+ * @return The current counters.
+*/
+UartBufPool::Stats UartBufPool::get_stats() {
+  return Stats{
+    .capacity = CONFIG_APP_UART_BUF_COUNT,
+    .in_use = static_cast<uint32_t>(atomic_get(&in_use)),
+    .high_water = static_cast<uint32_t>(atomic_get(&high_water)),
+    .alloc_failures = static_cast<uint32_t>(atomic_get(&alloc_failures)),
+  };
+}
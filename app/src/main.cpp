@@ -1,18 +1,30 @@
 #include "uart.hpp"
+#include "tasks.hpp"
+#include "boot_prof.hpp"
 #include <stdint.h>
 #include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_DECLARE(app_main);
 
-/**
- * @brief Semaphore used to signal that BLE is initialized.
-*/
-K_SEM_DEFINE(ble_init_done, 0, 1);
-
 int main(void) {
+  boot_mark(BootStage::MAIN);
   LOG_INF("[main thread] begin");
-  k_sleep(K_SECONDS(3));
+
+  // Mount the settings once, here: the UART and the BLE stack load them concurrently.
+  if (IS_ENABLED(CONFIG_SETTINGS)) {
+    int err = settings_subsys_init();
+    if (err) {
+      LOG_ERR("Cannot initialize the settings (err %d)", err);
+    }
+  }
+
+  // The tasks run on the executor thread from here on. The BLE stack comes up on the system
+  // workqueue while the UART is set up. See tasks.hpp for the order.
+  nus_task_start();
+  ble_task_start();
+  uart_task_start();
 
   uint64_t counter = 0;
 
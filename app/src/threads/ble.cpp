@@ -1,4 +1,5 @@
-#include "thread_base.hpp"
+#include "task_base.hpp"
+#include "tasks.hpp"
 #include "ble.hpp"
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -6,23 +7,20 @@
 LOG_MODULE_REGISTER(ble_thread);
 
 /**
- * @brief Semaphore used to signal that BLE is initialized.
-*/
-extern struct k_sem ble_init_done;
-
-/**
- * @brief Thread for handling BLE.
+ * @brief Task for handling BLE.
  * 
- * @details This thread is responsible for initializing and managing the BLE.
+ * @details This task is responsible for initializing and managing the BLE.
+ *          The stack comes up, loads the settings and starts advertising on
+ *          the system workqueue, so nothing is left to do here.
 */
-class BleThread : public ThreadBase<BleThread> {
-  friend class ThreadBase<BleThread>;
+class BleTask : public TaskBase<BleTask> {
+  friend class TaskBase<BleTask>;
 
 protected:
   bool init() override {
     int err;
 
-    // Get the singleton instance of the BLE class and initialize it.
+    // Get the singleton instance of the BLE class and initialize it. Returns before the stack is up.
     Ble& ble = Ble::get_instance();
     err = ble.init();
     if (err != 0) {
@@ -30,31 +28,15 @@ protected:
       return false;
     }
 
-    // Signal that BLE is initialized.
-    k_sem_give(&ble_init_done);
-
-    // Start advertising BLE device.
-    err = ble.start_advertising();
-    if (err != 0) {
-      LOG_ERR("ble.start_advertising failed (err %d)", err);
-      return false;
-    }
-
     return true;
   }
 
-  void run() override {
-    k_sleep(K_FOREVER);
+  Task<> run() override {
+    co_return;
   }
 };
 
-void ble_thread_function(void *arg0, void *arg1, void *arg2) {
-  ARG_UNUSED(arg0);
-  ARG_UNUSED(arg1);
-  ARG_UNUSED(arg2);
-
-  BleThread thread;
-  thread();
+void ble_task_start() {
+  static BleTask task;
+  task.start();
 }
-
-K_THREAD_DEFINE(ble_thread_id, CONFIG_MAIN_STACK_SIZE, ble_thread_function, NULL, NULL, NULL, 4, 0, 0);
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef _NUS_HPP_
+#define _NUS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Counters for the notifications sent over NUS.
+ * 
+ * @details The counters are summed over the connections. Those of a connection are reset
+ *          when it is established. The backlog ones count what happens while there is no
+ *          connection and are never reset.
+*/
+struct NusTxStats {
+  uint32_t in_flight;
+  uint32_t sent;
+  uint32_t retries;
+  uint32_t drops;
+  // UART data parked while the link is down, record headers included.
+  uint32_t backlog_bytes;
+  // UART bytes dropped because the backlog, and the flash log if enabled, were full or disabled.
+  uint32_t backlog_dropped;
+  // UART data in the flash log waiting to be replayed.
+  uint32_t spill_bytes;
+  // Notifications out of the slab, shared by the peers that still hold them.
+  uint32_t msgs_in_use;
+};
+
+/**
+ * @brief Counters for the data received over NUS.
+*/
+struct NusRxStats {
+  uint32_t overrun_bytes;
+  uint32_t xoff_count;
+  // Any central is paused.
+  bool paused;
+};
+
+/**
+ * @brief Counters of one central, in the slot of its connection.
+ * 
+ * @details Reset when a central connects in the slot.
+*/
+struct NusPeerStats {
+  bool connected;
+  uint32_t in_flight;
+  uint32_t sent;
+  uint32_t retries;
+  uint32_t drops;
+  // Notifications waiting in the queue of the central.
+  uint32_t queued;
+  // BLE bytes of the central waiting for the UART, record headers included.
+  uint32_t rx_bytes;
+  bool paused;
+};
+
+// Read the NUS TX counters. Safe to call from any thread.
+NusTxStats nus_get_tx_stats();
+
+// Read the NUS RX counters. Safe to call from any thread.
+NusRxStats nus_get_rx_stats();
+
+// Read the counters of one central, index below CONFIG_BT_MAX_CONN. Safe to call from any thread.
+NusPeerStats nus_get_peer_stats(size_t index);
+
+/**
+ * @brief A logical channel of a component over the NUS link.
+ *
+ * @details With CONFIG_APP_NUS_MUX the link carries the UARTs and other components side by
+ *          side, see channel_mux.hpp. The UARTs take the ids from 0 up, one each. Any other
+ *          component registers a channel with a free id. Its data waits in a queue of its
+ *          own, which the NUS task drains in turn with the others.
+*/
+struct NusChannel {
+  uint8_t id;
+  // Called on the Bluetooth RX thread with the data a central wrote to the channel, possibly
+  // in several pieces. May be nullptr.
+  void (*receive)(const uint8_t *data, size_t len);
+};
+
+/**
+ * @brief Register a channel.
+ *
+ * @param channel The channel. Must stay valid from then on.
+ *
+ * @return 0, -EINVAL if a UART has the id, -EALREADY if another channel has it, -ENOMEM if
+ *         CONFIG_APP_NUS_CHANNELS are registered already, or -ENOTSUP without CONFIG_APP_NUS_MUX.
+*/
+int nus_channel_register(const NusChannel *channel);
+
+/**
+ * @brief Queue data of a registered channel for the centrals.
+ *
+ * @details A channel must be fed from one thread only.
+ *
+ * @param channel The channel.
+ * @param data The data.
+ * @param len The length of the data.
+ *
+ * @return The number of bytes queued, fewer than len once the queue is full.
+*/
+size_t nus_channel_send(const NusChannel *channel, const uint8_t *data, size_t len);
+
+#endif // _NUS_HPP_
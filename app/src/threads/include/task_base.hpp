@@ -0,0 +1,46 @@
+#ifndef _TASK_BASE_HPP_
+#define _TASK_BASE_HPP_
+
+#include "executor.hpp"
+
+/**
+ * @brief Base class for tasks.
+ *
+ * @details Curiously Recurring Template Pattern (CRTP) is used to implement
+ *          the task base class. This allows the derived class to be passed
+ *          as a template parameter to the base class. This allows the base
+ *          class to call the derived class's methods.
+ *
+ *          init() runs on the caller of start(). run() is a coroutine resumed
+ *          by the Executor and shares its thread with the other tasks. A task
+ *          that co_awaits coroutines gives their frames an arena with
+ *          frame_arena().
+ *
+ * @tparam Derived The derived class.
+*/
+template<typename Derived>
+class TaskBase {
+public:
+  bool start() {
+    if (!static_cast<Derived*>(this)->init()) {
+      return false;
+    }
+
+    task = static_cast<Derived*>(this)->run();
+    return task.spawn(static_cast<Derived*>(this)->frame_arena());
+  }
+
+protected:
+  virtual bool init() = 0;
+  virtual Task<> run() = 0;
+
+  virtual FrameArena *frame_arena() {
+    return nullptr;
+  }
+
+private:
+  // The coroutine of run(). Owned here so it lives as long as the component.
+  Task<> task;
+};
+
+#endif // _TASK_BASE_HPP_
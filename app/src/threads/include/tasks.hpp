@@ -0,0 +1,15 @@
+#ifndef _TASKS_HPP_
+#define _TASKS_HPP_
+
+/**
+ * @brief Start the application tasks on the executor.
+ *
+ * @details Each call initializes its component on the calling thread, then queues its task.
+ *          Start the NUS first, so its callbacks are in place before BLE advertises. BLE
+ *          returns without waiting for the stack, whose initialization overlaps the UART's.
+*/
+void ble_task_start();
+void nus_task_start();
+void uart_task_start();
+
+#endif // _TASKS_HPP_
@@ -0,0 +1,73 @@
+#ifndef _UART_NUS_HPP_
+#define _UART_NUS_HPP_
+
+#include "uart.hpp"
+#include "spsc_ring.hpp"
+#include "trace.hpp"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/**
+ * @brief Queue from the UART tasks to the NUS task.
+ * 
+ * @details The naming format is <putter>_<getter>_<queue>. With zero-copy the received bytes
+ *          of all the UARTs are passed by reference through uart_nus_fifo, as uart_nus_item_t
+ *          tagged with their stream, and the getter frees the items. Otherwise the bytes are
+ *          copied into the uart_nus_rings entry of their stream and uart_nus_sem is given after
+ *          every write.
+*/
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+/**
+ * @brief Received bytes handed to the NUS by reference.
+ * 
+ * @details The bytes are a part of a pool buffer, which keeps a reference for the item. The
+ *          UART may still be receiving into the rest of it.
+*/
+struct uart_nus_item_t {
+  void *fifo_reserved;
+  uart_data_t *buf;
+  const uint8_t *data;
+  uint16_t len;
+  uint8_t stream;
+  TRACE_STAMP_FIELD(stamp)
+};
+
+/**
+ * @brief Get an item for bytes of a buffer.
+ * 
+ * @param buf The buffer, which the caller holds a reference to. The item takes another.
+ * @param offset The offset of the bytes in the buffer.
+ * @param len The number of bytes.
+ * 
+ * @return The item, or nullptr if all CONFIG_APP_UART_NUS_ITEMS are in use.
+*/
+uart_nus_item_t *uart_nus_item_alloc(uart_data_t *buf, size_t offset, size_t len);
+
+// Free an item and drop its reference to the buffer.
+void uart_nus_item_free(uart_nus_item_t *item);
+
+extern struct k_fifo uart_nus_fifo;
+
+// Bytes in the buffers queued in uart_nus_fifo. Added by the putter, subtracted by the getter.
+extern atomic_t uart_nus_fifo_bytes;
+#else
+using uart_nus_ring_t = SpscRing<UART_PIPE_SIZE>;
+
+// One ring per UART, each written by the task of its UART only.
+extern uart_nus_ring_t uart_nus_rings[UART_COUNT];
+extern struct k_sem uart_nus_sem;
+
+#if defined(CONFIG_APP_TRACE)
+// Stamp of the oldest unread write in each ring. Set by the putter before the write.
+extern trace_stamp_t uart_nus_stamps[UART_COUNT];
+#endif
+#endif
+
+/**
+ * @brief Queue from the NUS task to the UARTs.
+ * 
+ * @details The BLE writes for each stream, drained by the TX engine of its UART.
+*/
+extern const Uart::TxSource nus_uart_source;
+
+#endif // _UART_NUS_HPP_
\ No newline at end of file
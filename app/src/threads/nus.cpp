@@ -1,9 +1,28 @@
-#include "thread_base.hpp"
+#include "task_base.hpp"
+#include "tasks.hpp"
+#include "nus.hpp"
 #include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "uart_nus.hpp"
+#include "spsc_ring.hpp"
+#include "trace.hpp"
+#include "framing.hpp"
+#include "compress.hpp"
+#include "channel_mux.hpp"
+#include "ble.hpp"
+#include "ble_events.h"
+#include "backlog.hpp"
+#include "boot_prof.hpp"
+#include "flash_log.hpp"
+#include "flow_control.hpp"
 #include <errno.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/zbus/zbus.h>
+#include <zephyr/bluetooth/conn.h>
 #include <bluetooth/services/nus.h>
 #include <zephyr/settings/settings.h>
+#include <zephyr/storage/flash_map.h>
 #include <zephyr/logging/log.h>
 
 #define NUS_WRITE_TIMEOUT K_MSEC(150)
@@ -11,40 +30,1113 @@
 LOG_MODULE_REGISTER(nus_thread);
 
 /**
- * @brief Pipe used by the UART/NUS.
+ * @brief Channel records of the notifications and of the writes.
  * 
- * @details This pipe is used to pass data from the UART to the NUS.
+ * @details With CONFIG_APP_NUS_MUX every notification and every write is a run of records,
+ *          see channel_mux.hpp. The UART of stream i has channel i, and components register
+ *          the others with nus_channel_register(). Without it the data of the one UART goes
+ *          as it is.
 */
-extern struct k_pipe uart_nus_pipe;
+constexpr bool NUS_MUX = IS_ENABLED(CONFIG_APP_NUS_MUX);
+
+BUILD_ASSERT(NUS_MUX || (UART_COUNT == 1), "Bridging several UARTs needs CONFIG_APP_NUS_MUX");
+
+using nus_ring_t = SpscRing<UART_PIPE_SIZE>;
+
+/**
+ * @brief BLE data on its way to one UART.
+ * 
+ * @details ring is written by the NUS (from BLE callback) and read by the UART. Every BLE
+ *          write is stored whole as a record: a nus_record_hdr_t followed by the data. The BLE
+ *          callback is the only producer and the TX engine of the stream's UART, through
+ *          nus_uart_fill(), the only consumer.
+*/
+struct nus_stream_t {
+  nus_ring_t ring;
+
+  // State of the record being consumed.
+  size_t record_left;
+  bool record_raw;
+  bool pending_lf;
+};
+
+static nus_stream_t nus_streams[UART_COUNT];
+
+#if defined(CONFIG_APP_NUS_MUX)
+/**
+ * @brief A channel registered by a component.
+ * 
+ * @details ring holds the data of the channel for the centrals. The component is its only
+ *          producer and the NUS task its only consumer. The slots are taken in the order
+ *          of registration and never given back.
+*/
+struct nus_channel_slot_t {
+  const NusChannel *channel;
+  nus_ring_t ring;
+};
+
+static nus_channel_slot_t nus_channel_slots[CONFIG_APP_NUS_CHANNELS];
+static struct k_spinlock channel_lock;
+
+// Slots taken. Raised once the slot is filled, so readers only see complete slots.
+static atomic_t nus_channel_count;
+
+/**
+ * @brief Find a registered channel.
+ * 
+ * @param id The channel id.
+ * 
+ * @return The slot of the channel, or nullptr if no component registered it.
+*/
+static nus_channel_slot_t *nus_channel_find(uint8_t id) {
+  size_t count = static_cast<size_t>(atomic_get(&nus_channel_count));
+
+  for (size_t i = 0; i < count; ++i) {
+    if (nus_channel_slots[i].channel->id == id) {
+      return &nus_channel_slots[i];
+    }
+  }
+  return nullptr;
+}
+#endif
+
+struct nus_record_hdr_t {
+  uint16_t len;
+  // Written in framed mode or decompressed. Passed to the UART unchanged.
+  bool raw;
+  // Slot of the central that wrote it.
+  uint8_t peer;
+  TRACE_STAMP_FIELD(stamp)
+};
+
+/**
+ * @brief Centrals served at the same time, one peer slot per connection.
+*/
+constexpr size_t NUS_PEER_COUNT = CONFIG_BT_MAX_CONN;
+
+BUILD_ASSERT(CONFIG_APP_NUS_TX_WINDOW * CONFIG_BT_MAX_CONN <= CONFIG_BT_CONN_TX_MAX, "NUS TX windows exceed the connection TX queue");
+
+// The NUS task, a task per UART and a sender per peer.
+BUILD_ASSERT(CONFIG_APP_EXECUTOR_MAX_TASKS >= 1 + UART_COUNT + CONFIG_BT_MAX_CONN, "Not enough executor tasks for the UARTs and the NUS peers");
+
+/**
+ * @brief A notification shared by the peers.
+ * 
+ * @details The NUS task packs the UART data once into these and queues each one to every
+ *          peer that is up. The last peer done with it returns it to the slab.
+*/
+struct nus_msg_t {
+  atomic_t refs;
+  uint16_t len;
+  TRACE_STAMP_FIELD(stamp)
+  uint8_t data[NUS_MAX_PAYLOAD];
+};
+
+// Full queues, a message being sent by each peer and one being built.
+constexpr size_t NUS_MSG_COUNT = NUS_PEER_COUNT * (CONFIG_APP_NUS_PEER_QUEUE + 1) + 1;
+
+K_MEM_SLAB_DEFINE_STATIC(nus_msg_slab, sizeof(nus_msg_t), NUS_MSG_COUNT, alignof(nus_msg_t));
+
+/**
+ * @brief Get an empty message with one reference, for the NUS task.
+ * 
+ * @return The message, or nullptr if the slab is exhausted.
+*/
+static nus_msg_t *nus_msg_alloc() {
+  void *block;
+
+  if (k_mem_slab_alloc(&nus_msg_slab, &block, K_NO_WAIT) != 0) {
+    return nullptr;
+  }
+
+  nus_msg_t *msg = static_cast<nus_msg_t *>(block);
+  atomic_set(&msg->refs, 1);
+  msg->len = 0;
+  return msg;
+}
+
+static void nus_msg_ref(nus_msg_t *msg) {
+  atomic_inc(&msg->refs);
+}
+
+static void nus_msg_unref(nus_msg_t *msg) {
+  if (atomic_dec(&msg->refs) == 1) {
+    k_mem_slab_free(&nus_msg_slab, static_cast<void *>(msg));
+  }
+}
+
+/**
+ * @brief State of one central, in the slot of bt_conn_index().
+ * 
+ * @details Each peer has its own queue of messages, sent by its own sender task within its
+ *          own window of CONFIG_APP_NUS_TX_WINDOW notifications in flight, in pieces of its
+ *          own payload size. One credit is taken per bt_nus_send and returned by the NUS
+ *          sent callback. A slow peer drops its oldest messages and leaves the others alone.
+*/
+struct nus_peer_t {
+  // Referenced while connected. Guarded by peer_lock.
+  struct bt_conn *conn;
+  struct k_sem credits;
+  struct k_msgq queue;
+  nus_msg_t *queue_buf[CONFIG_APP_NUS_PEER_QUEUE];
+
+  // TX counters, reset when the peer connects.
+  atomic_t in_flight;
+  atomic_t sent;
+  atomic_t retries;
+  atomic_t drops;
+
+  // BLE bytes of the peer in the BLE to UART rings, record headers included.
+  atomic_t rx_queued;
+  // Flow control state wanted, and last notified to the central.
+  atomic_t rx_paused;
+  atomic_t fc_sent;
+
+  // Trace stamp of the message being sent.
+  TRACE_STAMP_FIELD(send_stamp)
+
+#if defined(CONFIG_APP_COMPRESS)
+  // Encoder of the compressed notifications and the block it builds. Only used by the
+  // sender, so a stream started over for the peer leaves the others alone.
+  LzEncoder encoder;
+  uint8_t block[NUS_MAX_PAYLOAD];
+  uint32_t session_id;
+#endif
+};
+
+static nus_peer_t nus_peers[NUS_PEER_COUNT];
+static struct k_spinlock peer_lock;
+
+// Connected peers, which share the BLE to UART rings.
+static atomic_t peer_connections;
+
+// Messages no peer could take. Never reset.
+static atomic_t tx_lost;
+
+/**
+ * @brief Given by the senders when they take a message, so the NUS task can queue the next.
+*/
+K_SEM_DEFINE(nus_room_sem, 0, 1);
+
+/**
+ * @brief Get the connection of a peer.
+ * 
+ * @return A reference to the connection, or nullptr if the peer is not connected.
+*/
+static struct bt_conn *nus_peer_conn(nus_peer_t &peer) {
+  k_spinlock_key_t key = k_spin_lock(&peer_lock);
+  struct bt_conn *conn = peer.conn ? bt_conn_ref(peer.conn) : nullptr;
+  k_spin_unlock(&peer_lock, key);
+  return conn;
+}
+
+/**
+ * @brief Whether a peer is still on the given connection.
+*/
+static bool nus_peer_on(nus_peer_t &peer, struct bt_conn *conn) {
+  k_spinlock_key_t key = k_spin_lock(&peer_lock);
+  bool on = (peer.conn == conn);
+  k_spin_unlock(&peer_lock, key);
+  return on;
+}
+
+/**
+ * @brief Whether notifications can reach a peer.
+ * 
+ * @details A peer is up while its central is connected and has enabled the notifications.
+*/
+static bool nus_peer_up(nus_peer_t &peer) {
+  struct bt_conn *conn = nus_peer_conn(peer);
+  if (!conn) {
+    return false;
+  }
+
+  bool up = Ble::get_instance().nus_subscribed(conn);
+  bt_conn_unref(conn);
+  return up;
+}
+
+/**
+ * @brief Whether notifications can reach a central.
+ * 
+ * @details The link is up while any peer is. Until then the NUS task parks the UART data
+ *          in nus_backlog instead of sending it.
+*/
+static bool nus_link_up() {
+  for (nus_peer_t &peer : nus_peers) {
+    if (nus_peer_up(peer)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Get the notification payload of the peers that are up.
+ * 
+ * @param smallest Take the smallest payload rather than the largest.
+ * 
+ * @return The payload size in bytes. NUS_MIN_PAYLOAD when no peer is up.
+*/
+static size_t nus_payload(bool smallest) {
+  size_t payload = 0;
+
+  for (nus_peer_t &peer : nus_peers) {
+    struct bt_conn *conn = nus_peer_conn(peer);
+    if (!conn) {
+      continue;
+    }
+
+    if (Ble::get_instance().nus_subscribed(conn)) {
+      size_t size = Ble::get_instance().get_max_payload(conn);
+      payload = (payload == 0) ? size : (smallest ? MIN(payload, size) : MAX(payload, size));
+    }
+    bt_conn_unref(conn);
+  }
+
+  return (payload > 0) ? payload : NUS_MIN_PAYLOAD;
+}
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+/**
+ * @brief UART data received while the link was down, sent first once it is back.
+ * 
+ * @details Only used by the NUS task. Its size is read by the connection policy.
+*/
+using nus_backlog_t = Backlog<CONFIG_APP_NUS_BACKLOG_SIZE>;
+
+static nus_backlog_t nus_backlog(IS_ENABLED(CONFIG_APP_NUS_BACKLOG_DROP_OLDEST) ?
+                                 nus_backlog_t::Policy::DROP_OLDEST : nus_backlog_t::Policy::DROP_NEWEST);
+#endif
+
+#if defined(CONFIG_APP_NUS_SPILL)
+/**
+ * @brief Older UART data moved out of a full backlog, replayed once the link is back.
+ * 
+ * @details Only used by the spill work queue, so the flash writes and erases never hold up
+ *          the executor. Left unused if the partition cannot be opened.
+*/
+static FlashLog nus_spill(IS_ENABLED(CONFIG_APP_NUS_BACKLOG_DROP_OLDEST) ?
+                          FlashLog::Policy::DROP_OLDEST : FlashLog::Policy::DROP_NEWEST);
+static bool spill_ready;
+
+K_THREAD_STACK_DEFINE(nus_spill_stack, CONFIG_APP_NUS_SPILL_STACK_SIZE);
+static struct k_work_q nus_spill_q;
+
+static void nus_spill_work_handler(struct k_work *item);
+K_WORK_DEFINE(nus_spill_work, nus_spill_work_handler);
+
+// Backlog data on its way to the flash log. Written by the NUS task, read by the spill work queue.
+static SpscRing<CONFIG_APP_NUS_SPILL_QUEUE_SIZE> spill_queue;
+
+// Data batched by the flash log and not written yet. Set by the spill work queue.
+static atomic_t spill_batched;
+
+/**
+ * @brief Block of the flash log to replay.
+ * 
+ * @details The NUS task asks for the block with SPILL_BLOCK_REQUESTED. The spill work queue
+ *          reads it into spill_block, sets spill_block_len to its length, 0 if the log is
+ *          empty or a negative error, and hands it back with SPILL_BLOCK_READY. Once the
+ *          block was sent, spill_pop has the work queue mark it as sent.
+*/
+enum : atomic_val_t {
+  SPILL_BLOCK_NONE,
+  SPILL_BLOCK_REQUESTED,
+  SPILL_BLOCK_READY,
+};
+static atomic_t spill_block_state;
+static atomic_t spill_pop;
+static uint8_t spill_block[FLASH_LOG_BLOCK_SIZE];
+static int spill_block_len;
+
+// Data in the flash log, written, batched or still queued.
+static bool spill_pending() {
+  return spill_ready && (!nus_spill.empty() || (atomic_get(&spill_batched) > 0) || !spill_queue.empty());
+}
+#endif
+
+// UART bytes lost while the link was down. Never reset.
+static atomic_t backlog_dropped;
+
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+/**
+ * @brief Item queued in uart_nus_fifo to wake the NUS task when the link comes up.
+ * 
+ * @details Queued at most once, which wake_queued tracks, since a fifo item cannot be queued twice.
+*/
+static struct {
+  void *fifo_reserved;
+} nus_wake_item;
+
+static atomic_t wake_queued;
+#endif
+
+/**
+ * @brief Wake the NUS task waiting for UART data, so it looks at its queues again.
+*/
+static void nus_wake() {
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+  if (atomic_cas(&wake_queued, 0, 1)) {
+    k_fifo_put(&uart_nus_fifo, &nus_wake_item);
+  }
+#else
+  k_sem_give(&uart_nus_sem);
+#endif
+}
+
+#if defined(CONFIG_APP_NUS_SPILL)
+/**
+ * @brief Do the flash log work the NUS task asked for.
+ * 
+ * @details Runs on the spill work queue, the only user of nus_spill. Writes the queued
+ *          backlog data, marks the block sent last as sent, then reads the next block if
+ *          asked to and wakes the NUS task with it. The flash calls block this queue only,
+ *          an erase for tens of milliseconds.
+ * 
+ * @param item The work item.
+*/
+static void nus_spill_work_handler(struct k_work *item) {
+  ARG_UNUSED(item);
+  uint8_t chunk[64];
+  size_t dropped = 0;
+  size_t len;
+
+  while ((len = spill_queue.read(chunk, sizeof(chunk))) > 0) {
+    dropped += nus_spill.append(chunk, len);
+  }
+
+  if (atomic_cas(&spill_pop, 1, 0)) {
+    int err = nus_spill.pop();
+    if (err) {
+      LOG_WRN("Failed to mark a flash log block as sent (err %d)", err);
+    }
+  }
+
+  if (atomic_get(&spill_block_state) == SPILL_BLOCK_REQUESTED) {
+    if (nus_spill.batched() > 0) {
+      // Write the last partial block so that it is replayed too.
+      dropped += nus_spill.sync();
+    }
+    spill_block_len = nus_spill.peek(spill_block);
+    atomic_set(&spill_block_state, SPILL_BLOCK_READY);
+    nus_wake();
+  }
+
+  atomic_set(&spill_batched, nus_spill.batched());
+  if (dropped > 0) {
+    atomic_add(&backlog_dropped, dropped);
+  }
+}
+#endif
+
+/**
+ * @brief Wake the NUS task once the link is up, so the backlog goes out without waiting for
+ *        new UART data.
+*/
+static void nus_link_changed() {
+  // A NUS task waiting for room looks at the peers again.
+  k_sem_give(&nus_room_sem);
+
+  if (nus_link_up()) {
+    nus_wake();
+  }
+}
+
+/**
+ * @brief Register a channel of a component.
+ * 
+ * @param channel The channel.
+ * 
+ * @return 0, or a negative error code, see nus.hpp.
+*/
+int nus_channel_register(const NusChannel *channel) {
+#if defined(CONFIG_APP_NUS_MUX)
+  if (channel->id < UART_COUNT) {
+    return -EINVAL;
+  }
+
+  int err = 0;
+  k_spinlock_key_t key = k_spin_lock(&channel_lock);
+  size_t count = static_cast<size_t>(atomic_get(&nus_channel_count));
+  if (nus_channel_find(channel->id)) {
+    err = -EALREADY;
+  } else if (count == ARRAY_SIZE(nus_channel_slots)) {
+    err = -ENOMEM;
+  } else {
+    nus_channel_slots[count].channel = channel;
+    atomic_inc(&nus_channel_count);
+  }
+  k_spin_unlock(&channel_lock, key);
+
+  if (err == 0) {
+    LOG_INF("NUS channel %u registered", channel->id);
+  }
+  return err;
+#else
+  ARG_UNUSED(channel);
+  return -ENOTSUP;
+#endif
+}
+
+/**
+ * @brief Queue data of a registered channel for the centrals.
+ * 
+ * @param channel The channel.
+ * @param data The data.
+ * @param len The length of the data.
+ * 
+ * @return The number of bytes queued. 0 for a channel that is not registered.
+*/
+size_t nus_channel_send(const NusChannel *channel, const uint8_t *data, size_t len) {
+#if defined(CONFIG_APP_NUS_MUX)
+  nus_channel_slot_t *slot = nus_channel_find(channel->id);
+  if (!slot || (slot->channel != channel)) {
+    return 0;
+  }
+
+  size_t written = slot->ring.write(data, len);
+  if (written > 0) {
+    nus_wake();
+  }
+  return written;
+#else
+  ARG_UNUSED(channel);
+  ARG_UNUSED(data);
+  ARG_UNUSED(len);
+  return 0;
+#endif
+}
+
+/**
+ * @brief NUS RX counters.
+*/
+static atomic_t rx_overrun_bytes;
+static atomic_t rx_xoff_count;
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+/**
+ * @brief Software flow control towards the centrals.
+ * 
+ * @details When a peer's share of the BLE to UART rings fills past its part of the high watermark,
+ *          XOFF is notified to that central. XON follows once the UART TX engine has drained
+ *          it below its part of the low watermark. The headroom above the high watermark
+ *          absorbs writes already in flight. Both go on the flow control characteristic,
+ *          see flow_control.hpp, never in the NUS data.
+*/
+
+BUILD_ASSERT(CONFIG_APP_NUS_RX_HIGH_WATERMARK < CONFIG_APP_UART_PIPE_SIZE, "NUS RX high watermark must be below the ring size");
+BUILD_ASSERT(CONFIG_APP_NUS_RX_LOW_WATERMARK < CONFIG_APP_NUS_RX_HIGH_WATERMARK, "NUS RX low watermark must be below the high watermark");
+
+/**
+ * @brief Notify the flow control state that changed to each central.
+ * 
+ * @details Sends whatever state applies when the work runs, so quick pause/resume
+ *          changes collapse into one notification, or none. Retried while the controller
+ *          is out of buffers.
+ * 
+ * @param item The work item.
+*/
+static void nus_fc_work_handler(struct k_work *item);
+K_WORK_DELAYABLE_DEFINE(nus_fc_work, nus_fc_work_handler);
+
+static void nus_fc_work_handler(struct k_work *item) {
+  ARG_UNUSED(item);
+
+  bool retry = false;
+
+  for (nus_peer_t &peer : nus_peers) {
+    atomic_val_t paused = atomic_get(&peer.rx_paused);
+    if (atomic_get(&peer.fc_sent) == paused) {
+      continue;
+    }
+
+    struct bt_conn *conn = nus_peer_conn(peer);
+    if (!conn) {
+      continue;
+    }
+
+    int err = flow_control_notify(conn, paused);
+    bt_conn_unref(conn);
+    if (err == 0) {
+      atomic_set(&peer.fc_sent, paused);
+      continue;
+    }
+
+    if ((err == -ENOMEM) || (err == -EAGAIN)) {
+      retry = true;
+    }
+  }
+
+  if (retry) {
+    k_work_reschedule(&nus_fc_work, K_MSEC(CONFIG_APP_NUS_TX_BACKOFF_MS));
+  }
+}
+
+#endif
+
+/**
+ * @brief Get the part of the BLE to UART rings each connected peer may fill.
+ * 
+ * @details The ring is shared evenly so that a central writing fast cannot crowd out
+ *          the others. The records are merged in the order they arrive.
+ * 
+ * @param size A size for the whole ring.
+ * 
+ * @return The size for one peer.
+*/
+static size_t nus_rx_share(size_t size) {
+  atomic_val_t peers = atomic_get(&peer_connections);
+  return size / MAX(peers, 1);
+}
+
+/**
+ * @brief Take BLE data for the TX engine of a UART.
+ * 
+ * @details Consumes whole records from the ring of the UART's stream into the UART DMA
+ *          buffer. In line mode a LF is appended when the CR character ended a write from
+ *          the peer. Runs in the UART TX work context, off the Bluetooth RX thread.
+ * 
+ * @param uart The UART.
+ * @param buf The UART DMA buffer to fill.
+ * @param size The size of the buffer.
+ * 
+ * @return The number of bytes copied.
+*/
+static size_t nus_uart_fill(const Uart &uart, uint8_t *buf, size_t size) {
+  nus_stream_t &stream = nus_streams[uart.id()];
+  size_t len = 0;
+
+  while (len < size) {
+    if (stream.pending_lf) {
+      buf[len++] = '\n';
+      stream.pending_lf = false;
+      continue;
+    }
+
+    if (stream.record_left == 0) {
+      // Start the next record. Headers and data are committed together so a header means data follows.
+      nus_record_hdr_t hdr;
+      if (stream.ring.read(reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr)) != sizeof(hdr)) {
+        break;
+      }
+      stream.record_left = hdr.len;
+      stream.record_raw = hdr.raw;
+      atomic_sub(&nus_peers[hdr.peer].rx_queued, sizeof(hdr) + hdr.len);
+      TRACE_POINT(NUS_UART_GET, hdr.stamp);
+      continue;
+    }
+
+    size_t chunk = stream.ring.read(&buf[len], MIN(size - len, stream.record_left));
+    if (chunk == 0) {
+      break;
+    }
+    len += chunk;
+    stream.record_left -= chunk;
+
+    // Append the LF character when the CR character triggered transmission from the peer.
+    if ((stream.record_left == 0) && !stream.record_raw && (buf[len - 1] == '\r')) {
+      stream.pending_lf = true;
+    }
+  }
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+  // Resume each central once the UART has drained its share of the ring.
+  size_t low = nus_rx_share(CONFIG_APP_NUS_RX_LOW_WATERMARK);
+  for (nus_peer_t &peer : nus_peers) {
+    if ((static_cast<size_t>(atomic_get(&peer.rx_queued)) <= low) && atomic_cas(&peer.rx_paused, 1, 0)) {
+      k_work_reschedule(&nus_fc_work, K_NO_WAIT);
+    }
+  }
+#endif
+
+  return len;
+}
+
+/**
+ * @brief Get the number of BLE bytes waiting for a UART.
+ * 
+ * @param uart The UART.
+ * 
+ * @return The number of bytes in the ring of its stream, record headers included.
+*/
+static size_t nus_uart_depth(const Uart &uart) {
+  return nus_streams[uart.id()].ring.size();
+}
+
+/**
+ * @brief The BLE to UART queues as seen by the UART TX engines.
+*/
+const Uart::TxSource nus_uart_source = {
+  .fill = nus_uart_fill,
+  .depth = nus_uart_depth,
+};
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+/**
+ * @brief Get the fill of the UART to BLE queue of a connection.
+ * 
+ * @param conn The connection.
+ * 
+ * @return The fill in percent.
+*/
+static uint32_t uart_nus_fill_pct(struct bt_conn *conn) {
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+  // The fifo can hold every buffer of the pool.
+  size_t bytes = static_cast<size_t>(atomic_get(&uart_nus_fifo_bytes));
+  uint32_t pct = (bytes * 100) / (CONFIG_APP_UART_BUF_COUNT * UART_BUF_SIZE);
+#else
+  uint32_t pct = 0;
+  for (uart_nus_ring_t &ring : uart_nus_rings) {
+    pct = MAX(pct, (ring.size() * 100) / uart_nus_ring_t::capacity);
+  }
+#endif
+
+#if defined(CONFIG_APP_NUS_MUX)
+  // The queues of the channels other components registered.
+  size_t channels = static_cast<size_t>(atomic_get(&nus_channel_count));
+  for (size_t i = 0; i < channels; ++i) {
+    pct = MAX(pct, (nus_channel_slots[i].ring.size() * 100) / nus_ring_t::capacity);
+  }
+#endif
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+  // A backlog to catch up on after a reconnection also asks for the fast parameters.
+  pct = MAX(pct, (nus_backlog.size() * 100) / nus_backlog_t::capacity);
+#endif
+
+  // The messages waiting for this central.
+  uint32_t queued = k_msgq_num_used_get(&nus_peers[bt_conn_index(conn)].queue);
+  return MAX(pct, (queued * 100) / CONFIG_APP_NUS_PEER_QUEUE);
+}
+
+/**
+ * @brief Get the fill of the BLE to UART queue of a connection.
+ * 
+ * @param conn The connection.
+ * 
+ * @return The fill of its share of a ring in percent.
+*/
+static uint32_t nus_uart_fill_pct(struct bt_conn *conn) {
+  size_t queued = static_cast<size_t>(atomic_get(&nus_peers[bt_conn_index(conn)].rx_queued));
+  return MIN((queued * 100) / nus_rx_share(UART_PIPE_SIZE), 100);
+}
+
+/**
+ * @brief The queues the connection interval follows.
+*/
+static const Ble::QueueLevels nus_queue_levels = {
+  .uart_to_ble = uart_nus_fill_pct,
+  .ble_to_uart = nus_uart_fill_pct,
+};
+#endif
+
+/**
+ * @brief Queue BLE data for a UART.
+ * 
+ * @details Stores the data in the ring of the stream as one record. Data that does not fit
+ *          in the ring, or in the peer's share of it, is dropped whole and counted as overrun.
+ *          Runs on the Bluetooth RX thread.
+ * 
+ * @param peer The slot of the central that wrote the data.
+ * @param stream The stream, which is also the index of the UART.
+ * @param data The data.
+ * @param len The length of the data.
+ * @param raw Whether the UART gets the data without the CR/LF handling.
+*/
+static void nus_uart_put(uint8_t peer, uint8_t stream, const uint8_t *data, size_t len, bool raw) {
+  nus_ring_t &ring = nus_streams[stream].ring;
+  nus_record_hdr_t hdr = {
+    .len = static_cast<uint16_t>(len),
+    .raw = raw,
+    .peer = peer,
+  };
+  TRACE_STAMP(hdr.stamp);
+  size_t queued = static_cast<size_t>(atomic_get(&nus_peers[peer].rx_queued));
+  if ((ring.space() < sizeof(hdr) + len) ||
+      (queued + sizeof(hdr) + len > nus_rx_share(ring.capacity))) {
+    atomic_add(&rx_overrun_bytes, len);
+    return;
+  }
+
+  // Count the bytes before the consumer can see them, so it never takes off more than was added.
+  atomic_add(&nus_peers[peer].rx_queued, sizeof(hdr) + len);
+
+  // Commit header and data together.
+  ring.stage(reinterpret_cast<const uint8_t *>(&hdr), sizeof(hdr));
+  ring.stage(data, len);
+  ring.write_commit(sizeof(hdr) + len);
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+  // Pause the central before its share of the rings overflows.
+  queued += sizeof(hdr) + len;
+  if ((queued >= nus_rx_share(CONFIG_APP_NUS_RX_HIGH_WATERMARK)) && atomic_cas(&nus_peers[peer].rx_paused, 0, 1)) {
+    atomic_inc(&rx_xoff_count);
+    k_work_reschedule(&nus_fc_work, K_NO_WAIT);
+  }
+#endif
+}
+
+/**
+ * @brief Wake the TX engine of a UART so the data goes out without waiting for a previous
+ *        transfer. Until the UART is up, its initialization does.
+ * 
+ * @param stream The stream of the UART.
+*/
+static void nus_uart_kick(uint8_t stream) {
+  Uart *uart = Uart::get(stream);
+  if (uart) {
+    uart->tx_kick();
+  }
+}
+
+#if defined(CONFIG_APP_NUS_MUX)
+// The write being split into channels. Only used on the Bluetooth RX thread.
+static uint8_t rx_mux_peer;
+static bool rx_mux_raw;
+
+/**
+ * @brief Hand the data of a channel record to its UART or to the component of the channel.
+ * 
+ * @details Data of a channel nobody registered is dropped and counted as overrun. Runs on
+ *          the Bluetooth RX thread.
+ * 
+ * @param channel The channel.
+ * @param data The data.
+ * @param len The length of the data.
+*/
+static void nus_mux_sink(uint8_t channel, const uint8_t *data, size_t len) {
+  if (channel < UART_COUNT) {
+    nus_uart_put(rx_mux_peer, channel, data, len, rx_mux_raw);
+    nus_uart_kick(channel);
+    return;
+  }
+
+  nus_channel_slot_t *slot = nus_channel_find(channel);
+  if (slot && slot->channel->receive) {
+    slot->channel->receive(data, len);
+  } else {
+    atomic_add(&rx_overrun_bytes, len);
+  }
+}
+#endif
+
+#if defined(CONFIG_APP_COMPRESS)
+/**
+ * @brief Decoders of the compressed BLE writes, one per peer.
+ * 
+ * @details Only used on the Bluetooth RX thread. Blocks starting a stream clear them. With
+ *          CONFIG_APP_NUS_MUX the decoded bytes are a run of channel records, which may
+ *          span blocks, so each peer also has a parser that goes on from one block to the next.
+*/
+static LzDecoder nus_lz_decoders[NUS_PEER_COUNT];
+#if defined(CONFIG_APP_NUS_MUX)
+static MuxParser nus_lz_parsers[NUS_PEER_COUNT];
+#endif
+static uint8_t rx_decode_peer;
+static size_t rx_decoded_len;
+
+static void nus_lz_sink(const uint8_t *data, size_t len) {
+  rx_decoded_len += len;
+#if defined(CONFIG_APP_NUS_MUX)
+  nus_lz_parsers[rx_decode_peer].feed(data, len, nus_mux_sink);
+#else
+  nus_uart_put(rx_decode_peer, 0, data, len, true);
+#endif
+}
+
+/**
+ * @brief Decompress a BLE write for the UARTs and the channels.
+ * 
+ * @details The output is queued in records of up to the window size. A corrupt block is
+ *          dropped and counted. The central should then start a new stream by writing
+ *          the compression mode again, since its next blocks refer to the lost data.
+ * 
+ * @param peer The slot of the central that wrote the block.
+ * @param data The block.
+ * @param len The length of the block.
+*/
+static void nus_put_compressed(uint8_t peer, const uint8_t *data, size_t len) {
+  rx_decode_peer = peer;
+  rx_decoded_len = 0;
+
+#if defined(CONFIG_APP_NUS_MUX)
+  rx_mux_peer = peer;
+  rx_mux_raw = true;
+  if (data[0] & LZ_BLOCK_RESET) {
+    // A new stream starts with a new record.
+    nus_lz_parsers[peer].reset();
+  }
+#endif
+
+  uint32_t start = k_cycle_get_32();
+  int err = nus_lz_decoders[peer].decode(data, len, nus_lz_sink);
+  compress_count_rx(len, rx_decoded_len, k_cycle_get_32() - start, err != 0);
+
+  if (err) {
+    LOG_WRN("Dropped a corrupt compressed block of %u bytes", static_cast<unsigned int>(len));
+#if defined(CONFIG_APP_NUS_MUX)
+    nus_lz_parsers[peer].reset();
+#endif
+  }
+}
+#endif
+
+/**
+ * @brief Refill the TX window of a peer.
+ * 
+ * @details Notifications still queued on a dropped link never complete, so the window
+ *          is refilled on every connection change.
+*/
+static void nus_peer_refill(nus_peer_t &peer) {
+  k_sem_reset(&peer.credits);
+  for (int i = 0; i < CONFIG_APP_NUS_TX_WINDOW; ++i) {
+    k_sem_give(&peer.credits);
+  }
+
+  atomic_clear(&peer.in_flight);
+}
+
+/**
+ * @brief Drop the messages waiting for a peer.
+*/
+static void nus_peer_purge(nus_peer_t &peer) {
+  nus_msg_t *msg;
+
+  while (k_msgq_get(&peer.queue, &msg, K_NO_WAIT) == 0) {
+    nus_msg_unref(msg);
+  }
+}
+
+static void nus_connected(struct bt_conn *conn) {
+  nus_peer_t &peer = nus_peers[bt_conn_index(conn)];
+
+  // Start the new connection with a full window and fresh counters.
+  nus_peer_refill(peer);
+  atomic_clear(&peer.sent);
+  atomic_clear(&peer.retries);
+  atomic_clear(&peer.drops);
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+  // A new central starts unpaused.
+  atomic_clear(&peer.rx_paused);
+  atomic_clear(&peer.fc_sent);
+#endif
+
+#if defined(CONFIG_APP_COMPRESS)
+  // The central starts with an empty window.
+  compress_new_session(bt_conn_index(conn));
+#endif
+
+  k_spinlock_key_t key = k_spin_lock(&peer_lock);
+  if (!peer.conn) {
+    peer.conn = bt_conn_ref(conn);
+    atomic_inc(&peer_connections);
+  }
+  k_spin_unlock(&peer_lock, key);
+}
+
+static void nus_disconnected(struct bt_conn *conn) {
+  nus_peer_t &peer = nus_peers[bt_conn_index(conn)];
+
+  // Park the sender of this peer until its central is back and subscribed.
+  k_spinlock_key_t key = k_spin_lock(&peer_lock);
+  struct bt_conn *old_conn = peer.conn;
+  peer.conn = nullptr;
+  k_spin_unlock(&peer_lock, key);
+  if (old_conn) {
+    atomic_dec(&peer_connections);
+    bt_conn_unref(old_conn);
+  }
+
+  nus_peer_purge(peer);
+  nus_peer_refill(peer);
+
+#if defined(CONFIG_APP_NUS_RX_FLOW_CONTROL)
+  atomic_clear(&peer.rx_paused);
+  atomic_clear(&peer.fc_sent);
+#endif
+}
+
+/**
+ * @brief Follow the connection events published by the BLE device.
+ * 
+ * @details Runs in the Bluetooth stack's connection callbacks, see ble_events.h.
+ * 
+ * @param chan The connection event channel.
+*/
+static void nus_conn_changed(const struct zbus_channel *chan) {
+  auto evt = static_cast<const struct ble_conn_event *>(zbus_chan_const_msg(chan));
+
+  if (evt->connected) {
+    nus_connected(evt->conn);
+  } else {
+    nus_disconnected(evt->conn);
+  }
+  nus_link_changed();
+}
+
+// Listed as an observer of ble_conn_chan in ble_events.c.
+ZBUS_LISTENER_DEFINE(nus_conn_listener, nus_conn_changed);
+
+/**
+ * @brief Get the NUS RX counters.
+ * 
+ * @return A snapshot of the counters.
+*/
+NusRxStats nus_get_rx_stats() {
+  bool paused = false;
+
+  for (nus_peer_t &peer : nus_peers) {
+    paused = paused || (atomic_get(&peer.rx_paused) != 0);
+  }
+
+  return NusRxStats{
+    .overrun_bytes = static_cast<uint32_t>(atomic_get(&rx_overrun_bytes)),
+    .xoff_count = static_cast<uint32_t>(atomic_get(&rx_xoff_count)),
+    .paused = paused,
+  };
+}
+
+/**
+ * @brief Get the NUS TX counters.
+ * 
+ * @return A snapshot of the counters, summed over the peers.
+*/
+NusTxStats nus_get_tx_stats() {
+  uint32_t in_flight = 0;
+  uint32_t sent = 0;
+  uint32_t retries = 0;
+  uint32_t drops = static_cast<uint32_t>(atomic_get(&tx_lost));
+
+  for (nus_peer_t &peer : nus_peers) {
+    in_flight += static_cast<uint32_t>(atomic_get(&peer.in_flight));
+    sent += static_cast<uint32_t>(atomic_get(&peer.sent));
+    retries += static_cast<uint32_t>(atomic_get(&peer.retries));
+    drops += static_cast<uint32_t>(atomic_get(&peer.drops));
+  }
+
+  return NusTxStats{
+    .in_flight = in_flight,
+    .sent = sent,
+    .retries = retries,
+    .drops = drops,
+#if defined(CONFIG_APP_NUS_BACKLOG)
+    .backlog_bytes = static_cast<uint32_t>(nus_backlog.size()),
+#else
+    .backlog_bytes = 0,
+#endif
+    .backlog_dropped = static_cast<uint32_t>(atomic_get(&backlog_dropped)),
+#if defined(CONFIG_APP_NUS_SPILL)
+    .spill_bytes = nus_spill.get_stats().pending_bytes,
+#else
+    .spill_bytes = 0,
+#endif
+    .msgs_in_use = k_mem_slab_num_used_get(&nus_msg_slab),
+  };
+}
 
 /**
- * @brief Semaphore used to signal that NUS can be initialized (BLE init is done).
+ * @brief Get the counters of one peer.
+ * 
+ * @param index The peer slot, below CONFIG_BT_MAX_CONN.
+ * 
+ * @return A snapshot of the counters. All zero for a slot out of range.
+*/
+NusPeerStats nus_get_peer_stats(size_t index) {
+  if (index >= NUS_PEER_COUNT) {
+    return NusPeerStats{};
+  }
+
+  nus_peer_t &peer = nus_peers[index];
+  struct bt_conn *conn = nus_peer_conn(peer);
+  if (conn) {
+    bt_conn_unref(conn);
+  }
+
+  return NusPeerStats{
+    .connected = conn != nullptr,
+    .in_flight = static_cast<uint32_t>(atomic_get(&peer.in_flight)),
+    .sent = static_cast<uint32_t>(atomic_get(&peer.sent)),
+    .retries = static_cast<uint32_t>(atomic_get(&peer.retries)),
+    .drops = static_cast<uint32_t>(atomic_get(&peer.drops)),
+    .queued = k_msgq_num_used_get(&peer.queue),
+    .rx_bytes = static_cast<uint32_t>(atomic_get(&peer.rx_queued)),
+    .paused = atomic_get(&peer.rx_paused) != 0,
+  };
+}
+
+#if defined(CONFIG_APP_NUS_MUX) || !defined(CONFIG_APP_NUS_ZERO_COPY)
+/**
+ * @brief Count the queues of data for the centrals.
+ * 
+ * @details With copy the rings of the UARTs come first, then the queues of the registered
+ *          channels. With zero-copy the UART data comes through uart_nus_fifo instead.
+ * 
+ * @param uarts_only Leave out the registered channels.
+ * 
+ * @return The number of queues.
 */
-extern struct k_sem ble_init_done;
+static size_t nus_queue_count(bool uarts_only) {
+  size_t count = 0;
+
+#if !defined(CONFIG_APP_NUS_ZERO_COPY)
+  count += UART_COUNT;
+#endif
+#if defined(CONFIG_APP_NUS_MUX)
+  if (!uarts_only) {
+    count += static_cast<size_t>(atomic_get(&nus_channel_count));
+  }
+#else
+  ARG_UNUSED(uarts_only);
+#endif
+  return count;
+}
 
 /**
- * @brief Pipes used by the UART and NUS (from BLE callback).
+ * @brief Get a queue of data for the centrals.
  * 
- * @details The naming format is <putter>_<getter>_pipe.
+ * @param index The queue, below nus_queue_count().
+ * @param channel Set to the channel of the queue.
+ * 
+ * @return The ring of the queue.
 */
-K_PIPE_DEFINE(nus_uart_pipe, 1024, 4);
+static nus_ring_t &nus_queue(size_t index, uint8_t &channel) {
+#if defined(CONFIG_APP_NUS_MUX)
+#if !defined(CONFIG_APP_NUS_ZERO_COPY)
+  if (index < UART_COUNT) {
+    channel = static_cast<uint8_t>(index);
+    return uart_nus_rings[index];
+  }
+  index -= UART_COUNT;
+#endif
+  channel = nus_channel_slots[index].channel->id;
+  return nus_channel_slots[index].ring;
+#else
+  channel = static_cast<uint8_t>(index);
+  return uart_nus_rings[index];
+#endif
+}
+#endif
 
 /**
- * @brief Thread for handling NUS (Nordic UART Sevice).
+ * @brief Task for handling NUS (Nordic UART Sevice).
  * 
- * @details This thread is responsible for initializing the NUS and handling
- * 			    incoming data from the NUS. It passes the data to the nus_uart_pipe.
+ * @details This task is responsible for initializing the NUS and handling
+ * 			    incoming data from the NUS. It passes the data to the ring of its stream.
+ *          It packs the UART data, and that of the registered channels, into messages for
+ *          the peers, each of which has a sender task of its own.
 */
-class NusThread : public ThreadBase<NusThread> {
-  friend class ThreadBase<NusThread>;
+class NusTask : public TaskBase<NusTask> {
+  friend class TaskBase<NusTask>;
 
 protected:
   bool init() override {
-    // Don't go any further until BLE is initialized
-	  k_sem_take(&ble_init_done, K_FOREVER);
-
+    // Only registers the callbacks of the static NUS service, so it does not wait for the stack.
     static struct bt_nus_cb nus_cb = {
       .received = bt_receive_cb,
+      .sent = bt_sent_cb,
+      .send_enabled = bt_send_enabled_cb,
     };
 
     // Initialize the NUS service.
@@ -54,115 +1146,753 @@ protected:
       return false;
     }
 
+    for (size_t i = 0; i < NUS_PEER_COUNT; ++i) {
+      nus_peer_t &peer = nus_peers[i];
+
+      k_sem_init(&peer.credits, CONFIG_APP_NUS_TX_WINDOW, CONFIG_APP_NUS_TX_WINDOW);
+      k_msgq_init(&peer.queue, reinterpret_cast<char *>(peer.queue_buf), sizeof(nus_msg_t *), CONFIG_APP_NUS_PEER_QUEUE);
+
+      senders[i] = peer_sender(peer);
+      if (!senders[i].spawn(&sender_arenas[i])) {
+        LOG_ERR("Failed to start the sender of peer %u", static_cast<unsigned int>(i));
+      }
+    }
+
+#if defined(CONFIG_APP_NUS_SPILL)
+    // Blocks not sent before a reset are replayed to the first central.
+    err = nus_spill.init(FIXED_PARTITION_ID(spill_partition));
+    if (err) {
+      LOG_ERR("Failed to open the spill partition (err: %d)", err);
+    } else {
+      const struct k_work_queue_config spill_q_config = {.name = "nus_spill"};
+      k_work_queue_start(&nus_spill_q, nus_spill_stack, K_THREAD_STACK_SIZEOF(nus_spill_stack),
+                         CONFIG_APP_NUS_SPILL_PRIORITY, &spill_q_config);
+      spill_ready = true;
+      LOG_INF("%u bytes to replay from flash", nus_spill.get_stats().pending_bytes);
+    }
+#endif
+
+#if defined(CONFIG_APP_CONN_PARAM_POLICY)
+    // Speed the link up while data backs up in either direction.
+    Ble::get_instance().set_queue_levels(&nus_queue_levels);
+#endif
+
     LOG_INF("NUS module initialized");
-    k_sem_give(&ble_init_done);
+    boot_mark(BootStage::NUS_READY);
     return true;
   }
 
-  void run() override {
-    LOG_INF("[nus thread] starting");
+  FrameArena *frame_arena() override {
+    return &arena;
+  }
+
+  Task<> run() override {
+    while (true) {
+      LOG_INF("[nus task] starting");
 
-    // get data from pipe
-    size_t bytes_read;
-    int err = k_pipe_get(&uart_nus_pipe, buf->data, UART_BUF_SIZE, &bytes_read, 0, K_FOREVER);
-    buf->len = bytes_read;
-    if (err < 0) {
-      LOG_WRN("nus get from uart_nus_pipe failed: %d", err);
-      return;
+      // Fill each notification up to what the largest payload of the peers allows. The
+      // senders of the peers with a smaller one split it. Channel records cannot be split,
+      // so with CONFIG_APP_NUS_MUX every notification fits the smallest payload instead.
+      size_t payload = nus_payload(NUS_MUX);
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+      if (nus_link_up() && !nus_backlog.empty()) {
+        // Catch up on what came in while the link was down, before any newer data.
+        co_await flush_backlog(payload);
+        continue;
+      }
+#endif
+
+#if defined(CONFIG_APP_NUS_SPILL)
+      if (replay_due()) {
+        // One block of the flash log, then the live data again.
+        co_await replay(payload);
+        continue;
+      }
+#endif
+
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+#if defined(CONFIG_APP_NUS_MUX)
+      if (nus_link_up() && (co_await pack_queues(payload) > 0)) {
+        // The registered channels had data.
+        co_await flush();
+        continue;
+      }
+#endif
+
+      // Take ownership of the next received bytes.
+      uart_nus_item_t *item = take_item(co_await FifoGet(&uart_nus_fifo, replay_wait()));
+      if (!item) {
+        continue;
+      }
+
+      TRACE_COPY(send_stamp, item->stamp);
+
+      if (!nus_link_up()) {
+        park(item->stream, item->data, item->len);
+        uart_nus_item_free(item);
+        continue;
+      }
+
+      // Pack them with the items queued behind into as few notifications as possible.
+      co_await pack_and_send(item, payload);
+#else
+      if (nus_link_up()) {
+        size_t packed = co_await pack_queues(payload);
+        co_await flush();
+        if (packed == 0) {
+          co_await SemTake(&uart_nus_sem, replay_wait());
+        }
+        continue;
+      }
+
+      uint8_t stream;
+      nus_ring_t *ring = next_queue(true, stream);
+      if (!ring) {
+        co_await SemTake(&uart_nus_sem, replay_wait());
+        continue;
+      }
+
+      TRACE_COPY(send_stamp, uart_nus_stamps[stream]);
+      TRACE_POINT(NUS_GET, send_stamp);
+
+      // Move the queued data out of the way of the UART. A wrapped ring takes two rounds.
+      auto span = ring->read_claim();
+      park(stream, span.data, span.len);
+      ring->read_commit(span.len);
+#endif
+
+      LOG_INF("[nus task] done");
     }
+  }
+
+private:
+  // Staging buffer for the backlog and the spill.
+  uint8_t notify_buf[NUS_MAX_PAYLOAD];
 
-    LOG_INF("[nus thread] buf->data: %s", buf->data);
+  // The sender of each peer, and the frames of the sends it awaits.
+  Task<> senders[NUS_PEER_COUNT];
+  StaticFrameArena<CONFIG_APP_NUS_SENDER_FRAME_ARENA_SIZE> sender_arenas[NUS_PEER_COUNT];
 
-    // Send the data over BLE.
-    err = bt_nus_send(nullptr, buf->data, buf->len);
-    if (err) {
-      LOG_WRN("Failed to send data over BLE connection (err %d)", err);
+  // Frames of the packing and publishing run() awaits.
+  StaticFrameArena<CONFIG_APP_NUS_FRAME_ARENA_SIZE> arena;
+
+  // Trace stamp of the data being sent.
+  TRACE_STAMP_FIELD(send_stamp)
+
+  // Message being packed, its payload and the writer of its channel records.
+  nus_msg_t *pack_msg{nullptr};
+  size_t pack_size{0};
+  MuxWriter pack_writer{nullptr, 0};
+
+#if defined(CONFIG_APP_NUS_MUX) || !defined(CONFIG_APP_NUS_ZERO_COPY)
+  // Queue read last.
+  size_t last_queue{0};
+#endif
+
+#if defined(CONFIG_APP_NUS_SPILL)
+  // When the next block of the flash log is due.
+  int64_t replay_at{0};
+#endif
+
+#if defined(CONFIG_APP_NUS_MUX) || !defined(CONFIG_APP_NUS_ZERO_COPY)
+  /**
+   * @brief Pick the next queue with data for the centrals.
+   * 
+   * @details The queues take turns, so a busy UART or channel cannot hold the others back.
+   * 
+   * @param uarts_only Leave out the registered channels.
+   * @param channel Set to the channel of the queue.
+   * 
+   * @return The ring of the queue, or nullptr if all of them are empty.
+  */
+  nus_ring_t *next_queue(bool uarts_only, uint8_t &channel) {
+    size_t count = nus_queue_count(uarts_only);
+
+    for (size_t i = 1; i <= count; ++i) {
+      size_t index = (last_queue + i) % count;
+      nus_ring_t &ring = nus_queue(index, channel);
+      if (!ring.empty()) {
+        last_queue = index;
+        return &ring;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Pack the data waiting in the queues.
+   * 
+   * @details Each queue with data takes one turn of up to a notification's worth. With
+   *          CONFIG_APP_NUS_MUX the turns of the channels share notifications. The last
+   *          message stays open for flush().
+   * 
+   * @param payload The notification payload.
+   * 
+   * @return The number of bytes packed.
+  */
+  Task<size_t> pack_queues(size_t payload) {
+    size_t packed = 0;
+    size_t turns = nus_queue_count(false);
+    uint8_t channel;
+    nus_ring_t *ring;
+
+    while ((turns-- > 0) && (ring = next_queue(false, channel))) {
+#if !defined(CONFIG_APP_NUS_ZERO_COPY)
+      if (channel < UART_COUNT) {
+        TRACE_COPY(send_stamp, uart_nus_stamps[channel]);
+        TRACE_POINT(NUS_GET, send_stamp);
+      }
+#endif
+
+      // A wrapped ring takes two turns.
+      auto span = ring->read_claim(payload);
+      co_await pack(channel, span.data, span.len, payload);
+      ring->read_commit(span.len);
+      packed += span.len;
     }
 
-    LOG_INF("[nus thread] done");
+    co_return packed;
   }
+#endif
 
-public:
-  NusThread() {
-    // Allocate memory for the buffer. Must use heap memory because the buffer is passed to NUS service.
-    buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
-    if (!buf) {
-      LOG_ERR("Not able to allocate UART receive buffer");
-      return;
+  /**
+   * @brief Pack data of a channel into messages.
+   * 
+   * @details The data goes into the open message, which is sent once full. With
+   *          CONFIG_APP_NUS_MUX the data of several channels shares a message, each piece in a
+   *          record of its channel. flush() sends the last message.
+   * 
+   * @param channel The channel, which is also the stream of a UART.
+   * @param data The data.
+   * @param len The length of the data.
+   * @param payload The notification payload.
+  */
+  Task<> pack(uint8_t channel, const uint8_t *data, size_t len, size_t payload) {
+    for (size_t pos = 0; pos < len;) {
+      if (!pack_msg) {
+        pack_msg = nus_msg_alloc();
+        if (!pack_msg) {
+          atomic_inc(&tx_lost);
+          co_return;
+        }
+        pack_size = payload;
+        pack_writer = MuxWriter(pack_msg->data, payload);
+      }
+
+      size_t chunk;
+      if (NUS_MUX) {
+        chunk = pack_writer.write(channel, &data[pos], len - pos);
+        pack_msg->len = static_cast<uint16_t>(pack_writer.len());
+      } else {
+        chunk = MIN(len - pos, pack_size - pack_msg->len);
+        memcpy(&pack_msg->data[pack_msg->len], &data[pos], chunk);
+        pack_msg->len += chunk;
+      }
+      pos += chunk;
+
+      if (NUS_MUX ? pack_writer.full() : (pack_msg->len == pack_size)) {
+        co_await flush();
+      }
     }
   }
 
-  ~NusThread() {
-    k_free(buf);
+  /**
+   * @brief Send the open message, if any.
+  */
+  Task<> flush() {
+    if (pack_msg) {
+      nus_msg_t *msg = pack_msg;
+      pack_msg = nullptr;
+      co_await publish(msg);
+    }
   }
 
-private:
-  // Buffer used to store data received on NUS pipe and sent to BLE.
-  struct uart_data_t *buf;
+  /**
+   * @brief Send data of a channel over BLE.
+   * 
+   * @details Each call ends with a notification.
+   * 
+   * @param channel The channel, which is also the stream of a UART.
+   * @param data The data to send.
+   * @param len The number of bytes to send.
+   * @param payload The notification payload.
+  */
+  Task<> send(uint8_t channel, const uint8_t *data, size_t len, size_t payload) {
+    co_await pack(channel, data, len, payload);
+    co_await flush();
+  }
 
   /**
-   * @brief Callback for when data is received from BLE.
+   * @brief Whether a peer that is up has room in its queue.
+  */
+  static bool has_room() {
+    for (nus_peer_t &peer : nus_peers) {
+      if ((k_msgq_num_free_get(&peer.queue) > 0) && nus_peer_up(peer)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Queue a message to every peer that is up.
    * 
-   * @details This function is called when data is received from BLE. Data from BLE is
-   *          passed to the pipe (i.e. to uart).
+   * @details Waits while no peer has room, so the fastest peer sets the pace. A peer whose
+   *          queue is still full drops its oldest message to make room, which only costs
+   *          that peer. Takes over the reference of the NUS task.
    * 
-   * @param conn The connection object.
-   * @param data The data received.
-   * @param len The length of the data received.
+   * @param msg The message.
   */
-  static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data, uint16_t len) {
-    char addr[BT_ADDR_LE_STR_LEN] = {0};
-	  bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
-	  LOG_INF("Received data from: %s", addr);
-
-    for (uint16_t pos = 0; pos != len;) {
-      // \todo: can stack be used here?
-      struct uart_data_t *tx = static_cast<struct uart_data_t*>(k_malloc(sizeof(*tx)));
-      if (!tx) {
-        LOG_WRN("Not able to allocate UART send data buffer");
-        return;
+  Task<> publish(nus_msg_t *msg) {
+    TRACE_COPY(msg->stamp, send_stamp);
+
+    while (nus_link_up() && !has_room()) {
+      (void)co_await SemTake(&nus_room_sem, NUS_WRITE_TIMEOUT);
+    }
+
+    bool queued = false;
+
+    for (nus_peer_t &peer : nus_peers) {
+      if (!nus_peer_up(peer)) {
+        continue;
       }
 
-      /* Keep the last byte of TX buffer for potential LF char. */
-      int tx_data_size = sizeof(tx->data) - 1;
+      nus_msg_ref(msg);
+      if (k_msgq_put(&peer.queue, &msg, K_NO_WAIT) != 0) {
+        nus_msg_t *old;
+        if (k_msgq_get(&peer.queue, &old, K_NO_WAIT) == 0) {
+          nus_msg_unref(old);
+          atomic_inc(&peer.drops);
+        }
+        if (k_msgq_put(&peer.queue, &msg, K_NO_WAIT) != 0) {
+          nus_msg_unref(msg);
+          atomic_inc(&peer.drops);
+          continue;
+        }
+      }
+      queued = true;
+    }
 
-      if ((len - pos) > tx_data_size) {
-        tx->len = tx_data_size;
-      } else {
-        tx->len = (len - pos);
+    if (!queued) {
+      atomic_inc(&tx_lost);
+    }
+    nus_msg_unref(msg);
+  }
+
+  /**
+   * @brief Send the messages queued for a peer, one at a time.
+   * 
+   * @details The messages left when the peer disconnects are dropped.
+   * 
+   * @param peer The peer.
+  */
+  Task<> peer_sender(nus_peer_t &peer) {
+    while (true) {
+      nus_msg_t *msg = nullptr;
+      if (co_await MsgqGet(&peer.queue, &msg) != 0) {
+        continue;
+      }
+
+      // There is room for the next message now.
+      k_sem_give(&nus_room_sem);
+
+      struct bt_conn *conn = nus_peer_conn(peer);
+      if (conn) {
+        TRACE_COPY(peer.send_stamp, msg->stamp);
+#if defined(CONFIG_APP_COMPRESS)
+        if (compress_get_mode(bt_conn_index(conn)) == CompressMode::LZ) {
+          co_await send_compressed(peer, conn, msg->data, msg->len);
+        } else
+#endif
+        {
+          (void)co_await send_raw(peer, conn, msg->data, msg->len);
+        }
+        bt_conn_unref(conn);
+      }
+
+      nus_msg_unref(msg);
+    }
+  }
+
+#if defined(CONFIG_APP_COMPRESS)
+  /**
+   * @brief Compress data for a peer and send it in blocks.
+   * 
+   * @details Each peer compresses on its own, so the data is compressed once per central
+   *          in LZ mode. Every block is one notification of at most the peer's payload. The
+   *          encoder keeps its history across calls; a new stream of the peer resets it and
+   *          its next block tells the central to do the same. Messages dropped from the
+   *          queue never reach the encoder, so only a lost block starts a new stream. With
+   *          CONFIG_APP_NUS_MUX a channel record may go on in the next block.
+   * 
+   * @param peer The peer.
+   * @param conn The connection of the peer. Referenced until the task completes.
+   * @param data The data to send. Must stay valid until the task completes.
+   * @param len The number of bytes to send.
+  */
+  static Task<> send_compressed(nus_peer_t &peer, struct bt_conn *conn, const uint8_t *data, size_t len) {
+    size_t payload = Ble::get_instance().get_max_payload(conn);
+
+    for (size_t pos = 0; pos < len;) {
+      uint32_t session = compress_session(bt_conn_index(conn));
+      if (session != peer.session_id) {
+        peer.session_id = session;
+        peer.encoder.reset();
       }
 
-      // Copy the data received from ble to the buffer.
-      memcpy(tx->data, &data[pos], tx->len);
+      uint32_t start = k_cycle_get_32();
+      peer.encoder.begin(peer.block, payload);
+      size_t consumed = peer.encoder.write(&data[pos], len - pos);
+      size_t block_len = peer.encoder.end();
+      compress_count_tx(consumed, block_len, k_cycle_get_32() - start);
+      pos += consumed;
+
+      // The block fits one notification. The next blocks would refer to it if it was
+      // lost, so the stream of this peer starts over.
+      if (co_await send_raw(peer, conn, peer.block, block_len) != 0) {
+        compress_new_session(bt_conn_index(conn));
+      }
+    }
+  }
+#endif
+
+  /**
+   * @brief Send data to a peer in notifications of at most its payload.
+   * 
+   * @details Each notification is sent within the peer's in-flight window and waits while
+   *          the window is full, however long the connection interval, until the central
+   *          disconnects. If the controller is out of buffers the notification is retried
+   *          after a back-off, up to CONFIG_APP_NUS_TX_RETRIES times, then dropped.
+   * 
+   * @param peer The peer.
+   * @param conn The connection of the peer. Referenced until the task completes.
+   * @param data The data to send. Must stay valid until the task completes.
+   * @param len The number of bytes to send.
+   * 
+   * @return 0, or the error of the last notification dropped.
+  */
+  static Task<int> send_raw(nus_peer_t &peer, struct bt_conn *conn, const uint8_t *data, size_t len) {
+    size_t payload = Ble::get_instance().get_max_payload(conn);
+    int last_err = 0;
+
+    for (size_t pos = 0; pos < len;) {
+      uint16_t chunk = static_cast<uint16_t>(MIN(len - pos, payload));
+      int err;
+
+      for (int attempt = 0;; ++attempt) {
+        // Wait for a notification in flight to complete. A full window only means the
+        // central is slow, so the wait lasts as long as the connection does. A disconnect
+        // refills the window, the timeout is a safety net.
+        if (co_await SemTake(&peer.credits, NUS_WRITE_TIMEOUT) != 0) {
+          if (nus_peer_on(peer, conn)) {
+            continue;
+          }
+          err = -ENOTCONN;
+          break;
+        }
 
-      pos += tx->len;
+        // bt_nus_send copies the data into the controller buffers.
+        err = bt_nus_send(conn, &data[pos], chunk);
+        if (err == 0) {
+          atomic_inc(&peer.in_flight);
+          TRACE_POINT(NUS_SEND, peer.send_stamp);
+          break;
+        }
 
-      // Append the LF character when the CR character triggered transmission from the peer.
-      if ((pos == len) && (data[len - 1] == '\r')) {
-        tx->data[tx->len] = '\n';
-        tx->len++;
+        // Nothing was queued so no sent callback will return the credit.
+        k_sem_give(&peer.credits);
+
+        if (((err != -ENOMEM) && (err != -EAGAIN)) || (attempt == CONFIG_APP_NUS_TX_RETRIES)) {
+          break;
+        }
+
+        atomic_inc(&peer.retries);
+        co_await Sleep(K_MSEC(CONFIG_APP_NUS_TX_BACKOFF_MS));
       }
 
-      // Send ble data to pipe
-      size_t bytes_written;
-      int rc = k_pipe_put(&nus_uart_pipe, tx->data, tx->len, &bytes_written, 0, K_NO_WAIT);
-      tx->len = bytes_written;
-      if (rc < 0) {
-        LOG_WRN("nus put to nus_uart_pipe failed: %d", rc);
+      if (err) {
+        atomic_inc(&peer.drops);
+        LOG_WRN("Failed to send data over BLE connection (err %d)", err);
+        last_err = err;
+        if (!nus_peer_on(peer, conn)) {
+          // The rest would only wait for a central that is gone.
+          break;
+        }
       }
 
-      k_free(tx);
+      pos += chunk;
     }
+
+    co_return last_err;
   }
-};
 
-void nus_thread_function(void *arg0, void *arg1, void *arg2) {
-  ARG_UNUSED(arg0);
-  ARG_UNUSED(arg1);
-  ARG_UNUSED(arg2);
+  /**
+   * @brief Keep UART data for when the link is back.
+   * 
+   * @details Stored in the backlog, which drops the oldest or the newest data once full.
+   *          With CONFIG_APP_NUS_SPILL the oldest data moves to flash instead, as much as
+   *          the queue of the spill work queue takes, until the flash log is full too.
+   *          Without the backlog the data is dropped. Either way the loss is counted. The
+   *          backlog holds one stream, so only the data of the first UART is kept.
+   * 
+   * @param stream The stream of the data.
+   * @param data The data.
+   * @param len The length of the data.
+  */
+  void park(uint8_t stream, const uint8_t *data, size_t len) {
+    size_t dropped = 0;
 
-  NusThread thread;
-  thread();
-}
+    if (stream != 0) {
+      atomic_add(&backlog_dropped, len);
+      return;
+    }
+
+#if defined(CONFIG_APP_NUS_SPILL)
+    // Make room by moving the oldest data to flash, which holds far more. The spill work
+    // queue writes it; what its queue cannot take stays in the backlog.
+    size_t spilled = 0;
+    while (spill_ready && !nus_backlog.fits(len) && !nus_backlog.empty() && (spill_queue.space() > 0)) {
+      size_t moved = nus_backlog.read(notify_buf, MIN(sizeof(notify_buf), spill_queue.space()));
+      spill_queue.write(notify_buf, moved);
+      spilled += moved;
+    }
+    if (spilled > 0) {
+      k_work_submit_to_queue(&nus_spill_q, &nus_spill_work);
+    }
+#endif
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+    dropped += nus_backlog.push(data, len);
+#else
+    dropped += len;
+#endif
+
+    if (dropped > 0) {
+      atomic_add(&backlog_dropped, dropped);
+    }
+  }
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+  /**
+   * @brief Send the backlog in full notifications.
+   * 
+   * @details Stops early if the link goes down again. The notification being sent then is
+   *          lost, like those still queued in the controller.
+   * 
+   * @param payload The notification payload.
+  */
+  Task<> flush_backlog(size_t payload) {
+    while (nus_link_up() && !nus_backlog.empty()) {
+      size_t len = nus_backlog.read(notify_buf, payload);
+      co_await pack(0, notify_buf, len, payload);
+    }
+    co_await flush();
+  }
+#endif
+
+  /**
+   * @brief How long to wait for new data.
+   * 
+   * @return Until the next block of the flash log is due, or forever if there is none.
+  */
+  k_timeout_t replay_wait() const {
+#if defined(CONFIG_APP_NUS_SPILL)
+    // The spill work queue wakes the task once the block it asked for is read.
+    if (nus_link_up() && spill_pending() && (atomic_get(&spill_block_state) != SPILL_BLOCK_REQUESTED)) {
+      return K_MSEC(MAX(replay_at - k_uptime_get(), 0));
+    }
+#endif
+    return K_FOREVER;
+  }
+
+#if defined(CONFIG_APP_NUS_SPILL)
+  bool replay_due() const {
+    return nus_link_up() && spill_pending() && (atomic_get(&spill_block_state) != SPILL_BLOCK_REQUESTED) &&
+           (k_uptime_get() >= replay_at);
+  }
+
+  /**
+   * @brief Send the oldest block of the flash log.
+   * 
+   * @details The blocks are paced to CONFIG_APP_NUS_SPILL_REPLAY_RATE so the live data keeps
+   *          going out in between. A block is only marked as sent if the link is still up
+   *          after it, so one cut short goes to the next central again. The flash is read
+   *          and written by the spill work queue: the first call asks it for the block,
+   *          and the task sends the block once woken with it.
+   * 
+   * @param payload The largest notification payload.
+  */
+  Task<> replay(size_t payload) {
+    if (atomic_get(&spill_block_state) != SPILL_BLOCK_READY) {
+      atomic_set(&spill_block_state, SPILL_BLOCK_REQUESTED);
+      k_work_submit_to_queue(&nus_spill_q, &nus_spill_work);
+      co_return;
+    }
+
+    // spill_block is left alone by the spill work queue until the next request.
+    atomic_set(&spill_block_state, SPILL_BLOCK_NONE);
+    int len = spill_block_len;
+    if (len < 0) {
+      LOG_WRN("Failed to read the flash log (err %d)", len);
+      replay_at = k_uptime_get() + MSEC_PER_SEC;
+      co_return;
+    }
+    if (len == 0) {
+      co_return;
+    }
+
+    co_await send(0, spill_block, len, payload);
+
+    if (nus_link_up()) {
+      // Marked as sent before the next block is read.
+      atomic_set(&spill_pop, 1);
+      k_work_submit_to_queue(&nus_spill_q, &nus_spill_work);
+    }
+    replay_at = k_uptime_get() + (len * MSEC_PER_SEC) / CONFIG_APP_NUS_SPILL_REPLAY_RATE;
+  }
+#endif
+
+
+  /**
+   * @brief Callback for when a notification has been sent.
+   * 
+   * @details Returns the notification's credit to the in-flight window of its peer.
+   * 
+   * @param conn The connection object.
+  */
+  static void bt_sent_cb(struct bt_conn *conn) {
+    nus_peer_t &peer = nus_peers[bt_conn_index(conn)];
+
+    if (atomic_get(&peer.in_flight) > 0) {
+      atomic_dec(&peer.in_flight);
+    }
+    atomic_inc(&peer.sent);
+    k_sem_give(&peer.credits);
+  }
+
+  /**
+   * @brief Callback for when a central enables or disables the notifications.
+   * 
+   * @details The status only tells whether any central has them enabled. Each peer is
+   *          checked on its own connection instead, see Ble::nus_subscribed().
+   * 
+   * @param status The new state of the notifications.
+  */
+  static void bt_send_enabled_cb(enum bt_nus_send_status status) {
+    ARG_UNUSED(status);
+
+    nus_link_changed();
+  }
+
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+  /**
+   * @brief Take ownership of an item got from uart_nus_fifo.
+   * 
+   * @param item The item, or nullptr.
+   * 
+   * @return The UART data, or nullptr if there was none or the item only woke the task.
+  */
+  uart_nus_item_t *take_item(void *item) {
+    if (item == &nus_wake_item) {
+      atomic_clear(&wake_queued);
+      return nullptr;
+    }
+
+    uart_nus_item_t *data = static_cast<uart_nus_item_t *>(item);
+    if (data) {
+      atomic_sub(&uart_nus_fifo_bytes, data->len);
+      TRACE_POINT(NUS_GET, data->stamp);
+    }
+    return data;
+  }
+
+  /**
+   * @brief Take the next queued item without waiting.
+   * 
+   * @return The UART data, or nullptr if none is queued.
+  */
+  uart_nus_item_t *next_item() {
+    return take_item(k_fifo_get(&uart_nus_fifo, K_NO_WAIT));
+  }
+
+  /**
+   * @brief Pack the queued UART data into full notifications.
+   * 
+   * @details Takes ownership of item and of every item queued behind it. The bytes of each
+   *          are copied into the messages for the peers straight from the UART buffer, and
+   *          the item is freed. With CONFIG_APP_NUS_MUX the data of the registered channels
+   *          fills the last message.
+   * 
+   * @param item The first item.
+   * @param payload The notification payload.
+  */
+  Task<> pack_and_send(uart_nus_item_t *item, size_t payload) {
+    while (item) {
+      co_await pack(item->stream, item->data, item->len, payload);
+      uart_nus_item_free(item);
+      item = next_item();
+    }
+
+#if defined(CONFIG_APP_NUS_MUX)
+    (void)co_await pack_queues(payload);
+#endif
+    co_await flush();
+  }
+#endif
+
+  /**
+   * @brief Callback for when data is received from BLE.
+   * 
+   * @details This function is called on the Bluetooth RX thread when data is received from BLE.
+   *          It only copies the write into the ring of its stream as one record and wakes the
+   *          TX engine of the stream's UART, which does the CR/LF handling and chunking. Frames
+   *          are passed on without decoding: the UART host checks them. Compressed writes are
+   *          decompressed first. The writes of all the centrals are merged, each within its
+   *          share of the ring. With CONFIG_APP_NUS_MUX the write is split into its channel
+   *          records first, and a write that does not end with a whole record is dropped as
+   *          overrun.
+   * 
+   * @param conn The connection object.
+   * @param data The data received.
+   * @param len The length of the data received.
+  */
+  static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data, uint16_t len) {
+    uint8_t peer = bt_conn_index(conn);
+    bool raw = framing_get_mode() == FrameMode::COBS;
+
+    if (len == 0) {
+      return;
+    }
+
+#if defined(CONFIG_APP_COMPRESS)
+    if (compress_get_mode(peer) == CompressMode::LZ) {
+      nus_put_compressed(peer, data, len);
+    } else
+#endif
+    {
+#if defined(CONFIG_APP_NUS_MUX)
+      if (!MuxParser::whole(data, len)) {
+        atomic_add(&rx_overrun_bytes, len);
+        return;
+      }
+
+      MuxParser parser;
+      rx_mux_peer = peer;
+      rx_mux_raw = raw;
+      parser.feed(data, len, nus_mux_sink);
+#else
+      nus_uart_put(peer, 0, data, len, raw);
+#endif
+    }
+
+    if (!NUS_MUX) {
+      nus_uart_kick(0);
+    }
+  }
+};
 
-K_THREAD_DEFINE(nus_thread_id, CONFIG_MAIN_STACK_SIZE, nus_thread_function, NULL, NULL, NULL, 4, 0, 0);
\ No newline at end of file
+void nus_task_start() {
+  static NusTask task;
+  task.start();
+}
@@ -1,89 +1,382 @@
-#include "thread_base.hpp"
+#include "task_base.hpp"
+#include "tasks.hpp"
 #include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "uart_nus.hpp"
+#include "trace.hpp"
+#include "framing.hpp"
 #include <errno.h>
+#include <cstring>
+#include <utility>
 #include <zephyr/kernel.h>
 #include <zephyr/settings/settings.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_REGISTER(uart_thread_log);
 
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
 /**
- * @brief This pipe is used to pass data from the UART to the NUS.
+ * @brief This FIFO is used to hand the received bytes to the NUS by reference.
+*/
+K_FIFO_DEFINE(uart_nus_fifo);
+atomic_t uart_nus_fifo_bytes;
+
+K_MEM_SLAB_DEFINE_STATIC(uart_nus_item_slab, sizeof(uart_nus_item_t), CONFIG_APP_UART_NUS_ITEMS, alignof(uart_nus_item_t));
+
+/**
+ * @brief Get an item for bytes of a buffer.
+ * 
+ * @param buf The buffer. The item takes a reference to it.
+ * @param offset The offset of the bytes in the buffer.
+ * @param len The number of bytes.
  * 
- * @details The naming format is <putter>_<getter>_pipe.
+ * @return The item, or nullptr if none is left.
 */
-K_PIPE_DEFINE(uart_nus_pipe, 1024, 4);
+uart_nus_item_t *uart_nus_item_alloc(uart_data_t *buf, size_t offset, size_t len) {
+  void *block;
+
+  if (k_mem_slab_alloc(&uart_nus_item_slab, &block, K_NO_WAIT) != 0) {
+    return nullptr;
+  }
+
+  UartBufPool::ref(buf);
+
+  uart_nus_item_t *item = static_cast<uart_nus_item_t *>(block);
+  item->buf = buf;
+  item->data = &buf->data[offset];
+  item->len = static_cast<uint16_t>(len);
+  item->stream = buf->stream;
+  return item;
+}
 
 /**
- * @brief FIFO buffer for UART data.
+ * @brief Free an item and drop its reference to the buffer.
+ * 
+ * @param item The item.
 */
-extern struct k_fifo uart_rx_fifo;
+void uart_nus_item_free(uart_nus_item_t *item) {
+  UartBufPool::free(item->buf);
+  k_mem_slab_free(&uart_nus_item_slab, static_cast<void *>(item));
+}
+#else
+/**
+ * @brief These rings are used to pass data from the UARTs to the NUS, one per UART.
+ * 
+ * @details The semaphore is given after every write to wake the NUS task.
+*/
+uart_nus_ring_t uart_nus_rings[UART_COUNT];
+K_SEM_DEFINE(uart_nus_sem, 0, 1);
+
+#if defined(CONFIG_APP_TRACE)
+trace_stamp_t uart_nus_stamps[UART_COUNT];
+#endif
+#endif
 
 /**
- * @brief Thread for handling UART.
+ * @brief Task for handling UART.
  * 
- * @details This thread is responsible for initializing the UART and handling
- *          incoming data from the UART. It passes the data to the uart_nus_pipe.
+ * @details This task is responsible for initializing one UART and handling
+ *          incoming data from it. It passes the data to the uart_nus_fifo
+ *          (zero-copy, by reference) or the uart_nus_rings, tagged with the
+ *          stream of its UART. Each bridged UART has a task of its own.
 */
-class UartThread : public ThreadBase<UartThread> {
-  friend class ThreadBase<UartThread>;
+class UartTask : public TaskBase<UartTask> {
+  friend class TaskBase<UartTask>;
+
+public:
+  explicit UartTask(uint8_t id) : uart(id) {}
 
 protected:
   bool init() override {
-    Uart uart;
+    // The UART TX engine drains the BLE data of its stream.
+    uart.set_tx_source(&nus_uart_source);
+
     int err = uart.init();
     if (err != 0) {
-      LOG_ERR("uart_init failed (err %d)", err);
+      LOG_ERR("uart_init failed for UART %u (err %d)", uart.id(), err);
       return false;
     }
     return true;
   }
 
-  void run() override {
-    LOG_INF("[uart thread] starting");
+  Task<> run() override {
+    while (true) {
+      LOG_INF("[uart task] starting");
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+      struct uart_rx_segment_t seg;
+
+      // Wait for data. While a partial line is pending, forward it once the UART goes idle.
+      k_timeout_t timeout = (pending.len > 0) ? K_MSEC(CONFIG_APP_UART_LINE_IDLE_MS) : K_FOREVER;
+      if (co_await MsgqGet(uart.rx_queue(), &seg, timeout) != 0) {
+        forward_pending();
+        continue;
+      }
+
+      if (seg.buf != rx_buf) {
+        // The UART moved on to a new buffer so the previous one is complete. A line cannot
+        // span two buffers by reference, so its first part goes now.
+        forward_pending();
+        UartBufPool::free(rx_buf);
+        rx_buf = seg.buf;
+      }
+
+      if (seg.len == 0) {
+        // The UART released the buffer and all of its data has been consumed.
+        forward_pending();
+        UartBufPool::free(rx_buf);
+        rx_buf = nullptr;
+        continue;
+      }
 
-    buf = static_cast<uart_data_t *>(k_fifo_get(&uart_rx_fifo, K_FOREVER));
-    LOG_INF("[uart thread] buf->data: %s", buf->data);
-    
-    size_t bytes_written;
-    int err = k_pipe_put(&uart_nus_pipe, buf->data, buf->len, &bytes_written, 0, K_NO_WAIT);
+      TRACE_POINT(UART_RX_GET, seg.stamp);
+#if defined(CONFIG_APP_FRAMING)
+      set_mode(framing_get_mode());
+      if (mode == FrameMode::COBS) {
+        split_frames(seg);
+        continue;
+      }
+#endif
+      split_lines(seg);
+#else
+      uart_data_t *buf = static_cast<uart_data_t *>(co_await FifoGet(uart.rx_queue()));
+      if (!buf) {
+        continue;
+      }
 
-    if (err < 0) {
-      LOG_WRN("UART put to uart_nus_pipe failed: %d", err);
-    } else if (bytes_written < buf->len) {
-      LOG_WRN("UART put to uart_nus_pipe incomplete: %d of %d bytes written", bytes_written, buf->len);
+      TRACE_POINT(UART_RX_GET, buf->stamp);
+      LOG_INF("[uart task] buf->data: %s", buf->data);
+      forward(buf);
+#endif
+
+      LOG_INF("[uart task] done");
     }
+  }
+
+private:
+  // The UART owned by this task. It must outlive init() because its callbacks use it.
+  Uart uart;
 
-    k_free(buf);
-    LOG_INF("[uart thread] done");
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  // RX buffer the current segments belong to. Returned to the pool once the UART is done with it.
+  uart_data_t *rx_buf{nullptr};
+
+  // Bytes of rx_buf received since the last line was forwarded. Empty when len is 0.
+  uart_rx_segment_t pending{};
+
+  /**
+   * @brief Split received bytes into lines.
+   * 
+   * @details The bytes are not copied. The segment extends the pending bytes of rx_buf, and
+   *          everything up to its last '\n' or '\r' is forwarded by reference. The rest waits
+   *          for the end of its line, the UART going idle or the next buffer.
+   * 
+   * @param seg The received segment.
+  */
+  void split_lines(const uart_rx_segment_t &seg) {
+    if ((pending.len > 0) && (seg.offset != pending.offset + pending.len)) {
+      forward_pending();
+    }
+    if (pending.len == 0) {
+      // The line is as old as the segment its first byte came from.
+      pending = seg;
+      pending.len = 0;
+    }
+    pending.len += seg.len;
+
+    const uint8_t *data = &seg.buf->data[seg.offset];
+    for (size_t end = seg.len; end > 0; --end) {
+      if ((data[end - 1] == '\n') || (data[end - 1] == '\r')) {
+        uart_rx_segment_t lines = pending;
+        lines.len -= seg.len - end;
+        forward_segment(lines);
+
+        pending.offset += lines.len;
+        pending.len -= lines.len;
+        TRACE_COPY(pending.stamp, seg.stamp);
+        break;
+      }
+    }
   }
 
-public:
-  UartThread() {
-    // Allocate memory for the buffer. Must use heap memory because the buffer is passed to NUS service.
-    buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
-    if (!buf) {
-      LOG_ERR("Not able to allocate UART receive buffer");
+  // Forward the pending bytes, if any.
+  void forward_pending() {
+    if (pending.len > 0) {
+      forward_segment(pending);
+      pending.len = 0;
+    }
+  }
+
+#if defined(CONFIG_APP_FRAMING)
+  // Framing of the data being received.
+  FrameMode mode{FrameMode::LINE};
+
+  // Decoder run over the raw stream in framed mode.
+  FrameDecoder decoder;
+
+  // Encoded bytes of the frame being decoded, forwarded once it is valid.
+  uint8_t frame[FRAME_MAX_ENCODED];
+  size_t frame_len{0};
+  TRACE_STAMP_FIELD(frame_stamp)
+
+  /**
+   * @brief Switch to the framing of the current connection.
+   * 
+   * @details A partial line is forwarded and a partial frame dropped.
+   * 
+   * @param next The framing mode.
+  */
+  void set_mode(FrameMode next) {
+    if (next == mode) {
       return;
     }
+
+    forward_pending();
+    decoder.reset();
+    frame_len = 0;
+    mode = next;
   }
 
-  ~UartThread() {
-    k_free(buf);
+  /**
+   * @brief Decode frames from received bytes.
+   * 
+   * @details The encoded bytes are kept until the delimiter. Only frames that pass the
+   *          length and CRC checks are forwarded, still encoded and with their delimiter.
+   * 
+   * @param seg The received segment.
+  */
+  void split_frames(const uart_rx_segment_t &seg) {
+    const uint8_t *data = &seg.buf->data[seg.offset];
+
+    for (size_t pos = 0; pos < seg.len; ++pos) {
+      if (frame_len == 0) {
+        // The frame is as old as the segment its first byte came from.
+        TRACE_COPY(frame_stamp, seg.stamp);
+      }
+      if (frame_len < sizeof(frame)) {
+        // The decoder reports the overrun at the delimiter.
+        frame[frame_len++] = data[pos];
+      }
+
+      FrameDecoder::Result result = decoder.feed(data[pos]);
+      if (result == FrameDecoder::Result::FRAME) {
+        forward_frame();
+      } else if (result != FrameDecoder::Result::MORE) {
+        LOG_WRN("UART frame dropped (result %d)", static_cast<int>(result));
+      }
+
+      if (data[pos] == FRAME_DELIMITER) {
+        frame_len = 0;
+      }
+    }
   }
 
-private:
-  // Buffer used to store data received on NUS pipe and sent to BLE.
-  struct uart_data_t *buf;
+  /**
+   * @brief Pass a decoded frame on to the NUS.
+   * 
+   * @details The frame is copied into as many pool buffers as it needs. It is dropped whole
+   *          if the pool cannot hold it, so the central never sees a partial frame.
+  */
+  void forward_frame() {
+    UartBufPool::Stats pool = UartBufPool::get_stats();
+    size_t needed = DIV_ROUND_UP(frame_len, UART_BUF_SIZE);
+    if (pool.capacity - pool.in_use < needed) {
+      LOG_WRN("Not able to allocate UART frame buffers, %zu bytes dropped", frame_len);
+      return;
+    }
+
+    for (size_t pos = 0; pos < frame_len;) {
+      uart_data_t *buf = UartBufPool::alloc();
+      if (!buf) {
+        LOG_WRN("Not able to allocate UART frame buffer, %zu bytes dropped", frame_len - pos);
+        return;
+      }
+
+      size_t chunk = MIN(frame_len - pos, sizeof(buf->data));
+      memcpy(buf->data, &frame[pos], chunk);
+      buf->len = chunk;
+      TRACE_COPY(buf->stamp, frame_stamp);
+      forward(buf);
+      pos += chunk;
+    }
+  }
+#endif
+#endif
+
+  /**
+   * @brief Pass a filled buffer on to the NUS.
+   * 
+   * @details Takes ownership of buf.
+   * 
+   * @param buf The buffer to forward.
+  */
+  void forward(uart_data_t *buf) {
+    uart_rx_segment_t seg = {
+      .buf = buf,
+      .offset = 0,
+      .len = buf->len,
+    };
+    TRACE_COPY(seg.stamp, buf->stamp);
+
+    forward_segment(seg);
+    UartBufPool::free(buf);
+  }
+
+  /**
+   * @brief Pass received bytes on to the NUS.
+   * 
+   * @details The bytes are either handed over by reference to their buffer or copied into
+   *          the ring of the stream.
+   * 
+   * @param seg The bytes. The caller keeps its reference to the buffer.
+  */
+  void forward_segment(uart_rx_segment_t seg) {
+    TRACE_POINT(UART_NUS_PUT, seg.stamp);
+    seg.buf->stream = uart.id();
+
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+    // The NUS task frees the item, and drops its reference to the buffer, once packed.
+    uart_nus_item_t *item = uart_nus_item_alloc(seg.buf, seg.offset, seg.len);
+    if (!item) {
+      LOG_WRN("Not able to queue UART data, %u bytes dropped", seg.len);
+      return;
+    }
+    TRACE_COPY(item->stamp, seg.stamp);
+    atomic_add(&uart_nus_fifo_bytes, item->len);
+    k_fifo_put(&uart_nus_fifo, item);
+#else
+    uart_nus_ring_t &ring = uart_nus_rings[seg.buf->stream];
+
+#if defined(CONFIG_APP_TRACE)
+    if (ring.empty()) {
+      // This write holds the oldest unread data.
+      TRACE_COPY(uart_nus_stamps[seg.buf->stream], seg.stamp);
+    }
+#endif
+
+    size_t bytes_written = ring.write(&seg.buf->data[seg.offset], seg.len);
+    if (bytes_written < seg.len) {
+      LOG_WRN("UART put to uart_nus_ring incomplete: %zu of %u bytes written", bytes_written, seg.len);
+    }
+    k_sem_give(&uart_nus_sem);
+#endif
+  }
 };
 
-static void uart_thread_function(void *arg0, void *arg1, void *arg2) {
-  ARG_UNUSED(arg0);
-  ARG_UNUSED(arg1);
-  ARG_UNUSED(arg2);
+/**
+ * @brief Start a task for each bridged UART.
+ * 
+ * @details A UART that fails to start is left out. The others bridge their streams anyway.
+*/
+template<size_t... Ids>
+static void uart_tasks_start(std::index_sequence<Ids...>) {
+  static UartTask tasks[] = {UartTask(Ids)...};
 
-  UartThread thread;
-  thread();
+  for (UartTask &task : tasks) {
+    (void)task.start();
+  }
 }
 
-K_THREAD_DEFINE(uart_thread_id, CONFIG_MAIN_STACK_SIZE, uart_thread_function, NULL, NULL, NULL, 4, 0, 0);
\ No newline at end of file
+void uart_task_start() {
+  uart_tasks_start(std::make_index_sequence<UART_COUNT>{});
+}
@@ -0,0 +1,312 @@
+#include "trace.hpp"
+
+#if defined(CONFIG_APP_TRACE)
+
+#include <errno.h>
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/timing/timing.h>
+
+#if defined(CONFIG_APP_TRACE_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+#if defined(CONFIG_APP_TRACE_GATT)
+#include "gatt.hpp"
+#include <zephyr/sys/byteorder.h>
+#endif
+
+/**
+ * @brief Histogram of one stage.
+ *
+ * @details Atomics are used because some stages are closed from more than one context,
+ *          e.g. UART_TX_START from the TX work and from the UART callback.
+*/
+struct trace_hist_t {
+  atomic_t count;
+  atomic_t max_cycles;
+  atomic_t buckets[TRACE_BUCKETS];
+};
+
+static struct trace_hist_t hists[TRACE_POINT_COUNT];
+
+static const char *const point_names[TRACE_POINT_COUNT] = {
+  "uart_rx_buf_released",
+  "uart_rx_get",
+  "uart_nus_put",
+  "nus_get",
+  "nus_send",
+  "nus_uart_get",
+  "uart_tx_start",
+  "uart_tx_done",
+};
+
+/**
+ * @brief Add the time since a stamp to a stage histogram and restamp.
+ *
+ * @param point The trace point closing the stage.
+ * @param stamp The stamp carried by the data. Updated to the current time.
+*/
+void trace_point(TracePoint point, trace_stamp_t *stamp) {
+  trace_stamp_t now = trace_now();
+  uint32_t cycles = now - *stamp;
+  *stamp = now;
+
+  struct trace_hist_t *hist = &hists[static_cast<size_t>(point)];
+  size_t bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+
+  atomic_inc(&hist->count);
+  atomic_inc(&hist->buckets[bucket]);
+
+  atomic_val_t max = atomic_get(&hist->max_cycles);
+  while (static_cast<uint32_t>(max) < cycles) {
+    if (atomic_cas(&hist->max_cycles, max, static_cast<atomic_val_t>(cycles))) {
+      break;
+    }
+    max = atomic_get(&hist->max_cycles);
+  }
+}
+
+/**
+ * @brief Get the name of a trace point.
+ *
+ * @param point The trace point.
+ *
+ * @return The name.
+*/
+const char *trace_point_name(TracePoint point) {
+  return point_names[static_cast<size_t>(point)];
+}
+
+/**
+ * @brief Get a snapshot of a stage histogram.
+ *
+ * @param point The trace point closing the stage.
+ * @param stats The snapshot.
+*/
+void trace_get(TracePoint point, TraceStats *stats) {
+  struct trace_hist_t *hist = &hists[static_cast<size_t>(point)];
+
+  stats->count = static_cast<uint32_t>(atomic_get(&hist->count));
+  stats->max_cycles = static_cast<uint32_t>(atomic_get(&hist->max_cycles));
+  for (size_t i = 0; i < TRACE_BUCKETS; ++i) {
+    stats->buckets[i] = static_cast<uint32_t>(atomic_get(&hist->buckets[i]));
+  }
+}
+
+/**
+ * @brief Clear all histograms.
+*/
+void trace_reset() {
+  for (auto &hist : hists) {
+    atomic_clear(&hist.count);
+    atomic_clear(&hist.max_cycles);
+    for (auto &bucket : hist.buckets) {
+      atomic_clear(&bucket);
+    }
+  }
+}
+
+/**
+ * @brief Convert trace cycles to nanoseconds.
+ *
+ * @param cycles The number of cycles.
+ *
+ * @return The time in nanoseconds.
+*/
+uint64_t trace_cycles_to_ns(uint64_t cycles) {
+#if defined(CONFIG_TIMING_FUNCTIONS)
+  return timing_cycles_to_ns(cycles);
+#else
+  return k_cyc_to_ns_floor64(cycles);
+#endif
+}
+
+/**
+ * @brief Estimate a percentile from a histogram.
+ *
+ * @param stats The histogram.
+ * @param pct The percentile, 0 to 100.
+ *
+ * @return The upper bound in cycles of the bucket holding the percentile, or 0 if the stage is empty.
+*/
+uint32_t trace_percentile_cycles(const TraceStats *stats, uint32_t pct) {
+  uint64_t target = (static_cast<uint64_t>(stats->count) * pct + 99) / 100;
+  uint64_t seen = 0;
+
+  if (stats->count == 0) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < TRACE_BUCKETS; ++i) {
+    seen += stats->buckets[i];
+    if (seen >= target) {
+      return (i == 0) ? 0 : ((i >= 32) ? UINT32_MAX : (1U << i) - 1);
+    }
+  }
+
+  return stats->max_cycles;
+}
+
+#if defined(CONFIG_TIMING_FUNCTIONS)
+/**
+ * @brief Start the timing counter.
+*/
+static int trace_init() {
+  timing_init();
+  timing_start();
+  return 0;
+}
+
+SYS_INIT(trace_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif
+
+#if defined(CONFIG_APP_TRACE_SHELL)
+static int cmd_trace_show(const struct shell *sh, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  TraceStats stats;
+
+  shell_print(sh, "%-22s %10s %10s %10s %10s", "stage", "count", "p50 us", "p99 us", "max us");
+  for (size_t i = 0; i < TRACE_POINT_COUNT; ++i) {
+    TracePoint point = static_cast<TracePoint>(i);
+    trace_get(point, &stats);
+    if (stats.count == 0) {
+      continue;
+    }
+
+    shell_print(sh, "%-22s %10u %10llu %10llu %10llu", trace_point_name(point), stats.count,
+                static_cast<unsigned long long>(trace_cycles_to_ns(trace_percentile_cycles(&stats, 50)) / 1000),
+                static_cast<unsigned long long>(trace_cycles_to_ns(trace_percentile_cycles(&stats, 99)) / 1000),
+                static_cast<unsigned long long>(trace_cycles_to_ns(stats.max_cycles) / 1000));
+  }
+
+  return 0;
+}
+
+static int cmd_trace_hist(const struct shell *sh, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+
+  TraceStats stats;
+  size_t i;
+
+  for (i = 0; i < TRACE_POINT_COUNT; ++i) {
+    if (strcmp(argv[1], trace_point_name(static_cast<TracePoint>(i))) == 0) {
+      break;
+    }
+  }
+  if (i == TRACE_POINT_COUNT) {
+    shell_error(sh, "Unknown stage %s", argv[1]);
+    return -EINVAL;
+  }
+
+  trace_get(static_cast<TracePoint>(i), &stats);
+  for (size_t b = 0; b < TRACE_BUCKETS; ++b) {
+    if (stats.buckets[b] > 0) {
+      shell_print(sh, "< %10llu ns: %u", static_cast<unsigned long long>(trace_cycles_to_ns(1ULL << b)),
+                  stats.buckets[b]);
+    }
+  }
+
+  return 0;
+}
+
+static int cmd_trace_reset(const struct shell *sh, size_t argc, char **argv) {
+  ARG_UNUSED(argc);
+  ARG_UNUSED(argv);
+
+  trace_reset();
+  shell_print(sh, "Trace histograms cleared");
+  return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+  SHELL_CMD(show, NULL, "Show the latency of every stage", cmd_trace_show),
+  SHELL_CMD_ARG(hist, NULL, "Show the histogram of one stage: hist <stage>", cmd_trace_hist, 2, 0),
+  SHELL_CMD(reset, NULL, "Clear the histograms", cmd_trace_reset),
+  SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(trace, &trace_cmds, "Data path latency trace", NULL);
+#endif
+
+#if defined(CONFIG_APP_TRACE_GATT)
+/**
+ * @brief Value of the trace characteristic.
+ *
+ * @details Little endian. Times are in trace cycles at freq_hz.
+*/
+struct __packed trace_gatt_value_t {
+  uint8_t point;
+  uint8_t bucket_count;
+  uint32_t freq_hz;
+  uint32_t count;
+  uint32_t max_cycles;
+  uint32_t buckets[TRACE_BUCKETS];
+};
+
+// Trace point returned by the next read.
+static uint8_t gatt_point;
+
+#define BT_UUID_TRACE_SERVICE_VAL BT_UUID_128_ENCODE(0x8e7f1a20, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+#define BT_UUID_TRACE_HIST_VAL BT_UUID_128_ENCODE(0x8e7f1a21, 0x4c1b, 0x4f3e, 0x9a7d, 0x2b6c5e0d1f00)
+
+static struct bt_uuid_128 trace_service_uuid = BT_UUID_INIT_128(BT_UUID_TRACE_SERVICE_VAL);
+static struct bt_uuid_128 trace_hist_uuid = BT_UUID_INIT_128(BT_UUID_TRACE_HIST_VAL);
+
+static struct bt_gatt_chrc trace_hist_chrc = BT_GATT_CHRC_INIT(&trace_hist_uuid.uuid, 0U,
+                                                               BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE);
+
+static ssize_t trace_hist_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+                               uint16_t len, uint16_t offset) {
+  TraceStats stats;
+  struct trace_gatt_value_t value;
+
+  trace_get(static_cast<TracePoint>(gatt_point), &stats);
+
+  value.point = gatt_point;
+  value.bucket_count = TRACE_BUCKETS;
+#if defined(CONFIG_TIMING_FUNCTIONS)
+  value.freq_hz = sys_cpu_to_le32(static_cast<uint32_t>(timing_freq_get()));
+#else
+  value.freq_hz = sys_cpu_to_le32(static_cast<uint32_t>(sys_clock_hw_cycles_per_sec()));
+#endif
+  value.count = sys_cpu_to_le32(stats.count);
+  value.max_cycles = sys_cpu_to_le32(stats.max_cycles);
+  for (size_t i = 0; i < TRACE_BUCKETS; ++i) {
+    value.buckets[i] = sys_cpu_to_le32(stats.buckets[i]);
+  }
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, &value, sizeof(value));
+}
+
+static ssize_t trace_hist_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+                                uint16_t len, uint16_t offset, uint8_t flags) {
+  ARG_UNUSED(conn);
+  ARG_UNUSED(attr);
+  ARG_UNUSED(flags);
+
+  if ((offset != 0) || (len != 1)) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+
+  uint8_t point = *static_cast<const uint8_t *>(buf);
+  if (point >= TRACE_POINT_COUNT) {
+    return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+  }
+
+  gatt_point = point;
+  return len;
+}
+
+BT_GATT_SERVICE_DEFINE(trace_svc,
+  GATT_PRIMARY_SERVICE(&trace_service_uuid.uuid),
+  GATT_CHRC_DECLARATION(&trace_hist_chrc),
+  BT_GATT_ATTRIBUTE(&trace_hist_uuid.uuid, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, trace_hist_read, trace_hist_write, NULL),
+);
+#endif
+
+#endif // CONFIG_APP_TRACE
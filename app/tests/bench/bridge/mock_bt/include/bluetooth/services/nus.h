@@ -0,0 +1,38 @@
+/**
+ * @file nus.h
+ *
+ * @brief Mock of the NCS Nordic UART Service API.
+ *
+ * @details Shadows <bluetooth/services/nus.h>. The functions are implemented by the
+ *          simulated link in mock_bt/nus.cpp.
+ */
+#ifndef _MOCK_BT_NUS_H_
+#define _MOCK_BT_NUS_H_
+
+#include <stdint.h>
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bt_nus_send_status {
+  BT_NUS_SEND_STATUS_ENABLED,
+  BT_NUS_SEND_STATUS_DISABLED,
+};
+
+struct bt_nus_cb {
+  void (*received)(struct bt_conn *conn, const uint8_t *const data, uint16_t len);
+  void (*sent)(struct bt_conn *conn);
+  void (*send_enabled)(enum bt_nus_send_status status);
+};
+
+int bt_nus_init(struct bt_nus_cb *callbacks);
+
+int bt_nus_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MOCK_BT_NUS_H_
@@ -0,0 +1,53 @@
+#ifndef _BT_SIM_HPP_
+#define _BT_SIM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Simulated BLE link behind the mocked NUS API.
+ *
+ * @details The link has CONFIG_BT_MAX_CONN centrals, each with a controller of its own.
+ *          bt_nus_send() queues a notification in the controller queue of its connection,
+ *          of CONFIG_BT_CONN_TX_MAX entries, and fails with -ENOMEM when it is full. Each
+ *          controller sends one notification at a time, taking the air time for its payload
+ *          plus the link layer overhead at the link rate of its central, then hands the
+ *          payload to the notify sink of the central and calls the NUS sent callback.
+ *
+ *          A simulated central honours the flow control characteristic: an XOFF notification
+ *          pauses it and XON resumes it. They take their turn in the controller queue like the
+ *          NUS notifications but are not passed to the sink, and every NUS notification is,
+ *          whatever its data.
+ *
+ *          The central argument of the calls below defaults to the first one.
+*/
+class BtSim {
+public:
+  // Receives the payload of every data notification once it has been sent.
+  using NotifySink = void (*)(const uint8_t *data, size_t len);
+
+  // Link layer, L2CAP and ATT overhead added to the air time of every packet.
+  static constexpr size_t PACKET_OVERHEAD = 14;
+
+  // True once the NUS task has called bt_nus_init().
+  static bool is_initialized();
+
+  // Connect a simulated central with the given NUS payload.
+  static void connect(size_t payload, size_t central = 0);
+  static void disconnect(size_t central = 0);
+
+  static void set_link_rate(uint32_t bytes_per_s, size_t central = 0);
+  static uint32_t air_time_us(size_t len, size_t central = 0);
+
+  static void set_notify_sink(NotifySink sink, size_t central = 0);
+
+  // True while the central is paused by XOFF.
+  static bool is_paused(size_t central = 0);
+
+  // Write data from a central. Calls the NUS received callback like the BT RX thread would.
+  static void write(const uint8_t *data, uint16_t len, size_t central = 0);
+
+  BtSim() = delete;
+};
+
+#endif // _BT_SIM_HPP_
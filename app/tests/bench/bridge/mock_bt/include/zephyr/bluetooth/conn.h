@@ -0,0 +1,43 @@
+/**
+ * @file conn.h
+ *
+ * @brief Mock of the Bluetooth connection API.
+ *
+ * @details Shadows <zephyr/bluetooth/conn.h> so the NUS task builds without the Bluetooth
+ *          stack. Only what the application uses is declared. The NUS task follows the
+ *          connection through ble_conn_chan, which the simulated link publishes to.
+ */
+#ifndef _MOCK_BT_CONN_H_
+#define _MOCK_BT_CONN_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Size of the connection TX queue. Set by the bench Kconfig, matches app/prj.conf.
+*/
+#ifndef CONFIG_BT_CONN_TX_MAX
+#define CONFIG_BT_CONN_TX_MAX 8
+#endif
+
+/**
+ * @brief Connections of the simulated link. Set by the bench Kconfig, 1 by default.
+*/
+#ifndef CONFIG_BT_MAX_CONN
+#define CONFIG_BT_MAX_CONN 1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bt_conn;
+
+struct bt_conn *bt_conn_ref(struct bt_conn *conn);
+void bt_conn_unref(struct bt_conn *conn);
+uint8_t bt_conn_index(const struct bt_conn *conn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MOCK_BT_CONN_H_
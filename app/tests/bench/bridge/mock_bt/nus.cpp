@@ -0,0 +1,213 @@
+/**
+ * @file nus.cpp
+ *
+ * @brief Simulated BLE link implementing the mocked NUS API.
+ */
+#include "bt_sim.hpp"
+#include "ble.hpp"
+#include "ble_events.h"
+#include "flow_control.hpp"
+#include <errno.h>
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/zbus/zbus.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+struct bt_conn {
+  uint8_t index;
+};
+
+/**
+ * @brief A notification waiting in the controller.
+ *
+ * @details Flow control notifications are on a characteristic of their own, so they are
+ *          told apart by that rather than by their data.
+*/
+struct bt_sim_notification {
+  bool flow_control;
+  uint16_t len;
+  uint8_t data[NUS_MAX_PAYLOAD];
+};
+
+/**
+ * @brief A simulated central and the controller of its connection.
+ *
+ * @details The connection lives as long as the program. on_air is only touched by the
+ *          controller work, which runs on the cooperative system workqueue.
+*/
+struct bt_sim_central {
+  struct bt_conn conn;
+  atomic_t connected;
+  atomic_t paused;
+  uint32_t link_rate{100000};
+  BtSim::NotifySink notify_sink;
+
+  struct k_msgq tx_queue;
+  struct bt_sim_notification tx_queue_buf[CONFIG_BT_CONN_TX_MAX];
+  struct bt_sim_notification on_air;
+  struct k_work_delayable controller_work;
+};
+
+static bt_sim_central centrals[CONFIG_BT_MAX_CONN];
+
+static struct bt_nus_cb *nus_cb;
+
+struct bt_conn *bt_conn_ref(struct bt_conn *conn) {
+  return conn;
+}
+
+void bt_conn_unref(struct bt_conn *conn) {
+  ARG_UNUSED(conn);
+}
+
+uint8_t bt_conn_index(const struct bt_conn *conn) {
+  return conn->index;
+}
+
+/**
+ * @brief Complete the notification on the air and start the next one.
+ *
+ * @param item The work item.
+*/
+static void controller_work_handler(struct k_work *item) {
+  bt_sim_central *central = CONTAINER_OF(k_work_delayable_from_work(item), bt_sim_central, controller_work);
+  struct bt_sim_notification &on_air = central->on_air;
+
+  if (on_air.len > 0) {
+    if (on_air.flow_control) {
+      atomic_set(&central->paused, on_air.data[0] == FLOW_XOFF);
+    } else {
+      if (central->notify_sink) {
+        central->notify_sink(on_air.data, on_air.len);
+      }
+      // Only the NUS notifications complete through the NUS sent callback.
+      if (nus_cb && nus_cb->sent) {
+        nus_cb->sent(&central->conn);
+      }
+    }
+
+    on_air.len = 0;
+  }
+
+  if (k_msgq_get(&central->tx_queue, &on_air, K_NO_WAIT) == 0) {
+    k_work_schedule(&central->controller_work, K_USEC(BtSim::air_time_us(on_air.len, central->conn.index)));
+  }
+}
+
+int bt_nus_init(struct bt_nus_cb *callbacks) {
+  for (size_t i = 0; i < CONFIG_BT_MAX_CONN; ++i) {
+    bt_sim_central &central = centrals[i];
+
+    central.conn.index = static_cast<uint8_t>(i);
+    k_msgq_init(&central.tx_queue, reinterpret_cast<char *>(central.tx_queue_buf),
+                sizeof(struct bt_sim_notification), CONFIG_BT_CONN_TX_MAX);
+    k_work_init_delayable(&central.controller_work, controller_work_handler);
+  }
+
+  nus_cb = callbacks;
+  return 0;
+}
+
+/**
+ * @brief Queue a notification in the controller of a connection.
+ *
+ * @return 0, -ENOTCONN without a connection, or -ENOMEM if the queue is full.
+*/
+static int queue_notification(struct bt_conn *conn, bool flow_control, const uint8_t *data, uint16_t len) {
+  bt_sim_central &central = centrals[conn->index];
+
+  if (!atomic_get(&central.connected)) {
+    return -ENOTCONN;
+  }
+
+  struct bt_sim_notification notification;
+  notification.flow_control = flow_control;
+  notification.len = len;
+  memcpy(notification.data, data, len);
+  if (k_msgq_put(&central.tx_queue, &notification, K_NO_WAIT) != 0) {
+    return -ENOMEM;
+  }
+
+  k_work_schedule(&central.controller_work, K_NO_WAIT);
+  return 0;
+}
+
+int bt_nus_send(struct bt_conn *conn, const uint8_t *data, uint16_t len) {
+  if ((len == 0) || (len > Ble::get_instance().get_max_payload(conn))) {
+    return -EINVAL;
+  }
+
+  return queue_notification(conn, false, data, len);
+}
+
+// The simulated centrals subscribe to the flow control characteristic too.
+int flow_control_notify(struct bt_conn *conn, bool paused) {
+  uint8_t code = paused ? FLOW_XOFF : FLOW_XON;
+  return queue_notification(conn, true, &code, sizeof(code));
+}
+
+/**
+ * @brief Publish a connection event like the BLE device does.
+*/
+static void publish_conn_event(struct bt_conn *conn, bool up, uint8_t reason) {
+  const struct ble_conn_event evt = {
+    .conn = conn,
+    .connected = up,
+    .reason = reason,
+  };
+
+  (void)zbus_chan_pub(&ble_conn_chan, &evt, K_FOREVER);
+}
+
+bool BtSim::is_initialized() {
+  return nus_cb != nullptr;
+}
+
+void BtSim::connect(size_t payload, size_t central) {
+  bt_sim_central &sim = centrals[central];
+
+  Ble::get_instance().set_max_payload(&sim.conn, payload);
+  atomic_set(&sim.paused, 0);
+  atomic_set(&sim.connected, 1);
+  publish_conn_event(&sim.conn, true, 0);
+
+  // The central subscribes to the notifications right away.
+  Ble::get_instance().set_subscribed(&sim.conn, true);
+  if (nus_cb && nus_cb->send_enabled) {
+    nus_cb->send_enabled(BT_NUS_SEND_STATUS_ENABLED);
+  }
+}
+
+void BtSim::disconnect(size_t central) {
+  bt_sim_central &sim = centrals[central];
+
+  atomic_set(&sim.connected, 0);
+  Ble::get_instance().set_subscribed(&sim.conn, false);
+  k_msgq_purge(&sim.tx_queue);
+  publish_conn_event(&sim.conn, false, 0);
+  Ble::get_instance().set_max_payload(&sim.conn, NUS_MIN_PAYLOAD);
+}
+
+void BtSim::set_link_rate(uint32_t bytes_per_s, size_t central) {
+  centrals[central].link_rate = bytes_per_s;
+}
+
+uint32_t BtSim::air_time_us(size_t len, size_t central) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(len + PACKET_OVERHEAD) * 1000000) / centrals[central].link_rate);
+}
+
+void BtSim::set_notify_sink(NotifySink sink, size_t central) {
+  centrals[central].notify_sink = sink;
+}
+
+bool BtSim::is_paused(size_t central) {
+  return atomic_get(&centrals[central].paused) != 0;
+}
+
+void BtSim::write(const uint8_t *data, uint16_t len, size_t central) {
+  if (nus_cb && nus_cb->received) {
+    nus_cb->received(&centrals[central].conn, data, len);
+  }
+}
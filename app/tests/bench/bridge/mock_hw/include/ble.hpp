@@ -0,0 +1,56 @@
+#ifndef _BLE_MOCK_HPP_
+#define _BLE_MOCK_HPP_
+
+#include <cstddef>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/conn.h>
+
+constexpr size_t NUS_MIN_PAYLOAD = 20;
+constexpr size_t NUS_MAX_PAYLOAD = 244;
+
+/**
+ * @brief Mock for Ble class.
+ *
+ * @details Only the negotiated payload and the subscription are mocked, per connection.
+ *          The simulated link sets them when its centrals connect.
+*/
+class Ble {
+public:
+  static Ble& get_instance() {
+    static Ble instance;
+    return instance;
+  }
+
+  Ble(const Ble&) = delete;
+  Ble& operator=(const Ble&) = delete;
+
+  size_t get_max_payload(struct bt_conn *conn) const {
+    return static_cast<size_t>(atomic_get(&links[bt_conn_index(conn)].max_payload));
+  }
+
+  bool nus_subscribed(struct bt_conn *conn) const {
+    return atomic_get(&links[bt_conn_index(conn)].subscribed) != 0;
+  }
+
+  // Mock only: set the payload of a simulated connection.
+  void set_max_payload(struct bt_conn *conn, size_t payload) {
+    atomic_set(&links[bt_conn_index(conn)].max_payload, payload);
+  }
+
+  // Mock only: set whether a simulated central enabled the notifications.
+  void set_subscribed(struct bt_conn *conn, bool enabled) {
+    atomic_set(&links[bt_conn_index(conn)].subscribed, enabled);
+  }
+
+private:
+  Ble() = default;
+
+  struct Link {
+    atomic_t max_payload{NUS_MIN_PAYLOAD};
+    atomic_t subscribed{0};
+  };
+
+  Link links[CONFIG_BT_MAX_CONN];
+};
+
+#endif // _BLE_MOCK_HPP_
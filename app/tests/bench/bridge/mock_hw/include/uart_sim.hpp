@@ -0,0 +1,35 @@
+#ifndef _UART_SIM_HPP_
+#define _UART_SIM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Simulated UART behind the Uart class.
+ *
+ * @details mock_hw/uart.cpp implements Uart without a driver, for each of the UART_COUNT
+ *          bridged UARTs. receive() stands in for the RX DMA: it fills buffers from the real
+ *          UartBufPool and posts them the way the UART callback does. The TX side drains the TX
+ *          source like the real TX engine, one CONFIG_APP_UART_TX_BUF_SIZE transfer at a time,
+ *          and hands each transfer to the TX sink of its UART once its wire time has passed.
+ *          All the UARTs run at the same baud rate. The id argument of the calls below
+ *          defaults to the first UART.
+*/
+class UartSim {
+public:
+  // Receives the bytes of every transfer once they have left the wire.
+  using TxSink = void (*)(const uint8_t *data, size_t len);
+
+  static void set_baudrate(uint32_t baudrate);
+  static uint32_t wire_time_us(size_t len);
+
+  static void set_tx_sink(TxSink sink, size_t id = 0);
+
+  // Deliver bytes from the wire. Bytes that find no free buffer are dropped and counted.
+  // Returns 0 if all bytes were accepted, otherwise -ENOMEM.
+  static int receive(const uint8_t *data, size_t len, size_t id = 0);
+
+  UartSim() = delete;
+};
+
+#endif // _UART_SIM_HPP_
@@ -0,0 +1,191 @@
+/**
+ * @file uart.cpp
+ *
+ * @brief Simulated UART implementing the Uart class from src/hw/include/uart.hpp.
+ */
+#include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "uart_sim.hpp"
+#include <cstring>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+static uint32_t baudrate = 115200;
+
+/**
+ * @brief A simulated UART, one per bridged UART.
+ *
+ * @details The TX state is only touched by the work of the UART, which runs on the
+ *          cooperative system workqueue, so tx_kick() never sees it half way through a
+ *          transfer.
+*/
+struct uart_sim_t {
+  Uart *uart;
+
+  // RX counters.
+  atomic_t rx_bytes;
+  atomic_t rx_dropped_bytes;
+
+  UartSim::TxSink tx_sink;
+  uint8_t tx_buf[CONFIG_APP_UART_TX_BUF_SIZE];
+  size_t tx_len;
+#if defined(CONFIG_APP_TRACE)
+  trace_stamp_t tx_stamp;
+#endif
+};
+
+static uart_sim_t sims[UART_COUNT];
+
+Uart::Uart(uint8_t id) : dev_(nullptr), id_(id) {
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  k_msgq_init(&rx_msgq_, reinterpret_cast<char *>(rx_msgq_buf_), sizeof(uart_rx_segment_t),
+              CONFIG_APP_UART_RX_SEGMENT_COUNT);
+#else
+  k_fifo_init(&rx_fifo_);
+#endif
+}
+
+int Uart::init() {
+  // The simulated wire runs on the delayable work, which the real UART uses for RX restarts.
+  k_work_init_delayable(&uart_work_.work, uart_work_handler);
+  uart_work_.uart = this;
+
+  sims[id_].uart = this;
+  tx_kick();
+  return 0;
+}
+
+Uart *Uart::get(size_t id) {
+  return (id < UART_COUNT) ? sims[id].uart : nullptr;
+}
+
+/**
+ * @brief Finish the transfer on the wire and start the next one.
+ *
+ * @param item The work item.
+*/
+void Uart::uart_work_handler(struct k_work *item) {
+  auto work = CONTAINER_OF(k_work_delayable_from_work(item), Work<struct k_work_delayable>, work);
+  work->uart->tx_fill();
+}
+
+void Uart::tx_fill() {
+  uart_sim_t &sim = sims[id_];
+
+  if (sim.tx_len > 0) {
+    TRACE_POINT(UART_TX_DONE, sim.tx_stamp);
+    if (sim.tx_sink) {
+      sim.tx_sink(sim.tx_buf, sim.tx_len);
+    }
+    tx_bytes_ += sim.tx_len;
+    tx_transfers_++;
+    sim.tx_len = 0;
+  }
+
+  if (!tx_source_) {
+    return;
+  }
+
+  uint32_t depth = tx_source_->depth(*this);
+  if (depth > tx_queue_high_water_) {
+    tx_queue_high_water_ = depth;
+  }
+
+  sim.tx_len = tx_source_->fill(*this, sim.tx_buf, sizeof(sim.tx_buf));
+  if (sim.tx_len > 0) {
+    // The simulated UART is always free once the previous transfer is done.
+    TRACE_STAMP(sim.tx_stamp);
+    TRACE_POINT(UART_TX_START, sim.tx_stamp);
+    k_work_schedule(&uart_work_.work, K_USEC(UartSim::wire_time_us(sim.tx_len)));
+  }
+}
+
+Uart::RxStats Uart::get_rx_stats() const {
+  return RxStats{
+    .bytes = static_cast<uint32_t>(atomic_get(&sims[id_].rx_bytes)),
+    .dropped_bytes = static_cast<uint32_t>(atomic_get(&sims[id_].rx_dropped_bytes)),
+    .restarts = 0,
+    .line_errors = 0,
+  };
+}
+
+void Uart::tx_kick() {
+  // No effect while a transfer is on the wire. The engine pulls more data when it completes.
+  k_work_schedule(&uart_work_.work, K_NO_WAIT);
+}
+
+Uart::TxStats Uart::get_tx_stats() {
+  return TxStats{
+    .bytes = tx_bytes_,
+    .transfers = tx_transfers_,
+    .idle_ms = 0,
+    .queue_depth = tx_source_ ? static_cast<uint32_t>(tx_source_->depth(*this)) : 0,
+    .queue_high_water = tx_queue_high_water_,
+    .stalls = 0,
+  };
+}
+
+void Uart::set_tx_source(const TxSource *source) {
+  tx_source_ = source;
+}
+
+void UartSim::set_baudrate(uint32_t rate) {
+  baudrate = rate;
+}
+
+uint32_t UartSim::wire_time_us(size_t len) {
+  // 8N1: 10 bits per byte.
+  return static_cast<uint32_t>((static_cast<uint64_t>(len) * 10 * 1000000) / baudrate);
+}
+
+void UartSim::set_tx_sink(TxSink sink, size_t id) {
+  sims[id].tx_sink = sink;
+}
+
+int UartSim::receive(const uint8_t *data, size_t len, size_t id) {
+  if (id >= UART_COUNT || !sims[id].uart) {
+    return -ENODEV;
+  }
+
+  uart_sim_t &sim = sims[id];
+  Uart *uart = sim.uart;
+
+  for (size_t pos = 0; pos < len;) {
+    uart_data_t *buf = UartBufPool::alloc();
+    if (!buf) {
+      atomic_add(&sim.rx_dropped_bytes, len - pos);
+      return -ENOMEM;
+    }
+
+    size_t chunk = MIN(len - pos, sizeof(buf->data));
+    memcpy(buf->data, &data[pos], chunk);
+    buf->len = chunk;
+    TRACE_STAMP(buf->stamp);
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+    // One segment for the data, then the release marker, as the UART callback posts them.
+    struct uart_rx_segment_t seg = {
+      .buf = buf,
+      .offset = 0,
+      .len = static_cast<uint16_t>(chunk),
+    };
+    TRACE_STAMP(seg.stamp);
+    if (k_msgq_put(uart->rx_queue(), &seg, K_NO_WAIT) != 0) {
+      UartBufPool::free(buf);
+      atomic_add(&sim.rx_dropped_bytes, len - pos);
+      return -ENOMEM;
+    }
+
+    seg.len = 0;
+    (void)k_msgq_put(uart->rx_queue(), &seg, K_NO_WAIT);
+#else
+    k_fifo_put(uart->rx_queue(), buf);
+#endif
+
+    atomic_add(&sim.rx_bytes, chunk);
+    pos += chunk;
+  }
+
+  return 0;
+}
@@ -0,0 +1,733 @@
+#include "bt_sim.hpp"
+#include "uart_sim.hpp"
+#include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "nus.hpp"
+#include "trace.hpp"
+#include "tasks.hpp"
+#include "compress.hpp"
+#include "channel_mux.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+// native_posix links against the host C library. Used for the host CPU cost of a run.
+#include <time.h>
+#endif
+
+constexpr size_t MSG_SIZE = CONFIG_BRIDGE_BENCH_MSG_SIZE;
+constexpr size_t MSG_COUNT = CONFIG_BRIDGE_BENCH_MSG_COUNT;
+constexpr size_t SEQ_DIGITS = 8;
+
+// Marks a message that was not sent or has already come out.
+constexpr uint64_t NOT_SENT = UINT64_MAX;
+
+// A run ends once nothing has come out of the bridge for this long.
+constexpr uint32_t DRAIN_IDLE_US = 500000;
+
+static uint64_t now_us() {
+  return k_cyc_to_us_floor64(k_cycle_get_64());
+}
+
+static uint64_t host_cpu_ns() {
+#if defined(CONFIG_ARCH_POSIX)
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Matches the messages coming out of one end of the bridge with the ones put in.
+ *
+ * @details Every message is SEQ_DIGITS hex digits of sequence number, filler and a LF. The
+ *          bridge may split and merge messages, so the output is parsed as a byte stream.
+ *          A message that comes out with the wrong length or an unknown sequence number
+ *          counts as corrupt.
+*/
+class MsgTracker {
+public:
+  void reset(size_t size) {
+    msg_size = size;
+    delivered = 0;
+    corrupt = 0;
+    bytes_out = 0;
+    hdr_len = 0;
+    msg_len = 0;
+    last_out_us = 0;
+    std::fill(std::begin(t_in), std::end(t_in), NOT_SENT);
+  }
+
+  // Build message seq into buf and stamp it. Called right before it enters the bridge.
+  void make(uint32_t seq, uint8_t *buf) {
+    char hdr[SEQ_DIGITS + 1];
+    snprintf(hdr, sizeof(hdr), "%08x", static_cast<unsigned>(seq));
+    memcpy(buf, hdr, SEQ_DIGITS);
+    for (size_t i = SEQ_DIGITS; i < msg_size - 1; ++i) {
+      buf[i] = 'a' + (seq + i) % 26;
+    }
+    buf[msg_size - 1] = '\n';
+
+    t_in[seq] = now_us();
+  }
+
+  // Feed bytes as they come out of the bridge.
+  void feed(const uint8_t *data, size_t len) {
+    uint64_t now = now_us();
+
+    for (size_t i = 0; i < len; ++i) {
+      if (data[i] == '\n') {
+        complete(now);
+        continue;
+      }
+      if (hdr_len < SEQ_DIGITS) {
+        hdr[hdr_len++] = static_cast<char>(data[i]);
+      }
+      msg_len++;
+    }
+
+    bytes_out += len;
+    last_out_us = now;
+  }
+
+  size_t msg_size{0};
+  uint32_t delivered{0};
+  uint32_t corrupt{0};
+  uint32_t bytes_out{0};
+  uint64_t last_out_us{0};
+  uint32_t latency_us[MSG_COUNT];
+  uint64_t t_in[MSG_COUNT];
+
+private:
+  void complete(uint64_t now) {
+    hdr[hdr_len] = '\0';
+    char *end;
+    unsigned long seq = strtoul(hdr, &end, 16);
+    bool valid = (hdr_len == SEQ_DIGITS) && (*end == '\0') && (msg_len + 1 == msg_size) &&
+                 (seq < MSG_COUNT) && (t_in[seq] != NOT_SENT);
+
+    if (valid) {
+      latency_us[delivered++] = static_cast<uint32_t>(now - t_in[seq]);
+      t_in[seq] = NOT_SENT;
+    } else {
+      corrupt++;
+    }
+
+    hdr_len = 0;
+    msg_len = 0;
+  }
+
+  char hdr[SEQ_DIGITS + 1];
+  size_t hdr_len{0};
+  size_t msg_len{0};
+};
+
+static MsgTracker tracker;
+
+static void tracker_sink(const uint8_t *data, size_t len) {
+  tracker.feed(data, len);
+}
+
+#if defined(CONFIG_APP_NUS_MUX)
+// Room for the record header in each write of the central.
+constexpr size_t WRITE_OVERHEAD = MUX_HDR_SIZE;
+
+// Channel of the bench component, right after those of the UARTs.
+constexpr uint8_t BENCH_CHANNEL = UART_COUNT;
+
+static MsgTracker channel_tracker;
+
+#if DT_PROP_LEN_OR(UART_BRIDGE_NODE, bridge_uarts, 1) > 1
+// The second UART, bridged with two_uarts.overlay.
+#define BENCH_UART1
+
+static MsgTracker uart1_tracker;
+
+static void uart1_tracker_sink(const uint8_t *data, size_t len) {
+  uart1_tracker.feed(data, len);
+}
+#endif
+
+/**
+ * @brief Get the tracker of a channel.
+ *
+ * @return The tracker, or nullptr for a channel the bench does not follow.
+*/
+static MsgTracker *channel_tracker_of(uint8_t channel) {
+  if (channel == 0) {
+    return &tracker;
+  }
+#if defined(BENCH_UART1)
+  if (channel == 1) {
+    return &uart1_tracker;
+  }
+#endif
+  if (channel == BENCH_CHANNEL) {
+    return &channel_tracker;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief The channel records of the notifications of the simulated central.
+ *
+ * @details Split into the data of each channel, which goes to the tracker of the channel.
+*/
+static MuxParser central_parser;
+
+static void central_channel_sink(uint8_t channel, const uint8_t *data, size_t len) {
+  MsgTracker *sink = channel_tracker_of(channel);
+  if (sink) {
+    sink->feed(data, len);
+  }
+}
+#else
+constexpr size_t WRITE_OVERHEAD = 0;
+#endif
+
+/**
+ * @brief Pass the data of the notifications to the trackers.
+*/
+static void central_data_sink(const uint8_t *data, size_t len) {
+#if defined(CONFIG_APP_NUS_MUX)
+  central_parser.feed(data, len, central_channel_sink);
+#else
+  tracker_sink(data, len);
+#endif
+}
+
+#if defined(CONFIG_APP_COMPRESS)
+/**
+ * @brief The compression of the simulated central.
+ *
+ * @details Its notifications are decompressed before the trackers, and its writes compressed
+ *          into blocks of up to one NUS payload.
+*/
+static LzDecoder central_decoder;
+static LzEncoder central_encoder;
+static uint8_t central_block[CONFIG_BRIDGE_BENCH_NUS_PAYLOAD];
+
+static void central_notify_sink(const uint8_t *data, size_t len) {
+  // A corrupt block loses its messages, which the trackers count.
+  (void)central_decoder.decode(data, len, central_data_sink);
+}
+#else
+static void central_notify_sink(const uint8_t *data, size_t len) {
+  central_data_sink(data, len);
+}
+#endif
+
+/**
+ * @brief Write a message from the simulated central.
+ *
+ * @param msg The message. With channels, it must fit one write with its record header.
+ * @param len The length of the message.
+ * @param channel The channel of the message, with channels.
+ *
+ * @return The number of bytes written over the air.
+*/
+static size_t central_write(const uint8_t *msg, size_t len, uint8_t channel = 0) {
+#if defined(CONFIG_APP_NUS_MUX)
+  static uint8_t record[CONFIG_BRIDGE_BENCH_NUS_PAYLOAD];
+  MuxWriter writer(record, sizeof(record));
+
+  zassert_equal(writer.write(channel, msg, len), len);
+  msg = record;
+  len = writer.len();
+#else
+  ARG_UNUSED(channel);
+#endif
+
+#if defined(CONFIG_APP_COMPRESS)
+  size_t written = 0;
+
+  for (size_t pos = 0; pos < len;) {
+    central_encoder.begin(central_block, sizeof(central_block));
+    pos += central_encoder.write(&msg[pos], len - pos);
+    size_t block_len = central_encoder.end();
+    BtSim::write(central_block, static_cast<uint16_t>(block_len));
+    written += block_len;
+  }
+  return written;
+#else
+  BtSim::write(msg, static_cast<uint16_t>(len));
+  return len;
+#endif
+}
+
+/**
+ * @brief Get the share of the payload bytes that went over the air.
+ *
+ * @return The percentage, 100 without compression.
+*/
+static uint32_t wire_pct(const char *dir) {
+#if defined(CONFIG_APP_COMPRESS)
+  CompressStats stats = compress_get_stats();
+  bool tx = strcmp(dir, "uart_to_ble") == 0;
+  uint64_t wire = tx ? stats.tx_out_bytes : stats.rx_in_bytes;
+  uint64_t data = tx ? stats.tx_in_bytes : stats.rx_out_bytes;
+
+  return (data > 0) ? static_cast<uint32_t>((wire * 100) / data) : 100;
+#else
+  ARG_UNUSED(dir);
+  return 100;
+#endif
+}
+
+/**
+ * @brief Wait for the bridge to deliver everything it is going to deliver to a tracker.
+*/
+static void drain(uint32_t msgs, const MsgTracker &sink = tracker) {
+  uint64_t last = now_us();
+  uint32_t bytes = sink.bytes_out;
+
+  while ((sink.delivered + sink.corrupt < msgs) && (now_us() - last < DRAIN_IDLE_US)) {
+    k_msleep(10);
+    if (sink.bytes_out != bytes) {
+      bytes = sink.bytes_out;
+      last = now_us();
+    }
+  }
+}
+
+/**
+ * @brief Sleep until the given time.
+*/
+static void sleep_until_us(uint64_t t) {
+  uint64_t now = now_us();
+  if (t > now) {
+    k_usleep(static_cast<int32_t>(t - now));
+  }
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, size_t pct) {
+  return (n > 0) ? sorted[((n - 1) * pct) / 100] : 0;
+}
+
+/**
+ * @brief Print the results of a run as one JSON line.
+ *
+ * @details The line starts with "BENCH " so it can be picked out of the test log.
+*/
+static void report(const char *dir, size_t size, uint32_t msgs, uint64_t start_us, uint64_t cpu_ns,
+                   uint32_t dropped_bytes, uint32_t queue_high_water) {
+  size_t n = tracker.delivered;
+  std::sort(tracker.latency_us, tracker.latency_us + n);
+
+  uint64_t elapsed_us = (tracker.last_out_us > start_us) ? tracker.last_out_us - start_us : 1;
+  uint32_t bytes_per_s = static_cast<uint32_t>((static_cast<uint64_t>(n) * size * 1000000) / elapsed_us);
+  uint32_t host_ns_per_byte = (tracker.bytes_out > 0) ? static_cast<uint32_t>(cpu_ns / tracker.bytes_out) : 0;
+
+  TC_PRINT("BENCH {\"dir\":\"%s\",\"zero_copy\":%d,\"rx_continuous\":%d,\"msg_size\":%u,\"msg_rate\":%u,"
+           "\"baud\":%u,\"link_rate\":%u,\"payload\":%u,\"msgs\":%u,\"delivered\":%u,\"lost\":%u,"
+           "\"corrupt\":%u,\"dropped_bytes\":%u,\"nus_tx_drops\":%u,\"bytes_per_s\":%u,\"lat_p50_us\":%u,\"lat_p99_us\":%u,"
+           "\"lat_max_us\":%u,\"pool_high_water\":%u,\"pool_capacity\":%u,\"queue_high_water\":%u,"
+           "\"host_ns_per_byte\":%u,\"compress\":%d,\"wire_pct\":%u}\n",
+           dir, IS_ENABLED(CONFIG_APP_NUS_ZERO_COPY), IS_ENABLED(CONFIG_APP_UART_RX_CONTINUOUS),
+           static_cast<unsigned>(size), CONFIG_BRIDGE_BENCH_MSG_RATE, CONFIG_BRIDGE_BENCH_UART_BAUD,
+           CONFIG_BRIDGE_BENCH_LINK_RATE, CONFIG_BRIDGE_BENCH_NUS_PAYLOAD, msgs, tracker.delivered,
+           msgs - tracker.delivered, tracker.corrupt, dropped_bytes, nus_get_tx_stats().drops, bytes_per_s,
+           percentile(tracker.latency_us, n, 50), percentile(tracker.latency_us, n, 99),
+           percentile(tracker.latency_us, n, 100), UartBufPool::get_stats().high_water,
+           UartBufPool::get_stats().capacity, queue_high_water, host_ns_per_byte,
+           IS_ENABLED(CONFIG_APP_COMPRESS), wire_pct(dir));
+}
+
+#if defined(CONFIG_APP_TRACE)
+/**
+ * @brief Print the stage histograms of a run, one "TRACE" JSON line per stage.
+*/
+static void report_trace(const char *dir) {
+  TraceStats stats;
+
+  for (size_t i = 0; i < TRACE_POINT_COUNT; ++i) {
+    TracePoint point = static_cast<TracePoint>(i);
+    trace_get(point, &stats);
+    if (stats.count == 0) {
+      continue;
+    }
+
+    TC_PRINT("TRACE {\"dir\":\"%s\",\"stage\":\"%s\",\"count\":%u,\"p50_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u}\n",
+             dir, trace_point_name(point), stats.count,
+             static_cast<uint32_t>(trace_cycles_to_ns(trace_percentile_cycles(&stats, 50))),
+             static_cast<uint32_t>(trace_cycles_to_ns(trace_percentile_cycles(&stats, 99))),
+             static_cast<uint32_t>(trace_cycles_to_ns(stats.max_cycles)));
+  }
+}
+#endif
+
+static uint32_t msg_interval_us(uint32_t wire_us) {
+  uint32_t interval = (CONFIG_BRIDGE_BENCH_MSG_RATE > 0) ? 1000000 / CONFIG_BRIDGE_BENCH_MSG_RATE : 0;
+  return MAX(interval, wire_us);
+}
+
+static void *bridge_bench_setup(void) {
+  // The NUS task registers its callbacks during init, the UART task its TX source.
+  nus_task_start();
+  uart_task_start();
+  zassert_true(BtSim::is_initialized(), "NUS task did not initialize");
+
+  UartSim::set_baudrate(CONFIG_BRIDGE_BENCH_UART_BAUD);
+  BtSim::set_link_rate(CONFIG_BRIDGE_BENCH_LINK_RATE);
+  BtSim::connect(CONFIG_BRIDGE_BENCH_NUS_PAYLOAD);
+
+  return NULL;
+}
+
+static void bridge_bench_teardown(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  BtSim::disconnect();
+}
+
+/**
+ * @brief Benchmarks the UART to BLE path.
+ *
+ * This test sends messages into the simulated UART and times them until the simulated
+ * controller has sent their last byte in a notification.
+ */
+ZTEST(bridge_bench, test_uart_to_ble)
+{
+  static uint8_t msg[MSG_SIZE];
+  uint32_t interval = msg_interval_us(UartSim::wire_time_us(MSG_SIZE));
+  uint32_t rx_dropped = Uart::get(0)->get_rx_stats().dropped_bytes;
+
+  tracker.reset(MSG_SIZE);
+  BtSim::set_notify_sink(central_notify_sink);
+#if defined(CONFIG_APP_TRACE)
+  trace_reset();
+#endif
+
+  uint64_t cpu = host_cpu_ns();
+  uint64_t start = now_us();
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    tracker.make(seq, msg);
+    (void)UartSim::receive(msg, MSG_SIZE);
+    sleep_until_us(start + static_cast<uint64_t>(seq + 1) * interval);
+  }
+  drain(MSG_COUNT);
+  cpu = host_cpu_ns() - cpu;
+
+  BtSim::set_notify_sink(nullptr);
+
+  uint32_t dropped = Uart::get(0)->get_rx_stats().dropped_bytes - rx_dropped;
+  report("uart_to_ble", MSG_SIZE, MSG_COUNT, start, cpu, dropped, 0);
+#if defined(CONFIG_APP_TRACE)
+  report_trace("uart_to_ble");
+#endif
+
+  zassert_true(tracker.delivered > 0, "nothing came out of the bridge");
+}
+
+/**
+ * @brief Benchmarks the BLE to UART path.
+ *
+ * This test writes messages from the simulated central, pausing while it is XOFFed, and times
+ * them until the simulated UART has sent their last byte. Messages are capped to one NUS write,
+ * channel record header included, and paced by the air time of what was written.
+ */
+ZTEST(bridge_bench, test_ble_to_uart)
+{
+  constexpr size_t size = MIN(MSG_SIZE, CONFIG_BRIDGE_BENCH_NUS_PAYLOAD - WRITE_OVERHEAD);
+  static uint8_t msg[size];
+  uint32_t overruns = nus_get_rx_stats().overrun_bytes;
+
+  tracker.reset(size);
+  UartSim::set_tx_sink(tracker_sink);
+#if defined(CONFIG_APP_TRACE)
+  trace_reset();
+#endif
+
+  uint64_t cpu = host_cpu_ns();
+  uint64_t start = now_us();
+  uint64_t next = start;
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    // The central holds off while it is paused.
+    while (BtSim::is_paused()) {
+      k_usleep(100);
+      next = now_us();
+    }
+
+    tracker.make(seq, msg);
+    size_t written = central_write(msg, size);
+
+    next += msg_interval_us(BtSim::air_time_us(written));
+    sleep_until_us(next);
+  }
+  drain(MSG_COUNT);
+  cpu = host_cpu_ns() - cpu;
+
+  UartSim::set_tx_sink(nullptr);
+
+  uint32_t dropped = nus_get_rx_stats().overrun_bytes - overruns;
+  report("ble_to_uart", size, MSG_COUNT, start, cpu, dropped, Uart::get(0)->get_tx_stats().queue_high_water);
+#if defined(CONFIG_APP_TRACE)
+  report_trace("ble_to_uart");
+#endif
+
+  zassert_true(tracker.delivered > 0, "nothing came out of the bridge");
+}
+
+#if defined(CONFIG_APP_NUS_BACKLOG)
+/**
+ * @brief Tests the UART to BLE path across a reconnection.
+ *
+ * This test sends messages into the simulated UART while the central is gone. Nothing may
+ * be sent until it reconnects, then every message must come out once, in order.
+ */
+ZTEST(bridge_bench, test_uart_to_ble_parked)
+{
+  static uint8_t msg[MSG_SIZE];
+  // Leave room for the record headers and whatever the UART still holds.
+  constexpr uint32_t msgs = MIN(MSG_COUNT, CONFIG_APP_NUS_BACKLOG_SIZE / 2 / MSG_SIZE);
+  uint32_t backlog_dropped = nus_get_tx_stats().backlog_dropped;
+
+  BtSim::disconnect();
+  tracker.reset(MSG_SIZE);
+  BtSim::set_notify_sink(central_notify_sink);
+
+  for (uint32_t seq = 0; seq < msgs; ++seq) {
+    tracker.make(seq, msg);
+    (void)UartSim::receive(msg, MSG_SIZE);
+    k_usleep(UartSim::wire_time_us(MSG_SIZE));
+  }
+  k_msleep(100);
+
+  zassert_equal(tracker.bytes_out, 0, "data was sent without a central");
+  zassert_true(nus_get_tx_stats().backlog_bytes > 0, "nothing was parked");
+
+  BtSim::connect(CONFIG_BRIDGE_BENCH_NUS_PAYLOAD);
+  drain(msgs);
+  BtSim::set_notify_sink(nullptr);
+
+  zassert_equal(tracker.delivered, msgs);
+  zassert_equal(tracker.corrupt, 0);
+  zassert_equal(nus_get_tx_stats().backlog_bytes, 0);
+  zassert_equal(nus_get_tx_stats().backlog_dropped, backlog_dropped);
+}
+#endif
+
+#if defined(CONFIG_APP_NUS_MUX)
+// Writes of the central to the bench channel, each with its record header in one NUS write.
+constexpr size_t CHANNEL_WRITE_SIZE = MIN(MSG_SIZE, CONFIG_BRIDGE_BENCH_NUS_PAYLOAD - WRITE_OVERHEAD);
+constexpr size_t CHANNEL_WRITES = 4;
+
+// What the simulated central wrote to the bench channel.
+static uint8_t channel_rx[CHANNEL_WRITE_SIZE * CHANNEL_WRITES];
+static size_t channel_rx_len;
+
+static void bench_channel_receive(const uint8_t *data, size_t len) {
+  size_t room = sizeof(channel_rx) - channel_rx_len;
+  memcpy(&channel_rx[channel_rx_len], data, MIN(len, room));
+  channel_rx_len += MIN(len, room);
+}
+
+static const NusChannel bench_channel = {
+  .id = BENCH_CHANNEL,
+  .receive = bench_channel_receive,
+};
+
+/**
+ * @brief Tests a registered channel next to the UART.
+ *
+ * This test registers a channel of its own and feeds it messages through nus_channel_send()
+ * while the UART receives its own. Each must reach the central on its channel, whole and in
+ * order. Then the central writes to the channel and the channel must get the data.
+ */
+ZTEST(bridge_bench, test_channel)
+{
+  static uint8_t msg[MSG_SIZE];
+  static uint8_t channel_msg[MSG_SIZE];
+  static const NusChannel uart_channel = {
+    .id = 0,
+    .receive = nullptr,
+  };
+  uint32_t interval = msg_interval_us(UartSim::wire_time_us(MSG_SIZE));
+
+  zassert_equal(nus_channel_register(&uart_channel), -EINVAL);
+  zassert_equal(nus_channel_register(&bench_channel), 0);
+  zassert_equal(nus_channel_register(&bench_channel), -EALREADY);
+
+  tracker.reset(MSG_SIZE);
+  channel_tracker.reset(MSG_SIZE);
+  BtSim::set_notify_sink(central_notify_sink);
+
+  uint64_t start = now_us();
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    tracker.make(seq, msg);
+    (void)UartSim::receive(msg, MSG_SIZE);
+    channel_tracker.make(seq, channel_msg);
+    zassert_equal(nus_channel_send(&bench_channel, channel_msg, MSG_SIZE), MSG_SIZE, "channel queue full");
+    sleep_until_us(start + static_cast<uint64_t>(seq + 1) * interval);
+  }
+  drain(MSG_COUNT);
+  // The channel may finish after the UART.
+  while ((channel_tracker.delivered + channel_tracker.corrupt < MSG_COUNT) &&
+         (now_us() - channel_tracker.last_out_us < DRAIN_IDLE_US)) {
+    k_msleep(10);
+  }
+  BtSim::set_notify_sink(nullptr);
+
+  zassert_true(tracker.delivered > 0, "nothing came out of the UART channel");
+  zassert_equal(tracker.corrupt, 0);
+  zassert_equal(channel_tracker.delivered, MSG_COUNT);
+  zassert_equal(channel_tracker.corrupt, 0);
+
+  channel_rx_len = 0;
+  for (size_t i = 0; i < CHANNEL_WRITES; ++i) {
+    for (size_t j = 0; j < CHANNEL_WRITE_SIZE; ++j) {
+      msg[j] = static_cast<uint8_t>(i * 31 + j);
+    }
+    (void)central_write(msg, CHANNEL_WRITE_SIZE, BENCH_CHANNEL);
+    zassert_mem_equal(&channel_rx[i * CHANNEL_WRITE_SIZE], msg, CHANNEL_WRITE_SIZE);
+  }
+  zassert_equal(channel_rx_len, sizeof(channel_rx));
+}
+#endif
+
+#if defined(BENCH_UART1)
+/**
+ * @brief Tests two UARTs bridged at once.
+ *
+ * This test feeds both UARTs messages at their full rate, then has the central write messages
+ * for each of them in turn. Every channel must carry the data of its UART only, whole and in
+ * order, in both directions.
+ */
+ZTEST(bridge_bench, test_two_uarts)
+{
+  constexpr size_t write_size = MIN(MSG_SIZE, CONFIG_BRIDGE_BENCH_NUS_PAYLOAD - WRITE_OVERHEAD);
+  static uint8_t msg[MSG_SIZE];
+  static uint8_t uart1_msg[MSG_SIZE];
+  uint32_t interval = msg_interval_us(UartSim::wire_time_us(MSG_SIZE));
+
+  tracker.reset(MSG_SIZE);
+  uart1_tracker.reset(MSG_SIZE);
+  BtSim::set_notify_sink(central_notify_sink);
+
+  uint64_t start = now_us();
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    tracker.make(seq, msg);
+    (void)UartSim::receive(msg, MSG_SIZE, 0);
+    uart1_tracker.make(seq, uart1_msg);
+    (void)UartSim::receive(uart1_msg, MSG_SIZE, 1);
+    sleep_until_us(start + static_cast<uint64_t>(seq + 1) * interval);
+  }
+  drain(MSG_COUNT);
+  drain(MSG_COUNT, uart1_tracker);
+  BtSim::set_notify_sink(nullptr);
+
+  zassert_true(tracker.delivered > 0, "nothing came out of UART 0");
+  zassert_equal(tracker.corrupt, 0);
+  zassert_true(uart1_tracker.delivered > 0, "nothing came out of UART 1");
+  zassert_equal(uart1_tracker.corrupt, 0);
+
+  tracker.reset(write_size);
+  uart1_tracker.reset(write_size);
+  UartSim::set_tx_sink(tracker_sink, 0);
+  UartSim::set_tx_sink(uart1_tracker_sink, 1);
+
+  uint64_t next = now_us();
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    // The central holds off while it is paused.
+    while (BtSim::is_paused()) {
+      k_usleep(100);
+      next = now_us();
+    }
+
+    tracker.make(seq, msg);
+    size_t written = central_write(msg, write_size, 0);
+    uart1_tracker.make(seq, uart1_msg);
+    written += central_write(uart1_msg, write_size, 1);
+
+    next += msg_interval_us(BtSim::air_time_us(written));
+    sleep_until_us(next);
+  }
+  drain(MSG_COUNT);
+  drain(MSG_COUNT, uart1_tracker);
+  UartSim::set_tx_sink(nullptr, 0);
+  UartSim::set_tx_sink(nullptr, 1);
+
+  zassert_true(tracker.delivered > 0, "nothing came out of UART 0");
+  zassert_equal(tracker.corrupt, 0);
+  zassert_true(uart1_tracker.delivered > 0, "nothing came out of UART 1");
+  zassert_equal(uart1_tracker.corrupt, 0);
+}
+#endif
+
+#if (CONFIG_BT_MAX_CONN > 1) && !defined(CONFIG_APP_COMPRESS) && !defined(CONFIG_APP_NUS_MUX)
+// The second central is behind a link this many times slower than the first.
+constexpr uint32_t SLOW_LINK_FACTOR = 20;
+
+// How long the slow central may take to get what it still holds once the UART is done.
+constexpr uint32_t SLOW_DRAIN_MS = 5000;
+
+static MsgTracker slow_tracker;
+
+static void slow_tracker_sink(const uint8_t *data, size_t len) {
+  slow_tracker.feed(data, len);
+}
+
+/**
+ * @brief Tests a slow central next to a fast one.
+ *
+ * This test connects a second central behind a link too slow for the UART data. The first
+ * central must get its data as if it were alone, while the second one drops its oldest
+ * notifications and still gets the newest. Once both are done, every notification must be
+ * back in the slab. Without compression or channels, since the bench decodes those for one
+ * central only.
+ */
+ZTEST(bridge_bench, test_slow_peer)
+{
+  static uint8_t msg[MSG_SIZE];
+  uint32_t interval = msg_interval_us(UartSim::wire_time_us(MSG_SIZE));
+  uint32_t fast_drops = nus_get_peer_stats(0).drops;
+
+  BtSim::set_link_rate(CONFIG_BRIDGE_BENCH_LINK_RATE / SLOW_LINK_FACTOR, 1);
+  BtSim::connect(CONFIG_BRIDGE_BENCH_NUS_PAYLOAD, 1);
+  tracker.reset(MSG_SIZE);
+  slow_tracker.reset(MSG_SIZE);
+  BtSim::set_notify_sink(tracker_sink);
+  BtSim::set_notify_sink(slow_tracker_sink, 1);
+
+  uint64_t start = now_us();
+  for (uint32_t seq = 0; seq < MSG_COUNT; ++seq) {
+    tracker.make(seq, msg);
+    slow_tracker.make(seq, msg);
+    (void)UartSim::receive(msg, MSG_SIZE);
+    sleep_until_us(start + static_cast<uint64_t>(seq + 1) * interval);
+  }
+  drain(MSG_COUNT);
+
+  for (uint32_t waited = 0; waited < SLOW_DRAIN_MS; waited += 10) {
+    NusPeerStats slow = nus_get_peer_stats(1);
+    if ((slow.queued == 0) && (slow.in_flight == 0)) {
+      break;
+    }
+    k_msleep(10);
+  }
+
+  NusPeerStats slow = nus_get_peer_stats(1);
+  BtSim::set_notify_sink(nullptr);
+  BtSim::set_notify_sink(nullptr, 1);
+  BtSim::disconnect(1);
+  BtSim::set_link_rate(CONFIG_BRIDGE_BENCH_LINK_RATE, 1);
+  k_msleep(100);
+
+  zassert_equal(nus_get_peer_stats(0).drops, fast_drops, "the slow central held up the fast one");
+  zassert_true(tracker.delivered > 0, "nothing came out of the bridge");
+  zassert_equal(tracker.corrupt, 0);
+  zassert_true(slow.drops > 0, "the slow central kept up");
+  zassert_true(slow_tracker.delivered < tracker.delivered);
+  zassert_equal(slow_tracker.t_in[MSG_COUNT - 1], NOT_SENT, "the slow central lost the newest data");
+  zassert_equal(nus_get_tx_stats().msgs_in_use, 0, "notifications were not returned to the slab");
+}
+#endif
+
+ZTEST_SUITE(bridge_bench, NULL, bridge_bench_setup, NULL, NULL, bridge_bench_teardown);
@@ -0,0 +1,240 @@
+#include "flash_log.hpp"
+
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/ztest.h>
+
+#define TEST_AREA FIXED_PARTITION_ID(storage_partition)
+
+// More than the partition holds.
+constexpr size_t DATA_SIZE = 64 * 1024;
+
+static uint8_t pattern[DATA_SIZE];
+static uint8_t out[DATA_SIZE];
+static uint8_t block[FLASH_LOG_BLOCK_SIZE];
+
+/**
+ * @brief Read and pop every block.
+ *
+ * @return The number of bytes read into out.
+*/
+static size_t drain(FlashLog &log) {
+  size_t len = 0;
+  int ret;
+
+  while ((ret = log.peek(block)) > 0) {
+    zassert_true(len + ret <= sizeof(out), "the log returned too much");
+    memcpy(&out[len], block, ret);
+    len += ret;
+    zassert_ok(log.pop());
+  }
+  zassert_equal(ret, 0);
+  zassert_true(log.empty());
+
+  return len;
+}
+
+/**
+ * @brief Append data in pieces of the given size.
+ *
+ * @return The number of bytes dropped.
+*/
+static size_t append(FlashLog &log, size_t len, size_t piece) {
+  size_t dropped = 0;
+
+  for (size_t pos = 0; pos < len; pos += piece) {
+    dropped += log.append(&pattern[pos], MIN(piece, len - pos));
+  }
+  return dropped + log.sync();
+}
+
+/**
+ * @brief Tests the order of the data.
+ *
+ * This test appends less than the partition holds in odd pieces, and checks that it comes
+ * out whole and in order, and that nothing is left.
+ */
+ZTEST(flash_log, test_order)
+{
+  FlashLog log(FlashLog::Policy::DROP_OLDEST);
+  const size_t len = 5000;
+
+  zassert_ok(log.init(TEST_AREA));
+  zassert_true(log.empty());
+
+  zassert_equal(append(log, len, 77), 0);
+  zassert_equal(log.get_stats().pending_bytes, len);
+
+  zassert_equal(drain(log), len);
+  zassert_mem_equal(out, pattern, len);
+  zassert_equal(log.get_stats().pending_bytes, 0);
+}
+
+/**
+ * @brief Tests the log across a reset.
+ *
+ * This test opens the log again, as after a reset, once after writing and once after
+ * sending part of it. Only the blocks not sent may come out, and new data goes after them.
+ */
+ZTEST(flash_log, test_persist)
+{
+  const size_t len = 3 * FLASH_LOG_BLOCK_SIZE;
+
+  {
+    FlashLog log(FlashLog::Policy::DROP_OLDEST);
+    zassert_ok(log.init(TEST_AREA));
+    zassert_equal(append(log, len, len), 0);
+  }
+
+  {
+    FlashLog log(FlashLog::Policy::DROP_OLDEST);
+    zassert_ok(log.init(TEST_AREA));
+    zassert_equal(log.get_stats().pending_blocks, 3);
+
+    // Send the first block only.
+    zassert_equal(log.peek(block), FLASH_LOG_BLOCK_SIZE);
+    zassert_mem_equal(block, pattern, FLASH_LOG_BLOCK_SIZE);
+    zassert_ok(log.pop());
+  }
+
+  FlashLog log(FlashLog::Policy::DROP_OLDEST);
+  zassert_ok(log.init(TEST_AREA));
+  zassert_equal(log.get_stats().pending_blocks, 2);
+  zassert_equal(log.append(&pattern[len], 100), 0);
+  zassert_equal(log.sync(), 0);
+
+  zassert_equal(drain(log), len - FLASH_LOG_BLOCK_SIZE + 100);
+  zassert_mem_equal(out, &pattern[FLASH_LOG_BLOCK_SIZE], len - FLASH_LOG_BLOCK_SIZE + 100);
+}
+
+/**
+ * @brief Tests a full log that drops its oldest data.
+ *
+ * This test appends more than the partition holds. What comes out must be the end of the
+ * data, and with what was dropped add up to all of it.
+ */
+ZTEST(flash_log, test_drop_oldest)
+{
+  FlashLog log(FlashLog::Policy::DROP_OLDEST);
+
+  zassert_ok(log.init(TEST_AREA));
+  size_t dropped = append(log, DATA_SIZE, 100);
+  zassert_true(dropped > 0, "the partition held everything");
+  zassert_equal(log.get_stats().dropped_bytes, dropped);
+
+  size_t len = drain(log);
+  zassert_equal(len + dropped, DATA_SIZE);
+  zassert_mem_equal(out, &pattern[dropped], len);
+}
+
+/**
+ * @brief Tests a full log that drops the new data.
+ *
+ * This test appends more than the partition holds. What comes out must be the start of the
+ * data, and with what was dropped add up to all of it. Erasing stops once the log is full.
+ */
+ZTEST(flash_log, test_drop_newest)
+{
+  FlashLog log(FlashLog::Policy::DROP_NEWEST);
+
+  zassert_ok(log.init(TEST_AREA));
+  size_t dropped = append(log, DATA_SIZE, 100);
+  zassert_true(dropped > 0, "the partition held everything");
+  uint32_t erases = log.get_stats().erases;
+
+  zassert_equal(append(log, 1000, 100), 1000);
+  zassert_equal(log.get_stats().erases, erases);
+
+  size_t len = drain(log);
+  zassert_equal(len + dropped, DATA_SIZE);
+  zassert_mem_equal(out, pattern, len);
+}
+
+/**
+ * @brief Tests a corrupt block.
+ *
+ * This test writes a block with a wrong CRC at the start of the partition, as a flash
+ * fault would leave it. The scan must skip and count it, and the log must work on.
+ */
+ZTEST(flash_log, test_corrupt)
+{
+  const struct flash_area *fa;
+  // Magic "LOG1", sequence 0, 4 data bytes, a wrong CRC and an erased sent word, then the data.
+  const uint8_t bad_block[] = {
+    0x4c, 0x4f, 0x47, 0x31, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0xff, 0xff, 0xff, 0xff, 0x01, 0x02, 0x03, 0x04,
+  };
+
+  zassert_ok(flash_area_open(TEST_AREA, &fa));
+  zassert_ok(flash_area_write(fa, 0, bad_block, sizeof(bad_block)));
+  flash_area_close(fa);
+
+  FlashLog log(FlashLog::Policy::DROP_OLDEST);
+  zassert_ok(log.init(TEST_AREA));
+  zassert_true(log.empty());
+  zassert_equal(log.get_stats().corrupt_blocks, 1);
+
+  zassert_equal(append(log, 1000, 100), 0);
+  zassert_equal(drain(log), 1000);
+  zassert_mem_equal(out, pattern, 1000);
+}
+
+/**
+ * @brief Tests a corrupt block between blocks not sent yet.
+ *
+ * This test writes a block, a corrupt one with an erased sent word after it, and after a
+ * reset a block in the next page. Reading past the corrupt block must not lose the count
+ * of the block after it.
+ */
+ZTEST(flash_log, test_corrupt_pending)
+{
+  const struct flash_area *fa;
+  // As in test_corrupt, with sequence 1, right after a block of 100 bytes.
+  const uint8_t bad_block[] = {
+    0x4c, 0x4f, 0x47, 0x31, 0x01, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0xff, 0xff, 0xff, 0xff, 0x01, 0x02, 0x03, 0x04,
+  };
+  const off_t bad_off = 16 + 100;
+
+  {
+    FlashLog log(FlashLog::Policy::DROP_OLDEST);
+    zassert_ok(log.init(TEST_AREA));
+    zassert_equal(append(log, 100, 100), 0);
+  }
+
+  zassert_ok(flash_area_open(TEST_AREA, &fa));
+  zassert_ok(flash_area_write(fa, bad_off, bad_block, sizeof(bad_block)));
+  flash_area_close(fa);
+
+  FlashLog log(FlashLog::Policy::DROP_OLDEST);
+  zassert_ok(log.init(TEST_AREA));
+  zassert_equal(log.get_stats().pending_blocks, 1);
+  zassert_equal(log.get_stats().corrupt_blocks, 1);
+  zassert_equal(log.append(&pattern[100], 100), 0);
+  zassert_equal(log.sync(), 0);
+  zassert_equal(log.get_stats().pending_blocks, 2);
+
+  zassert_equal(drain(log), 200);
+  zassert_mem_equal(out, pattern, 200);
+  zassert_equal(log.get_stats().pending_bytes, 0);
+}
+
+static void flash_log_before(void *fixture) {
+  const struct flash_area *fa;
+
+  ARG_UNUSED(fixture);
+
+  zassert_ok(flash_area_open(TEST_AREA, &fa));
+  zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+  flash_area_close(fa);
+}
+
+static void *flash_log_setup(void) {
+  for (size_t i = 0; i < DATA_SIZE; ++i) {
+    pattern[i] = static_cast<uint8_t>(i * 7 + i / 256 + 1);
+  }
+  return NULL;
+}
+
+ZTEST_SUITE(flash_log, NULL, flash_log_setup, flash_log_before, NULL, NULL);
@@ -0,0 +1,65 @@
+/**
+ * @file uart_fake.h
+ *
+ * @brief Fake asynchronous UART with RTS/CTS, bound to uart0.
+ *
+ * The fake stands in for the UARTE driver so the Uart class can run unchanged on
+ * native_posix, whose own UART has no asynchronous API. Bytes move at the configured baud
+ * rate in small steps on the system workqueue, and the events follow the order of the
+ * nRF UARTE driver. The functions below play the host on the other end of the wire.
+ */
+#ifndef _UART_FAKE_H_
+#define _UART_FAKE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/uart.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Receives the bytes the UART transmitted, as they leave the wire.
+*/
+typedef void (*uart_fake_sink_t)(const uint8_t *data, size_t len);
+
+void uart_fake_set_tx_sink(uart_fake_sink_t sink);
+
+/**
+ * @brief Set the host's RTS, seen by the UART as CTS.
+ *
+ * @details With flow control on, a transfer stops while the host is not ready and is
+ *          aborted once its timeout passes.
+*/
+void uart_fake_set_host_ready(bool ready);
+
+// Have the next count calls of uart_tx() fail with -EIO, without any event.
+void uart_fake_fail_tx(unsigned int count);
+
+/**
+ * @brief Queue bytes sent by the host.
+ *
+ * @details With flow control on, the host holds them while the UART has no RX buffer.
+ *          Without it, the bytes that find no buffer are lost and counted as overrun.
+ *          The data must stay valid until uart_fake_host_done() returns true.
+ *
+ * @return 0, or -EBUSY if the host is still sending.
+*/
+int uart_fake_host_send(const uint8_t *data, size_t len);
+
+// True once every byte queued by the host was received or lost.
+bool uart_fake_host_done(void);
+
+// Bytes lost because the UART had no RX buffer.
+uint32_t uart_fake_overrun_bytes(void);
+
+// Configuration last applied with uart_configure(), which fails while the line is busy.
+void uart_fake_get_config(struct uart_config *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UART_FAKE_H_ */
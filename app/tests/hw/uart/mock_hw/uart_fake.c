@@ -0,0 +1,384 @@
+/**
+ * @file uart_fake.c
+ *
+ * @brief Fake asynchronous UART with RTS/CTS, bound to uart0.
+ *
+ * @note This file needs to be C for DEVICE_DT_DEFINE.
+ */
+#include "uart_fake.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * @brief Bytes moved per step, like the few bytes of the UARTE FIFO.
+*/
+#define UART_FAKE_STEP 16
+
+struct uart_fake_data {
+  uart_callback_t callback;
+  void *user_data;
+  struct uart_config cfg;
+
+  // Transfer in progress.
+  const uint8_t *tx_buf;
+  size_t tx_len;
+  size_t tx_sent;
+  int64_t tx_deadline;
+  struct k_work_delayable tx_work;
+  uart_fake_sink_t tx_sink;
+  bool host_ready;
+  unsigned int tx_fail_count;
+
+  // Reception in progress and the buffer after it.
+  bool rx_enabled;
+  uint8_t *rx_buf;
+  size_t rx_size;
+  size_t rx_len;
+  size_t rx_offset;
+  uint8_t *rx_next;
+  size_t rx_next_size;
+  struct k_work_delayable rx_work;
+
+  // Bytes the host is sending.
+  const uint8_t *host_data;
+  size_t host_len;
+  size_t host_sent;
+  uint32_t overrun_bytes;
+};
+
+static struct uart_fake_data fake;
+
+static bool flow_control(void) {
+  return fake.cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS;
+}
+
+static k_timeout_t wire_time(size_t len) {
+  // 8N1: 10 bits per byte.
+  return K_USEC((len * 10 * USEC_PER_SEC) / fake.cfg.baudrate);
+}
+
+static void notify(struct uart_event *evt) {
+  if (fake.callback) {
+    fake.callback(DEVICE_DT_GET(DT_NODELABEL(uart0)), evt, fake.user_data);
+  }
+}
+
+/**
+ * @brief End the transfer in progress with the given event.
+*/
+static void tx_finish(enum uart_event_type type) {
+  struct uart_event evt = {
+    .type = type,
+    .data.tx = {
+      .buf = fake.tx_buf,
+      .len = fake.tx_sent,
+    },
+  };
+
+  // The callback may start the next transfer.
+  fake.tx_buf = NULL;
+  notify(&evt);
+}
+
+static void tx_work_handler(struct k_work *item) {
+  ARG_UNUSED(item);
+
+  if (!fake.tx_buf) {
+    return;
+  }
+
+  if (flow_control() && !fake.host_ready) {
+    if (k_uptime_ticks() >= fake.tx_deadline) {
+      tx_finish(UART_TX_ABORTED);
+    } else {
+      // uart_fake_set_host_ready() resumes it earlier.
+      k_work_reschedule(&fake.tx_work, K_TICKS(fake.tx_deadline - k_uptime_ticks()));
+    }
+    return;
+  }
+
+  size_t chunk = MIN(fake.tx_len - fake.tx_sent, UART_FAKE_STEP);
+  if (fake.tx_sink) {
+    fake.tx_sink(&fake.tx_buf[fake.tx_sent], chunk);
+  }
+  fake.tx_sent += chunk;
+
+  if (fake.tx_sent == fake.tx_len) {
+    tx_finish(UART_TX_DONE);
+  } else {
+    k_work_reschedule(&fake.tx_work, wire_time(MIN(fake.tx_len - fake.tx_sent, UART_FAKE_STEP)));
+  }
+}
+
+/**
+ * @brief Stop reception, as the UARTE does when it reaches the end of its last buffer.
+*/
+static void rx_stop(void) {
+  struct uart_event evt;
+
+  if (fake.rx_len > fake.rx_offset) {
+    evt.type = UART_RX_RDY;
+    evt.data.rx.buf = fake.rx_buf;
+    evt.data.rx.offset = fake.rx_offset;
+    evt.data.rx.len = fake.rx_len - fake.rx_offset;
+    notify(&evt);
+  }
+
+  evt.type = UART_RX_BUF_RELEASED;
+  evt.data.rx_buf.buf = fake.rx_buf;
+  notify(&evt);
+
+  if (fake.rx_next) {
+    evt.data.rx_buf.buf = fake.rx_next;
+    fake.rx_next = NULL;
+    notify(&evt);
+  }
+
+  // The callback may enable reception again.
+  fake.rx_enabled = false;
+  fake.rx_buf = NULL;
+  evt.type = UART_RX_DISABLED;
+  notify(&evt);
+}
+
+static void rx_work_handler(struct k_work *item) {
+  ARG_UNUSED(item);
+
+  size_t left = fake.host_len - fake.host_sent;
+  if (left == 0) {
+    return;
+  }
+
+  if (!fake.rx_enabled) {
+    if (!flow_control()) {
+      // Nothing holds the host off. What it sends now is lost.
+      size_t chunk = MIN(left, UART_FAKE_STEP);
+      fake.overrun_bytes += chunk;
+      fake.host_sent += chunk;
+      k_work_reschedule(&fake.rx_work, wire_time(chunk));
+    }
+    // Otherwise RTS holds the host until uart_rx_enable().
+    return;
+  }
+
+  size_t chunk = MIN(MIN(left, UART_FAKE_STEP), fake.rx_size - fake.rx_len);
+  memcpy(&fake.rx_buf[fake.rx_len], &fake.host_data[fake.host_sent], chunk);
+  fake.rx_len += chunk;
+  fake.host_sent += chunk;
+
+  struct uart_event evt = {
+    .type = UART_RX_RDY,
+    .data.rx = {
+      .buf = fake.rx_buf,
+      .offset = fake.rx_offset,
+      .len = fake.rx_len - fake.rx_offset,
+    },
+  };
+  fake.rx_offset = fake.rx_len;
+  notify(&evt);
+
+  if (fake.rx_len == fake.rx_size) {
+    if (fake.rx_next) {
+      // Switch to the next buffer and ask for another one.
+      evt.type = UART_RX_BUF_RELEASED;
+      evt.data.rx_buf.buf = fake.rx_buf;
+      fake.rx_buf = fake.rx_next;
+      fake.rx_size = fake.rx_next_size;
+      fake.rx_len = 0;
+      fake.rx_offset = 0;
+      fake.rx_next = NULL;
+      notify(&evt);
+
+      evt.type = UART_RX_BUF_REQUEST;
+      notify(&evt);
+    } else {
+      rx_stop();
+    }
+  }
+
+  k_work_reschedule(&fake.rx_work, wire_time(chunk));
+}
+
+static int uart_fake_callback_set(const struct device *dev, uart_callback_t callback, void *user_data) {
+  ARG_UNUSED(dev);
+
+  fake.callback = callback;
+  fake.user_data = user_data;
+  return 0;
+}
+
+static int uart_fake_tx(const struct device *dev, const uint8_t *buf, size_t len, int32_t timeout) {
+  ARG_UNUSED(dev);
+
+  if (fake.tx_buf) {
+    return -EBUSY;
+  }
+  if (fake.tx_fail_count > 0) {
+    fake.tx_fail_count--;
+    return -EIO;
+  }
+
+  fake.tx_buf = buf;
+  fake.tx_len = len;
+  fake.tx_sent = 0;
+  fake.tx_deadline = (timeout == SYS_FOREVER_MS) ? INT64_MAX : k_uptime_ticks() + k_ms_to_ticks_ceil64(timeout);
+  k_work_reschedule(&fake.tx_work, wire_time(MIN(len, UART_FAKE_STEP)));
+  return 0;
+}
+
+static int uart_fake_tx_abort(const struct device *dev) {
+  ARG_UNUSED(dev);
+
+  if (!fake.tx_buf) {
+    return -EFAULT;
+  }
+
+  k_work_cancel_delayable(&fake.tx_work);
+  tx_finish(UART_TX_ABORTED);
+  return 0;
+}
+
+static int uart_fake_rx_enable(const struct device *dev, uint8_t *buf, size_t len, int32_t timeout) {
+  ARG_UNUSED(dev);
+  ARG_UNUSED(timeout);
+
+  if (fake.rx_enabled) {
+    return -EBUSY;
+  }
+
+  fake.rx_enabled = true;
+  fake.rx_buf = buf;
+  fake.rx_size = len;
+  fake.rx_len = 0;
+  fake.rx_offset = 0;
+
+  struct uart_event evt = { .type = UART_RX_BUF_REQUEST };
+  notify(&evt);
+
+  // RTS is active again. Let the host go on.
+  k_work_reschedule(&fake.rx_work, K_NO_WAIT);
+  return 0;
+}
+
+static int uart_fake_rx_buf_rsp(const struct device *dev, uint8_t *buf, size_t len) {
+  ARG_UNUSED(dev);
+
+  if (!fake.rx_enabled) {
+    return -EACCES;
+  }
+  if (fake.rx_next) {
+    return -EBUSY;
+  }
+
+  fake.rx_next = buf;
+  fake.rx_next_size = len;
+  return 0;
+}
+
+static int uart_fake_rx_disable(const struct device *dev) {
+  ARG_UNUSED(dev);
+
+  if (!fake.rx_enabled) {
+    return -EFAULT;
+  }
+
+  rx_stop();
+  return 0;
+}
+
+static int uart_fake_configure(const struct device *dev, const struct uart_config *cfg) {
+  ARG_UNUSED(dev);
+
+  if ((cfg->baudrate == 0) || (cfg->flow_ctrl > UART_CFG_FLOW_CTRL_RTS_CTS)) {
+    return -ENOTSUP;
+  }
+  if (fake.tx_buf || fake.rx_enabled) {
+    // The line must be idle, as changing it would garble the bytes on the wire.
+    return -EBUSY;
+  }
+
+  fake.cfg = *cfg;
+  return 0;
+}
+
+static int uart_fake_config_get(const struct device *dev, struct uart_config *cfg) {
+  ARG_UNUSED(dev);
+
+  *cfg = fake.cfg;
+  return 0;
+}
+
+static const struct uart_driver_api uart_fake_api = {
+  .callback_set = uart_fake_callback_set,
+  .tx = uart_fake_tx,
+  .tx_abort = uart_fake_tx_abort,
+  .rx_enable = uart_fake_rx_enable,
+  .rx_buf_rsp = uart_fake_rx_buf_rsp,
+  .rx_disable = uart_fake_rx_disable,
+  .configure = uart_fake_configure,
+  .config_get = uart_fake_config_get,
+};
+
+static int uart_fake_init(const struct device *dev) {
+  ARG_UNUSED(dev);
+
+  fake.cfg = (struct uart_config){
+    .baudrate = 115200,
+    .parity = UART_CFG_PARITY_NONE,
+    .stop_bits = UART_CFG_STOP_BITS_1,
+    .data_bits = UART_CFG_DATA_BITS_8,
+    .flow_ctrl = UART_CFG_FLOW_CTRL_NONE,
+  };
+  fake.host_ready = true;
+  k_work_init_delayable(&fake.tx_work, tx_work_handler);
+  k_work_init_delayable(&fake.rx_work, rx_work_handler);
+  return 0;
+}
+
+DEVICE_DT_DEFINE(DT_NODELABEL(uart0), uart_fake_init, NULL, &fake, NULL, PRE_KERNEL_1,
+                 CONFIG_SERIAL_INIT_PRIORITY, &uart_fake_api);
+
+void uart_fake_set_tx_sink(uart_fake_sink_t sink) {
+  fake.tx_sink = sink;
+}
+
+void uart_fake_set_host_ready(bool ready) {
+  fake.host_ready = ready;
+  if (ready && fake.tx_buf) {
+    k_work_reschedule(&fake.tx_work, K_NO_WAIT);
+  }
+}
+
+void uart_fake_fail_tx(unsigned int count) {
+  fake.tx_fail_count = count;
+}
+
+int uart_fake_host_send(const uint8_t *data, size_t len) {
+  if (!uart_fake_host_done()) {
+    return -EBUSY;
+  }
+
+  fake.host_data = data;
+  fake.host_len = len;
+  fake.host_sent = 0;
+  k_work_reschedule(&fake.rx_work, K_NO_WAIT);
+  return 0;
+}
+
+bool uart_fake_host_done(void) {
+  return fake.host_sent == fake.host_len;
+}
+
+uint32_t uart_fake_overrun_bytes(void) {
+  return fake.overrun_bytes;
+}
+
+void uart_fake_get_config(struct uart_config *cfg) {
+  *cfg = fake.cfg;
+}
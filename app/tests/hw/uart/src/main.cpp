@@ -0,0 +1,342 @@
+#include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "uart_fake.h"
+
+#include <cstring>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+constexpr size_t DATA_SIZE = 4096;
+
+static uint8_t pattern[DATA_SIZE];
+static uint8_t received[DATA_SIZE];
+static size_t received_len;
+static bool received_too_much;
+
+static Uart uart(0);
+
+/**
+ * @brief TX source handing out the pattern.
+*/
+static size_t tx_pos;
+
+static size_t pattern_fill(const Uart &, uint8_t *buf, size_t size) {
+  size_t len = MIN(size, DATA_SIZE - tx_pos);
+  memcpy(buf, &pattern[tx_pos], len);
+  tx_pos += len;
+  return len;
+}
+
+static size_t pattern_depth(const Uart &) {
+  return DATA_SIZE - tx_pos;
+}
+
+static const Uart::TxSource pattern_source = {
+  .fill = pattern_fill,
+  .depth = pattern_depth,
+};
+
+/**
+ * @brief Collect received bytes. Also called from the fake UART's work, so it cannot assert.
+*/
+static void receive(const uint8_t *data, size_t len) {
+  if (received_len + len > DATA_SIZE) {
+    received_too_much = true;
+    return;
+  }
+  memcpy(&received[received_len], data, len);
+  received_len += len;
+}
+
+/**
+ * @brief Collect transmitted bytes while the host also sends.
+*/
+static uint8_t tx_received[DATA_SIZE];
+static size_t tx_received_len;
+static bool tx_received_too_much;
+
+static void tx_receive(const uint8_t *data, size_t len) {
+  if (tx_received_len + len > DATA_SIZE) {
+    tx_received_too_much = true;
+    return;
+  }
+  memcpy(&tx_received[tx_received_len], data, len);
+  tx_received_len += len;
+}
+
+/**
+ * @brief Wait until all of the pattern was received.
+*/
+static void wait_received() {
+  for (int i = 0; (i < 1000) && (received_len < DATA_SIZE); ++i) {
+    k_msleep(1);
+  }
+}
+
+/**
+ * @brief Read what the host sends from the RX segment queue.
+ *
+ * @details Returns the buffers to the pool in batches every hold_ms, as a busy consumer
+ *          would, or right away if hold_ms is 0.
+*/
+static void consume_rx(int64_t hold_ms) {
+  uart_data_t *held[CONFIG_APP_UART_BUF_COUNT];
+  size_t held_count = 0;
+  uart_data_t *current = nullptr;
+  int64_t release_at = k_uptime_get() + hold_ms;
+  int64_t end = k_uptime_get() + 5000;
+
+  while ((!uart_fake_host_done() || (received_len < DATA_SIZE)) && (k_uptime_get() < end)) {
+    struct uart_rx_segment_t seg;
+
+    if (k_uptime_get() >= release_at) {
+      for (size_t i = 0; i < held_count; ++i) {
+        UartBufPool::free(held[i]);
+      }
+      held_count = 0;
+      release_at = k_uptime_get() + hold_ms;
+    }
+
+    if (k_msgq_get(uart.rx_queue(), &seg, K_MSEC(1)) != 0) {
+      continue;
+    }
+
+    if ((seg.buf != current) && current) {
+      // The UART moved on without the release marker.
+      held[held_count++] = current;
+    }
+    current = seg.buf;
+
+    if (seg.len == 0) {
+      held[held_count++] = current;
+      current = nullptr;
+      continue;
+    }
+
+    receive(&seg.buf->data[seg.offset], seg.len);
+  }
+
+  for (size_t i = 0; i < held_count; ++i) {
+    UartBufPool::free(held[i]);
+  }
+}
+
+/**
+ * @brief Tests the line settings.
+ *
+ * This test checks that the UART runs at the Kconfig baud rate with RTS/CTS.
+ */
+ZTEST(uart_hw, test_config)
+{
+  struct uart_config cfg;
+
+  uart_fake_get_config(&cfg);
+  zassert_equal(cfg.baudrate, CONFIG_APP_UART_BAUDRATE);
+  zassert_equal(cfg.flow_ctrl, UART_CFG_FLOW_CTRL_RTS_CTS);
+}
+
+/**
+ * @brief Tests transmission held by CTS.
+ *
+ * This test stops the host several times for longer than the TX timeout while the TX engine
+ * sends the pattern, and checks that every aborted transfer resumes where it stopped.
+ */
+ZTEST(uart_hw, test_tx_stall)
+{
+  uint32_t stalls = uart.get_tx_stats().stalls;
+
+  received_len = 0;
+  received_too_much = false;
+  tx_pos = 0;
+  uart_fake_set_tx_sink(receive);
+  uart.set_tx_source(&pattern_source);
+  uart.tx_kick();
+
+  for (int i = 0; i < 4; ++i) {
+    k_usleep(700);
+    uart_fake_set_host_ready(false);
+    k_msleep(3 * CONFIG_APP_UART_TX_TIMEOUT_MS);
+    uart_fake_set_host_ready(true);
+  }
+
+  wait_received();
+  uart.set_tx_source(nullptr);
+  uart_fake_set_tx_sink(nullptr);
+
+  zassert_false(received_too_much);
+  zassert_equal(received_len, DATA_SIZE);
+  zassert_mem_equal(received, pattern, DATA_SIZE);
+  zassert_true(uart.get_tx_stats().stalls > stalls, "no transfer was held long enough");
+}
+
+/**
+ * @brief Tests reception held by RTS.
+ *
+ * This test sends the pattern from the host while the test returns the RX buffers to the
+ * pool late, so the UART runs out of them. RTS must hold the host until reception restarts.
+ */
+ZTEST(uart_hw, test_rx_hold)
+{
+  uint32_t dropped = uart.get_rx_stats().dropped_bytes;
+  uint32_t alloc_failures = UartBufPool::get_stats().alloc_failures;
+
+  received_len = 0;
+  received_too_much = false;
+  zassert_ok(uart_fake_host_send(pattern, DATA_SIZE));
+
+  consume_rx(10);
+
+  zassert_false(received_too_much);
+  zassert_equal(received_len, DATA_SIZE);
+  zassert_mem_equal(received, pattern, DATA_SIZE);
+  zassert_equal(uart_fake_overrun_bytes(), 0);
+  zassert_equal(uart.get_rx_stats().dropped_bytes, dropped);
+  zassert_true(UartBufPool::get_stats().alloc_failures > alloc_failures, "the UART never ran out of buffers");
+}
+
+/**
+ * @brief Wait until the UART runs with the given baud rate.
+*/
+static void wait_baudrate(uint32_t baudrate) {
+  struct uart_config cfg;
+
+  for (int i = 0; i < 1000; ++i) {
+    zassert_ok(uart.get_config(&cfg));
+    if (cfg.baudrate == baudrate) {
+      return;
+    }
+    k_msleep(1);
+  }
+}
+
+/**
+ * @brief Tests changing the line settings at runtime.
+ *
+ * This test reconfigures the UART while it sends the pattern and receives it from the host.
+ * The fake refuses a configuration while the line is busy, so the new baud rate only shows
+ * if the UART drained both directions first. No byte may be lost or reordered.
+ */
+ZTEST(uart_hw, test_reconfigure)
+{
+  struct uart_config old_cfg;
+  struct uart_config cfg;
+
+  zassert_ok(uart.get_config(&old_cfg));
+  cfg = old_cfg;
+  cfg.flow_ctrl = UART_CFG_FLOW_CTRL_DTR_DSR;
+  zassert_equal(uart.reconfigure(&cfg), -EINVAL);
+
+  received_len = 0;
+  received_too_much = false;
+  tx_received_len = 0;
+  tx_received_too_much = false;
+  tx_pos = 0;
+  uart_fake_set_tx_sink(tx_receive);
+  uart.set_tx_source(&pattern_source);
+  uart.tx_kick();
+  zassert_ok(uart_fake_host_send(pattern, DATA_SIZE));
+
+  // Switch while both directions are busy.
+  k_usleep(2000);
+  cfg = old_cfg;
+  cfg.baudrate = 2 * old_cfg.baudrate;
+  zassert_ok(uart.reconfigure(&cfg));
+  zassert_equal(uart.reconfigure(&cfg), -EBUSY);
+
+  consume_rx(0);
+  wait_baudrate(cfg.baudrate);
+  for (int i = 0; (i < 1000) && (tx_received_len < DATA_SIZE); ++i) {
+    k_msleep(1);
+  }
+  uart.set_tx_source(nullptr);
+  uart_fake_set_tx_sink(nullptr);
+
+  struct uart_config cur;
+  uart_fake_get_config(&cur);
+  zassert_equal(cur.baudrate, cfg.baudrate, "the UART was not idle when reconfigured");
+  zassert_false(tx_received_too_much);
+  zassert_equal(tx_received_len, DATA_SIZE);
+  zassert_mem_equal(tx_received, pattern, DATA_SIZE);
+  zassert_false(received_too_much);
+  zassert_equal(received_len, DATA_SIZE);
+  zassert_mem_equal(received, pattern, DATA_SIZE);
+  zassert_equal(uart_fake_overrun_bytes(), 0);
+
+  // Leave the UART as the other tests expect it.
+  zassert_ok(uart.reconfigure(&old_cfg));
+  wait_baudrate(old_cfg.baudrate);
+  uart_fake_get_config(&cur);
+  zassert_equal(cur.baudrate, old_cfg.baudrate);
+}
+
+/**
+ * @brief Tests transfers the driver does not take.
+ *
+ * This test has uart_tx() fail for the transfers that restart TX after a reconfiguration.
+ * No event follows such a failure, yet the reconfiguration must complete and TX must go on
+ * with the rest of the pattern, counting what was lost.
+ */
+ZTEST(uart_hw, test_tx_error)
+{
+  struct uart_config old_cfg;
+  struct uart_config cfg;
+  uint32_t lost = uart.get_tx_stats().lost_bytes;
+
+  zassert_ok(uart.get_config(&old_cfg));
+
+  tx_received_len = 0;
+  tx_received_too_much = false;
+  tx_pos = 0;
+  uart_fake_set_tx_sink(tx_receive);
+  uart.set_tx_source(&pattern_source);
+  uart.tx_kick();
+
+  // Fail the transfers after the one in flight.
+  k_usleep(2000);
+  uart_fake_fail_tx(2);
+  cfg = old_cfg;
+  cfg.baudrate = 2 * old_cfg.baudrate;
+  zassert_ok(uart.reconfigure(&cfg));
+  wait_baudrate(cfg.baudrate);
+
+  for (int i = 0; i < 1000; ++i) {
+    if (tx_received_len + (uart.get_tx_stats().lost_bytes - lost) >= DATA_SIZE) {
+      break;
+    }
+    k_msleep(1);
+  }
+  uart.set_tx_source(nullptr);
+  uart_fake_set_tx_sink(nullptr);
+  uart_fake_fail_tx(0);
+
+  struct uart_config cur;
+  uart_fake_get_config(&cur);
+  lost = uart.get_tx_stats().lost_bytes - lost;
+  zassert_equal(cur.baudrate, cfg.baudrate, "the reconfiguration did not complete");
+  zassert_false(tx_received_too_much);
+  zassert_true(lost > 0, "no transfer failed");
+  zassert_equal(tx_received_len + lost, DATA_SIZE, "TX did not go on after the failures");
+
+  // The pattern with the lost transfers cut out of it.
+  size_t gap = 0;
+  while ((gap < tx_received_len) && (tx_received[gap] == pattern[gap])) {
+    gap++;
+  }
+  zassert_mem_equal(&tx_received[gap], &pattern[gap + lost], tx_received_len - gap);
+
+  // Leave the UART as the other tests expect it.
+  zassert_ok(uart.reconfigure(&old_cfg));
+  wait_baudrate(old_cfg.baudrate);
+}
+
+static void *uart_hw_setup(void) {
+  for (size_t i = 0; i < DATA_SIZE; ++i) {
+    pattern[i] = static_cast<uint8_t>(i * 7 + i / 256);
+  }
+
+  zassert_ok(uart.init());
+  return NULL;
+}
+
+ZTEST_SUITE(uart_hw, NULL, uart_hw_setup, NULL, NULL, NULL);
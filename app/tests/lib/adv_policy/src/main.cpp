@@ -0,0 +1,64 @@
+#include "adv_policy.hpp"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+constexpr uint32_t FAST_MS = 30000;
+
+/**
+ * @brief Tests the phases with a bonded central.
+ *
+ * This test checks that directed advertising comes first, then fast and slow advertising,
+ * and that slow advertising goes on until a connection.
+ */
+ZTEST(adv_policy, test_bonded)
+{
+  AdvPolicy policy(FAST_MS);
+
+  zassert_equal(policy.phase(), AdvPolicy::Phase::NONE);
+  zassert_equal(policy.start(true), AdvPolicy::Phase::DIRECTED);
+  zassert_equal(policy.next(), AdvPolicy::Phase::FAST);
+  zassert_equal(policy.next(), AdvPolicy::Phase::SLOW);
+  zassert_equal(policy.next(), AdvPolicy::Phase::SLOW);
+  zassert_equal(policy.fast_ms(), FAST_MS);
+}
+
+/**
+ * @brief Tests the phases without a bond.
+ *
+ * This test checks that directed advertising is skipped.
+ */
+ZTEST(adv_policy, test_unbonded)
+{
+  AdvPolicy policy(FAST_MS);
+
+  zassert_equal(policy.start(false), AdvPolicy::Phase::FAST);
+  zassert_equal(policy.next(), AdvPolicy::Phase::SLOW);
+}
+
+/**
+ * @brief Tests the reconnection time.
+ *
+ * This test checks that the first connection since boot is not a reconnection, that the time
+ * from each disconnection to the next connection is returned, and that a connection ends the
+ * advertising phases.
+ */
+ZTEST(adv_policy, test_reconnect)
+{
+  AdvPolicy policy(FAST_MS);
+
+  policy.start(false);
+  zassert_equal(policy.connected(1000), -1);
+  zassert_equal(policy.phase(), AdvPolicy::Phase::NONE);
+
+  policy.disconnected(5000);
+  policy.start(true);
+  policy.next();
+  zassert_equal(policy.connected(6500), 1500);
+  zassert_equal(policy.phase(), AdvPolicy::Phase::NONE);
+
+  // Counted once.
+  zassert_equal(policy.connected(7000), -1);
+}
+
+ZTEST_SUITE(adv_policy, NULL, NULL, NULL, NULL, NULL);
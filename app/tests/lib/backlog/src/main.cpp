@@ -0,0 +1,104 @@
+#include "backlog.hpp"
+
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+// Records of up to 64 bytes.
+constexpr size_t CAPACITY = 256;
+
+static uint8_t data[1024];
+static uint8_t out[sizeof(data)];
+
+/**
+ * @brief Tests the stream order.
+ *
+ * This test checks that pieces pushed in various sizes, some larger than a record, come out
+ * as one stream whatever the size of the reads.
+ */
+ZTEST(backlog, test_order)
+{
+  Backlog<CAPACITY> backlog(Backlog<CAPACITY>::Policy::DROP_NEWEST);
+  static const size_t reads[] = {1, 5, 64, 200};
+  size_t in = 0;
+  size_t out_len = 0;
+
+  for (size_t read : reads) {
+    zassert_equal(backlog.push(&data[in], 100), 0);
+    in += 100;
+
+    size_t len;
+    while ((len = backlog.read(&out[out_len], read)) > 0) {
+      zassert_true(len <= read);
+      out_len += len;
+    }
+    zassert_true(backlog.empty());
+  }
+
+  zassert_equal(out_len, in);
+  zassert_mem_equal(out, data, in);
+}
+
+/**
+ * @brief Tests the drop-newest policy.
+ *
+ * This test fills the backlog and checks that what does not fit is dropped and counted,
+ * and that the data stored first comes out whole.
+ */
+ZTEST(backlog, test_drop_newest)
+{
+  Backlog<CAPACITY> backlog(Backlog<CAPACITY>::Policy::DROP_NEWEST);
+
+  // Three records of 64 bytes and one of 50 fill 4 * 2 + 242 = 250 bytes.
+  zassert_equal(backlog.push(data, 242), 0);
+  zassert_equal(backlog.size(), 250);
+
+  // 20 more bytes would need 22.
+  zassert_true(backlog.fits(4));
+  zassert_false(backlog.fits(20));
+  zassert_equal(backlog.push(&data[242], 20), 20);
+  zassert_equal(backlog.size(), 250);
+
+  zassert_equal(backlog.read(out, sizeof(out)), 242);
+  zassert_mem_equal(out, data, 242);
+  zassert_true(backlog.empty());
+}
+
+/**
+ * @brief Tests the drop-oldest policy.
+ *
+ * This test overfills the backlog and checks that whole records are dropped from the start,
+ * including the rest of a record being read, and that the newest data comes out in order.
+ */
+ZTEST(backlog, test_drop_oldest)
+{
+  Backlog<CAPACITY> backlog(Backlog<CAPACITY>::Policy::DROP_OLDEST);
+
+  // Four records of 60 bytes, 248 bytes in all.
+  for (size_t i = 0; i < 4; ++i) {
+    zassert_equal(backlog.push(&data[i * 60], 60), 0);
+  }
+
+  // Start reading the first record.
+  zassert_equal(backlog.read(out, 10), 10);
+  zassert_mem_equal(out, data, 10);
+
+  // The rest of the first record makes room for the new one.
+  zassert_equal(backlog.push(&data[240], 60), 50);
+
+  // A large piece replaces everything else.
+  zassert_equal(backlog.push(&data[300], 192), 4 * 60);
+
+  zassert_equal(backlog.read(out, sizeof(out)), 192);
+  zassert_mem_equal(out, &data[300], 192);
+  zassert_true(backlog.empty());
+}
+
+static void *backlog_setup(void) {
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = static_cast<uint8_t>(i * 13 + i / 256);
+  }
+  return NULL;
+}
+
+ZTEST_SUITE(backlog, NULL, backlog_setup, NULL, NULL, NULL);
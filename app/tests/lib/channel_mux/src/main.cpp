@@ -0,0 +1,159 @@
+#include "channel_mux.hpp"
+
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+static uint8_t data[1024];
+static uint8_t buf[1024];
+
+// What the sink got, per channel.
+static uint8_t got[4][sizeof(data)];
+static size_t got_len[4];
+static size_t sink_calls;
+
+static void sink(uint8_t channel, const uint8_t *piece, size_t len) {
+  zassert_true(channel < 4, "unexpected channel %u", channel);
+  zassert_true(len > 0);
+  memcpy(&got[channel][got_len[channel]], piece, len);
+  got_len[channel] += len;
+  ++sink_calls;
+}
+
+/**
+ * @brief Tests packing several channels.
+ *
+ * This test writes small pieces of three channels into one buffer and checks the records:
+ * a piece of the channel written last extends its record, any other starts a new one.
+ */
+ZTEST(channel_mux, test_pack)
+{
+  MuxWriter writer(buf, 64);
+
+  zassert_equal(writer.write(0, data, 5), 5);
+  zassert_equal(writer.write(0, &data[5], 3), 3);
+  zassert_equal(writer.write(2, &data[100], 4), 4);
+  zassert_equal(writer.write(1, &data[200], 1), 1);
+  zassert_equal(writer.len(), 3 * MUX_HDR_SIZE + 13);
+
+  zassert_equal(buf[0], 0);
+  zassert_equal(buf[1], 8);
+  zassert_mem_equal(&buf[2], data, 8);
+  zassert_equal(buf[10], 2);
+  zassert_equal(buf[11], 4);
+  zassert_mem_equal(&buf[12], &data[100], 4);
+  zassert_equal(buf[16], 1);
+  zassert_equal(buf[17], 1);
+  zassert_equal(buf[18], data[200]);
+
+  zassert_true(MuxParser::whole(buf, writer.len()));
+}
+
+/**
+ * @brief Tests a full buffer.
+ *
+ * This test writes more than the buffer holds and checks that the writer takes what fits,
+ * that a record starts only with room for data, and that records stop at MUX_MAX_RECORD.
+ */
+ZTEST(channel_mux, test_full)
+{
+  MuxWriter small(buf, 20);
+
+  zassert_equal(small.write(0, data, 10), 10);
+  // A new record has 20 - 12 - 2 bytes left for its data.
+  zassert_equal(small.write(1, data, 10), 6);
+  zassert_true(small.full());
+  zassert_equal(small.write(1, data, 10), 0);
+  zassert_equal(small.write(2, data, 10), 0);
+  zassert_equal(small.len(), 20);
+
+  MuxWriter large(buf, 600);
+
+  zassert_equal(large.write(3, data, 600), 600 - 3 * MUX_HDR_SIZE);
+  zassert_equal(buf[1], MUX_MAX_RECORD);
+  zassert_equal(buf[2 + MUX_MAX_RECORD], 3);
+  zassert_equal(buf[3 + MUX_MAX_RECORD], MUX_MAX_RECORD);
+  zassert_true(MuxParser::whole(buf, large.len()));
+}
+
+/**
+ * @brief Tests parsing a stream of records.
+ *
+ * This test packs the data of three channels, feeds the records to the parser in pieces of
+ * every size from 1 to 7 bytes, and checks that each channel gets its data back in order.
+ */
+ZTEST(channel_mux, test_parse)
+{
+  MuxWriter writer(buf, sizeof(buf));
+  size_t sent[3] = {};
+
+  for (size_t i = 0; i < 30; ++i) {
+    uint8_t channel = static_cast<uint8_t>((i * 7) % 3);
+    size_t len = (i * 11) % 40;
+    zassert_equal(writer.write(channel, &data[sent[channel]], len), len);
+    sent[channel] += len;
+  }
+
+  MuxParser parser;
+  for (size_t pos = 0, piece = 1; pos < writer.len(); piece = piece % 7 + 1) {
+    size_t len = MIN(piece, writer.len() - pos);
+    parser.feed(&buf[pos], len, sink);
+    pos += len;
+  }
+  zassert_true(parser.idle());
+
+  for (size_t channel = 0; channel < 3; ++channel) {
+    zassert_equal(got_len[channel], sent[channel]);
+    zassert_mem_equal(got[channel], data, sent[channel]);
+  }
+  zassert_equal(got_len[3], 0);
+}
+
+/**
+ * @brief Tests malformed records.
+ *
+ * This test checks that a buffer cut inside a record is not whole, that empty records reach
+ * no sink, and that a reset parser drops the rest of a record.
+ */
+ZTEST(channel_mux, test_malformed)
+{
+  const uint8_t records[] = {1, 3, 0xa, 0xb, 0xc, 2, 0, 0, 2, 0x1, 0x2};
+  MuxParser parser;
+
+  zassert_true(MuxParser::whole(records, sizeof(records)));
+  zassert_false(MuxParser::whole(records, sizeof(records) - 1));
+  zassert_false(MuxParser::whole(records, 1));
+  zassert_true(MuxParser::whole(records, 0));
+
+  parser.feed(records, sizeof(records), sink);
+  zassert_true(parser.idle());
+  zassert_equal(sink_calls, 2);
+  zassert_equal(got_len[1], 3);
+  zassert_equal(got_len[0], 2);
+  zassert_equal(got_len[2], 0);
+
+  // The data of the cut record is dropped and the next record parses.
+  parser.feed(records, 3, sink);
+  zassert_false(parser.idle());
+  parser.reset();
+  parser.feed(&records[5], 6, sink);
+  zassert_true(parser.idle());
+  zassert_equal(got_len[1], 4);
+  zassert_equal(got_len[0], 4);
+}
+
+static void channel_mux_before(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  memset(got_len, 0, sizeof(got_len));
+  sink_calls = 0;
+}
+
+static void *channel_mux_setup(void) {
+  for (size_t i = 0; i < sizeof(data); ++i) {
+    data[i] = static_cast<uint8_t>(i * 13 + i / 256);
+  }
+  return NULL;
+}
+
+ZTEST_SUITE(channel_mux, NULL, channel_mux_setup, channel_mux_before, NULL, NULL);
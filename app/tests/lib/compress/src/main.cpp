@@ -0,0 +1,212 @@
+#include "compress.hpp"
+
+#include <errno.h>
+#include <cstdio>
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+constexpr size_t BLOCK_SIZE = 244;
+
+static uint8_t input[4096];
+static uint8_t output[sizeof(input)];
+static size_t output_len;
+static uint8_t block[BLOCK_SIZE];
+
+static void sink(const uint8_t *data, size_t len) {
+  zassert_true(output_len + len <= sizeof(output), "decoder output overflows");
+  memcpy(&output[output_len], data, len);
+  output_len += len;
+}
+
+/**
+ * @brief Compress data into blocks of up to size bytes and decode every block.
+ *
+ * @param piece The largest piece written to the encoder at a time.
+ *
+ * @return The total length of the blocks.
+*/
+static size_t round_trip(LzEncoder &encoder, LzDecoder &decoder, const uint8_t *data, size_t len,
+                         size_t size, size_t piece) {
+  size_t total = 0;
+
+  for (size_t pos = 0; pos < len;) {
+    encoder.begin(block, size);
+    while ((pos < len) && !encoder.full()) {
+      pos += encoder.write(&data[pos], MIN(len - pos, piece));
+    }
+
+    size_t block_len = encoder.end();
+    zassert_true(block_len <= size, "block of %u bytes exceeds %u", block_len, size);
+    zassert_equal(decoder.decode(block, block_len, sink), 0);
+    total += block_len;
+  }
+
+  return total;
+}
+
+/**
+ * @brief Fill the input with text lines like the bridge benchmark sends.
+*/
+static void make_text(size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    size_t line = i / 40;
+    size_t col = i % 40;
+    if (col == 39) {
+      input[i] = '\n';
+    } else if (col < 8) {
+      char seq[9];
+      snprintf(seq, sizeof(seq), "%08x", static_cast<unsigned int>(line));
+      input[i] = seq[col];
+    } else {
+      input[i] = 'a' + (line + col) % 26;
+    }
+  }
+}
+
+/**
+ * @brief Tests a known block.
+ *
+ * This test checks the exact bytes of a literal followed by an overlapping match.
+ */
+ZTEST(compress, test_encode)
+{
+  LzEncoder encoder;
+  const uint8_t data[] = "aaaaaa";
+
+  encoder.begin(block, sizeof(block));
+  zassert_equal(encoder.write(data, 6), 6);
+
+  // Reset header, flags with token 1 a match, 'a', then distance 1 and length 5.
+  const uint8_t expected[] = {LZ_BLOCK_RESET, 0x02, 'a', 0x00, 5 - LZ_MIN_MATCH};
+  zassert_equal(encoder.end(), sizeof(expected));
+  zassert_mem_equal(block, expected, sizeof(expected));
+}
+
+/**
+ * @brief Tests compressing and decompressing text.
+ *
+ * This test checks the round trip of repetitive text written in pieces of various sizes, and
+ * that it shrinks.
+ */
+ZTEST(compress, test_round_trip_text)
+{
+  static const size_t pieces[] = {1, 7, 64, sizeof(input)};
+
+  make_text(sizeof(input));
+
+  for (size_t piece : pieces) {
+    LzEncoder encoder;
+    LzDecoder decoder;
+
+    output_len = 0;
+    size_t wire = round_trip(encoder, decoder, input, sizeof(input), BLOCK_SIZE, piece);
+
+    zassert_equal(output_len, sizeof(input));
+    zassert_mem_equal(output, input, sizeof(input));
+    if (piece >= 64) {
+      zassert_true(wire < sizeof(input) / 2, "text compressed to %u bytes", wire);
+    }
+  }
+}
+
+/**
+ * @brief Tests compressing and decompressing data without repeats.
+ *
+ * This test checks the round trip of pseudo random data in the smallest blocks.
+ */
+ZTEST(compress, test_round_trip_random)
+{
+  LzEncoder encoder;
+  LzDecoder decoder;
+  uint32_t x = 12345;
+
+  for (size_t i = 0; i < sizeof(input); ++i) {
+    x = x * 1103515245 + 12345;
+    input[i] = x >> 24;
+  }
+
+  output_len = 0;
+  (void)round_trip(encoder, decoder, input, sizeof(input), 4, sizeof(input));
+
+  zassert_equal(output_len, sizeof(input));
+  zassert_mem_equal(output, input, sizeof(input));
+}
+
+/**
+ * @brief Tests a new stream.
+ *
+ * This test checks that after an encoder reset the next block clears the decoder window,
+ * and that the decoder follows it.
+ */
+ZTEST(compress, test_reset)
+{
+  LzEncoder encoder;
+  LzDecoder decoder;
+
+  make_text(512);
+  output_len = 0;
+  (void)round_trip(encoder, decoder, input, 256, BLOCK_SIZE, 256);
+
+  encoder.reset();
+  encoder.begin(block, sizeof(block));
+  zassert_equal(encoder.write(&input[256], 64), 64);
+  size_t block_len = encoder.end();
+  zassert_equal(block[0], LZ_BLOCK_RESET);
+
+  output_len = 0;
+  zassert_equal(decoder.decode(block, block_len, sink), 0);
+  zassert_equal(output_len, 64);
+  zassert_mem_equal(output, &input[256], 64);
+}
+
+/**
+ * @brief Tests corrupt blocks.
+ *
+ * This test checks that a bad header, a match before the start of the stream, a truncated
+ * match and an empty block are rejected, and that a new stream is decoded again.
+ */
+ZTEST(compress, test_corrupt)
+{
+  LzDecoder decoder;
+
+  const uint8_t bad_header[] = {0x80, 0x00, 'a'};
+  zassert_equal(decoder.decode(bad_header, sizeof(bad_header), sink), -EINVAL);
+
+  const uint8_t too_far[] = {LZ_BLOCK_RESET, 0x02, 'a', 0x01, 0x00};
+  zassert_equal(decoder.decode(too_far, sizeof(too_far), sink), -EINVAL);
+
+  const uint8_t truncated[] = {LZ_BLOCK_RESET, 0x02, 'a', 0x00};
+  zassert_equal(decoder.decode(truncated, sizeof(truncated), sink), -EINVAL);
+
+  const uint8_t good[] = {LZ_BLOCK_RESET, 0x02, 'a', 0x00, 0x00};
+  zassert_equal(decoder.decode(good, 0, sink), -EINVAL);
+
+  output_len = 0;
+  zassert_equal(decoder.decode(good, sizeof(good), sink), 0);
+  zassert_equal(output_len, 4);
+  zassert_mem_equal(output, "aaaa", 4);
+}
+
+/**
+ * @brief Tests the counters.
+ *
+ * This test checks that compressed and decompressed blocks are counted.
+ */
+ZTEST(compress, test_stats)
+{
+  CompressStats before = compress_get_stats();
+
+  compress_count_tx(100, 40, 0);
+  compress_count_rx(40, 100, 0, false);
+  compress_count_rx(10, 0, 0, true);
+
+  CompressStats after = compress_get_stats();
+  zassert_equal(after.tx_in_bytes, before.tx_in_bytes + 100);
+  zassert_equal(after.tx_out_bytes, before.tx_out_bytes + 40);
+  zassert_equal(after.rx_in_bytes, before.rx_in_bytes + 50);
+  zassert_equal(after.rx_out_bytes, before.rx_out_bytes + 100);
+  zassert_equal(after.rx_errors, before.rx_errors + 1);
+}
+
+ZTEST_SUITE(compress, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,102 @@
+#include "conn_policy.hpp"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+constexpr ConnPolicy::Config CONFIG = {
+  .busy_pct = 25,
+  .idle_pct = 5,
+  .idle_ms = 1000,
+};
+
+// Sample period of the policy in the application.
+constexpr int64_t PERIOD_MS = 50;
+
+/**
+ * @brief Tests a new connection.
+ *
+ * This test checks that the central's parameters are kept while data flows below the busy
+ * level, and that a quiet link relaxes after the idle time.
+ */
+ZTEST(conn_policy, test_start)
+{
+  ConnPolicy policy(CONFIG);
+  int64_t now = 0;
+
+  policy.reset(now);
+  zassert_equal(policy.mode(), ConnPolicy::Mode::CENTRAL);
+
+  for (; now < 3000; now += PERIOD_MS) {
+    zassert_false(policy.update(10, now));
+  }
+  zassert_equal(policy.mode(), ConnPolicy::Mode::CENTRAL);
+
+  int64_t last_busy = now - PERIOD_MS;
+  for (; now < last_busy + CONFIG.idle_ms; now += PERIOD_MS) {
+    zassert_false(policy.update(0, now));
+  }
+  zassert_true(policy.update(0, now));
+  zassert_equal(policy.mode(), ConnPolicy::Mode::IDLE);
+}
+
+/**
+ * @brief Tests the switch to the fast parameters.
+ *
+ * This test checks that the first sample at the busy level switches to FAST, once.
+ */
+ZTEST(conn_policy, test_busy)
+{
+  ConnPolicy policy(CONFIG);
+
+  policy.reset(0);
+  zassert_false(policy.update(CONFIG.busy_pct - 1, 50));
+  zassert_true(policy.update(CONFIG.busy_pct, 100));
+  zassert_equal(policy.mode(), ConnPolicy::Mode::FAST);
+  zassert_false(policy.update(100, 150));
+  zassert_equal(policy.mode(), ConnPolicy::Mode::FAST);
+}
+
+/**
+ * @brief Tests the hysteresis.
+ *
+ * This test checks that a fast link stays fast while the fill is between the two levels or
+ * drops below the idle level for less than the idle time, and relaxes only after a full
+ * idle time.
+ */
+ZTEST(conn_policy, test_hysteresis)
+{
+  ConnPolicy policy(CONFIG);
+  int64_t now = 0;
+
+  policy.reset(now);
+  zassert_true(policy.update(50, now));
+
+  // Between the levels: still draining.
+  for (now += PERIOD_MS; now < 5000; now += PERIOD_MS) {
+    zassert_false(policy.update(CONFIG.idle_pct + 1, now));
+  }
+
+  // Short gaps between bursts.
+  for (int burst = 0; burst < 5; ++burst) {
+    int64_t gap = now;
+    for (; now < gap + CONFIG.idle_ms - PERIOD_MS; now += PERIOD_MS) {
+      zassert_false(policy.update(0, now));
+    }
+    zassert_false(policy.update(CONFIG.idle_pct + 1, now));
+    now += PERIOD_MS;
+  }
+  zassert_equal(policy.mode(), ConnPolicy::Mode::FAST);
+
+  int64_t last_busy = now - PERIOD_MS;
+  for (; now < last_busy + CONFIG.idle_ms; now += PERIOD_MS) {
+    zassert_false(policy.update(CONFIG.idle_pct, now));
+  }
+  zassert_true(policy.update(CONFIG.idle_pct, now));
+  zassert_equal(policy.mode(), ConnPolicy::Mode::IDLE);
+
+  // The next burst brings it back.
+  zassert_true(policy.update(CONFIG.busy_pct, now + PERIOD_MS));
+  zassert_equal(policy.mode(), ConnPolicy::Mode::FAST);
+}
+
+ZTEST_SUITE(conn_policy, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,168 @@
+#include "framing.hpp"
+
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/ztest.h>
+
+static uint8_t encoded[2 * FRAME_MAX_ENCODED];
+static uint8_t payload[FRAME_MAX_PAYLOAD];
+
+/**
+ * @brief Feed bytes to a decoder.
+ *
+ * @return The number of valid frames they completed.
+*/
+static size_t feed(FrameDecoder &decoder, const uint8_t *data, size_t len,
+                   FrameDecoder::Result *last = nullptr) {
+  size_t frames = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    FrameDecoder::Result result = decoder.feed(data[i]);
+    if (result == FrameDecoder::Result::FRAME) {
+      frames++;
+    }
+    if (last && (result != FrameDecoder::Result::MORE)) {
+      *last = result;
+    }
+  }
+
+  return frames;
+}
+
+/**
+ * @brief Tests the CRC.
+ *
+ * This test checks the frame CRC against the CRC-16/CCITT-FALSE check value.
+ */
+ZTEST(framing, test_crc)
+{
+  const uint8_t check[] = "123456789";
+
+  zassert_equal(crc16_itu_t(0xFFFF, check, 9), 0x29B1);
+}
+
+/**
+ * @brief Tests encoding a known frame.
+ *
+ * This test checks the exact bytes of a small frame.
+ */
+ZTEST(framing, test_encode)
+{
+  const uint8_t data[] = {0x11, 0x00, 0x22};
+  uint8_t header[] = {0x03, 0x00};
+  uint16_t crc = crc16_itu_t(crc16_itu_t(0xFFFF, header, sizeof(header)), data, sizeof(data));
+
+  size_t len = frame_encode(data, sizeof(data), encoded, sizeof(encoded));
+
+  // 03 00 11 00 22 crc_lo crc_hi, COBS encoded, then the delimiter.
+  uint8_t lo = crc & 0xFF;
+  uint8_t hi = crc >> 8;
+  zassert_true((lo != 0) && (hi != 0), "pick data whose CRC has no zero byte");
+  const uint8_t expected[] = {0x02, 0x03, 0x02, 0x11, 0x04, 0x22, lo, hi, 0x00};
+  zassert_equal(len, sizeof(expected));
+  zassert_mem_equal(encoded, expected, sizeof(expected));
+}
+
+/**
+ * @brief Tests encoding and decoding frames of every size.
+ *
+ * This test checks the round trip with payloads full of zeros and with runs longer than a COBS block.
+ */
+ZTEST(framing, test_round_trip)
+{
+  FrameDecoder decoder;
+
+  for (size_t len = 0; len <= FRAME_MAX_PAYLOAD; ++len) {
+    for (size_t i = 0; i < len; ++i) {
+      // Zeros every third byte, and long runs without any for the larger sizes.
+      payload[i] = ((len < 64) && (i % 3 == 0)) ? 0 : static_cast<uint8_t>(i + 1) | 1;
+    }
+
+    size_t n = frame_encode(payload, len, encoded, sizeof(encoded));
+    zassert_true((n > 0) && (n <= FRAME_MAX_ENCODED));
+    zassert_equal(encoded[n - 1], FRAME_DELIMITER);
+    zassert_is_null(memchr(encoded, FRAME_DELIMITER, n - 1), "delimiter inside frame of %u bytes", len);
+
+    zassert_equal(feed(decoder, encoded, n), 1, "frame of %u bytes not decoded", len);
+    zassert_equal(decoder.payload_len(), len);
+    zassert_mem_equal(decoder.payload(), payload, len);
+  }
+}
+
+/**
+ * @brief Tests back to back frames.
+ *
+ * This test checks that frames following each other and empty frames between them are all decoded.
+ */
+ZTEST(framing, test_back_to_back)
+{
+  FrameDecoder decoder;
+  size_t n = 0;
+
+  encoded[n++] = FRAME_DELIMITER;
+  for (uint8_t i = 0; i < 4; ++i) {
+    payload[0] = i;
+    n += frame_encode(payload, 1, &encoded[n], sizeof(encoded) - n);
+    encoded[n++] = FRAME_DELIMITER;
+  }
+
+  zassert_equal(feed(decoder, encoded, n), 4);
+}
+
+/**
+ * @brief Tests corrupted frames.
+ *
+ * This test checks that a flipped bit fails the CRC and a wrong length fails the length check,
+ * and that the next frame is decoded again.
+ */
+ZTEST(framing, test_errors)
+{
+  FrameDecoder decoder;
+  FrameDecoder::Result last = FrameDecoder::Result::MORE;
+  FrameStats before = framing_get_stats();
+
+  memset(payload, 0x5A, 16);
+  size_t n = frame_encode(payload, 16, encoded, sizeof(encoded));
+
+  // A data byte, past the first code byte and the length.
+  encoded[6] ^= 0x01;
+  zassert_equal(feed(decoder, encoded, n, &last), 0);
+  zassert_equal(last, FrameDecoder::Result::CRC_ERROR);
+  encoded[6] ^= 0x01;
+
+  // A truncated frame.
+  uint8_t truncated[] = {encoded[0], encoded[1], encoded[2], FRAME_DELIMITER};
+  zassert_equal(feed(decoder, truncated, sizeof(truncated), &last), 0);
+  zassert_equal(last, FrameDecoder::Result::LENGTH_ERROR);
+
+  zassert_equal(feed(decoder, encoded, n), 1);
+
+  FrameStats after = framing_get_stats();
+  zassert_equal(after.crc_errors, before.crc_errors + 1);
+  zassert_equal(after.length_errors, before.length_errors + 1);
+  zassert_equal(after.frames, before.frames + 1);
+}
+
+/**
+ * @brief Tests a frame that is too long.
+ *
+ * This test checks that the decoder drops it at its delimiter and decodes the next frame.
+ */
+ZTEST(framing, test_overrun)
+{
+  FrameDecoder decoder;
+  FrameDecoder::Result last = FrameDecoder::Result::MORE;
+
+  zassert_equal(frame_encode(payload, FRAME_MAX_PAYLOAD + 1, encoded, sizeof(encoded)), 0);
+
+  memset(encoded, 0x01, FRAME_MAX_ENCODED + 8);
+  encoded[FRAME_MAX_ENCODED + 8] = FRAME_DELIMITER;
+  zassert_equal(feed(decoder, encoded, FRAME_MAX_ENCODED + 9, &last), 0);
+  zassert_equal(last, FrameDecoder::Result::OVERRUN);
+
+  size_t n = frame_encode(payload, 8, encoded, sizeof(encoded));
+  zassert_equal(feed(decoder, encoded, n), 1);
+}
+
+ZTEST_SUITE(framing, NULL, NULL, NULL, NULL, NULL);
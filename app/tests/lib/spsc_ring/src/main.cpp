@@ -0,0 +1,319 @@
+#include "spsc_ring.hpp"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/ztest.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+// native_posix links against the host C library. Its simulated clock does not advance while
+// code runs, so the benchmark reads the host's monotonic clock instead.
+#include <time.h>
+#endif
+
+constexpr size_t RING_SIZE = 1024;
+
+/**
+ * @brief Bytes pushed through each queue per benchmark run.
+*/
+constexpr size_t BENCH_BYTES = 256 * 1024;
+
+/**
+ * @brief Chunk sizes measured by the benchmark.
+ *
+ * @details 1 byte is the per-call overhead, 20 the default UART buffer and 64 a bulk copy.
+*/
+constexpr size_t BENCH_CHUNKS[] = {1, 20, 64};
+constexpr size_t BENCH_MAX_CHUNK = 64;
+
+static SpscRing<RING_SIZE> ring;
+
+/**
+ * @brief Tests wrap-around.
+ *
+ * This test checks that data survives many passes over the end of the buffer with an odd write size.
+ */
+ZTEST(spsc_ring, test_wrap)
+{
+  SpscRing<16> small;
+  uint8_t in[7];
+  uint8_t out[7];
+  uint8_t next = 0;
+
+  for (int pass = 0; pass < 100; ++pass) {
+    for (size_t i = 0; i < sizeof(in); ++i) {
+      in[i] = next++;
+    }
+
+    zassert_equal(small.write(in, sizeof(in)), sizeof(in));
+    zassert_equal(small.size(), sizeof(in));
+    zassert_equal(small.read(out, sizeof(out)), sizeof(out));
+    zassert_mem_equal(in, out, sizeof(in));
+    zassert_true(small.empty());
+  }
+}
+
+/**
+ * @brief Tests a full ring.
+ *
+ * This test checks that writes are truncated once the ring is full and that nothing is lost.
+ */
+ZTEST(spsc_ring, test_full)
+{
+  SpscRing<16> small;
+  uint8_t in[20];
+  uint8_t out[20];
+
+  for (size_t i = 0; i < sizeof(in); ++i) {
+    in[i] = i;
+  }
+
+  zassert_equal(small.write(in, sizeof(in)), 16);
+  zassert_equal(small.space(), 0);
+  zassert_equal(small.write(in, 1), 0);
+  zassert_equal(small.read(out, sizeof(out)), 16);
+  zassert_mem_equal(in, out, 16);
+}
+
+/**
+ * @brief Tests the claim/commit interface.
+ *
+ * This test checks that spans stop at the end of the buffer, that uncommitted data is not visible
+ * and that a partial read commit hands the rest back on the next claim.
+ */
+ZTEST(spsc_ring, test_claim_commit)
+{
+  SpscRing<16> small;
+  uint8_t in[12];
+
+  for (size_t i = 0; i < sizeof(in); ++i) {
+    in[i] = i;
+  }
+
+  // Move the indices to offset 12 so the next write wraps.
+  zassert_equal(small.write(in, sizeof(in)), sizeof(in));
+  zassert_equal(small.read(in, sizeof(in)), sizeof(in));
+
+  auto first = small.write_claim(8);
+  zassert_equal(first.len, 4);
+  auto second = small.write_claim(4);
+  zassert_equal(second.len, 4);
+  memset(first.data, 0xA5, first.len);
+  memset(second.data, 0x5A, second.len);
+  zassert_true(small.empty());
+
+  small.write_commit(first.len + second.len);
+  zassert_equal(small.size(), 8);
+
+  auto span = small.read_claim();
+  zassert_equal(span.len, 4);
+  zassert_equal(span.data[0], 0xA5);
+  small.read_commit(2);
+
+  span = small.read_claim();
+  zassert_equal(span.len, 2);
+  small.read_commit(span.len);
+
+  span = small.read_claim();
+  zassert_equal(span.len, 4);
+  zassert_equal(span.data[0], 0x5A);
+  small.read_commit(span.len);
+  zassert_true(small.empty());
+}
+
+/**
+ * @brief Tests staged writes.
+ *
+ * This test checks that staged pieces are published together by one commit.
+ */
+ZTEST(spsc_ring, test_stage)
+{
+  SpscRing<16> small;
+  uint16_t hdr = 3;
+  uint8_t data[3] = {1, 2, 3};
+  uint8_t out[5];
+
+  zassert_equal(small.stage(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)), sizeof(hdr));
+  zassert_equal(small.stage(data, sizeof(data)), sizeof(data));
+  zassert_true(small.empty());
+
+  small.write_commit(sizeof(hdr) + sizeof(data));
+  zassert_equal(small.read(out, sizeof(out)), sizeof(out));
+  zassert_mem_equal(&out[0], &hdr, sizeof(hdr));
+  zassert_mem_equal(&out[2], data, sizeof(data));
+}
+
+#define PRODUCER_STACK_SIZE 2048
+K_THREAD_STACK_DEFINE(producer_stack, PRODUCER_STACK_SIZE);
+static struct k_thread producer_thread;
+
+constexpr size_t STREAM_BYTES = 64 * 1024;
+
+static void producer(void *, void *, void *) {
+  uint8_t chunk[13];
+  size_t sent = 0;
+
+  while (sent < STREAM_BYTES) {
+    size_t len = MIN(sizeof(chunk), STREAM_BYTES - sent);
+    for (size_t i = 0; i < len; ++i) {
+      chunk[i] = static_cast<uint8_t>(sent + i);
+    }
+
+    size_t done = 0;
+    while (done < len) {
+      done += ring.write(&chunk[done], len - done);
+      if (done < len) {
+        k_yield();
+      }
+    }
+    sent += len;
+  }
+}
+
+/**
+ * @brief Tests a producer and a consumer on separate threads.
+ *
+ * This test checks that a byte stream arrives complete and in order.
+ */
+ZTEST(spsc_ring, test_threads)
+{
+  size_t received = 0;
+
+  k_thread_create(&producer_thread, producer_stack, PRODUCER_STACK_SIZE,
+                  producer, NULL, NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+
+  while (received < STREAM_BYTES) {
+    auto span = ring.read_claim();
+    if (span.len == 0) {
+      k_yield();
+      continue;
+    }
+
+    for (size_t i = 0; i < span.len; ++i) {
+      zassert_equal(span.data[i], static_cast<uint8_t>(received + i));
+    }
+    received += span.len;
+    ring.read_commit(span.len);
+  }
+
+  k_thread_join(&producer_thread, K_FOREVER);
+  zassert_true(ring.empty());
+}
+
+// Benchmark
+
+static uint64_t bench_now_ns() {
+#if defined(CONFIG_ARCH_POSIX)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#else
+  return k_cyc_to_ns_floor64(k_cycle_get_64());
+#endif
+}
+
+K_PIPE_DEFINE(bench_pipe, RING_SIZE, 4);
+RING_BUF_DECLARE(bench_ring_buf, RING_SIZE);
+K_MSGQ_DEFINE(bench_msgq_1, 1, RING_SIZE, 1);
+K_MSGQ_DEFINE(bench_msgq_20, 20, RING_SIZE / 20, 1);
+K_MSGQ_DEFINE(bench_msgq_64, 64, RING_SIZE / 64, 1);
+
+static k_msgq* bench_msgq(size_t chunk) {
+  switch (chunk) {
+    case 1: return &bench_msgq_1;
+    case 20: return &bench_msgq_20;
+    default: return &bench_msgq_64;
+  }
+}
+
+/**
+ * @brief Queue adapters.
+ *
+ * @details Each one moves one chunk in and one chunk out. The producer and consumer run on the
+ *          same thread so only the queue cost is measured, not the scheduler.
+*/
+struct SpscCopy {
+  static constexpr const char *name = "spsc_ring";
+  static bool put_get(const uint8_t *in, uint8_t *out, size_t len) {
+    return ring.write(in, len) == len && ring.read(out, len) == len;
+  }
+};
+
+struct SpscInPlace {
+  static constexpr const char *name = "spsc_ring_claim";
+  static bool put_get(const uint8_t *in, uint8_t *, size_t len) {
+    auto span = ring.write_claim(len);
+    memcpy(span.data, in, span.len);
+    ring.write_commit(span.len);
+
+    // The consumer works on the ring memory directly.
+    span = ring.read_claim(len);
+    volatile uint8_t sink = span.data[span.len - 1];
+    (void)sink;
+    ring.read_commit(span.len);
+    return span.len == len;
+  }
+};
+
+struct Pipe {
+  static constexpr const char *name = "k_pipe";
+  static bool put_get(const uint8_t *in, uint8_t *out, size_t len) {
+    size_t done;
+    return k_pipe_put(&bench_pipe, const_cast<uint8_t*>(in), len, &done, len, K_NO_WAIT) == 0 &&
+           k_pipe_get(&bench_pipe, out, len, &done, len, K_NO_WAIT) == 0;
+  }
+};
+
+struct Msgq {
+  static constexpr const char *name = "k_msgq";
+  static bool put_get(const uint8_t *in, uint8_t *out, size_t len) {
+    k_msgq *q = bench_msgq(len);
+    return k_msgq_put(q, in, K_NO_WAIT) == 0 && k_msgq_get(q, out, K_NO_WAIT) == 0;
+  }
+};
+
+struct RingBuf {
+  static constexpr const char *name = "ring_buf";
+  static bool put_get(const uint8_t *in, uint8_t *out, size_t len) {
+    return ring_buf_put(&bench_ring_buf, in, len) == len && ring_buf_get(&bench_ring_buf, out, len) == len;
+  }
+};
+
+template<typename Queue>
+static void bench(size_t chunk) {
+  uint8_t in[BENCH_MAX_CHUNK];
+  uint8_t out[BENCH_MAX_CHUNK];
+  size_t ops = BENCH_BYTES / chunk;
+
+  for (size_t i = 0; i < chunk; ++i) {
+    in[i] = i;
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    zassert_true(Queue::put_get(in, out, chunk), "%s failed", Queue::name);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  // One line per result so the log can be grepped into a table.
+  TC_PRINT("BENCH queue=%s chunk=%u ns_per_op=%u ps_per_byte=%u\n", Queue::name,
+           static_cast<unsigned>(chunk), static_cast<unsigned>(elapsed / ops),
+           static_cast<unsigned>((elapsed * 1000) / BENCH_BYTES));
+}
+
+/**
+ * @brief Benchmarks the SPSC ring against the kernel queues.
+ *
+ * This test prints the cost of moving data through each queue for several chunk sizes.
+ */
+ZTEST(spsc_ring, test_benchmark)
+{
+  for (size_t chunk : BENCH_CHUNKS) {
+    bench<SpscCopy>(chunk);
+    bench<SpscInPlace>(chunk);
+    bench<Pipe>(chunk);
+    bench<Msgq>(chunk);
+    bench<RingBuf>(chunk);
+  }
+}
+
+ZTEST_SUITE(spsc_ring, NULL, NULL, NULL, NULL, NULL);
@@ -14,14 +14,15 @@ extern "C" {
 #endif
 
 #include <stdint.h>
-
-// \todo: I don't like how data is duplicated here from main project.
-//        Find another way to share data between main project and test project.
+#include <zephyr/sys/atomic.h>
 
 /**
  * @brief UART payload buffer element size.
+ * 
+ * @details Taken from the same Kconfig option as the application. The C++ mock
+ *          checks that this struct matches uart_buffer<UART_BUF_SIZE>.
 */
-#define UART_BUF_SIZE 20
+#define UART_BUF_SIZE CONFIG_APP_UART_BUF_SIZE
 
 /**
  * @brief UART data structure.
@@ -30,6 +31,17 @@ struct uart_data_t {
   void *fifo_reserved;
   uint8_t data[UART_BUF_SIZE];
   uint16_t len;
+  uint8_t stream;
+  atomic_t refs;
+};
+
+/**
+ * @brief Received bytes of a UART buffer. Same fields as the application's.
+*/
+struct uart_rx_segment_t {
+  struct uart_data_t *buf;
+  uint16_t offset;
+  uint16_t len;
 };
 
 #ifdef __cplusplus
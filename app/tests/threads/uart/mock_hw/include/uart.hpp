@@ -2,28 +2,91 @@
 #define _UART_MOCK_HPP_
 
 #include "uart.h"
+#include <cstddef>
 #include <cstdint>
 #include <zephyr/kernel.h>
 
+/**
+ * @brief Mock of the uart_buffer template.
+ * 
+ * @details Same layout as the application template. The C test code uses the
+ *          uart_data_t struct from uart.h, so both must stay interchangeable.
+ * 
+ * @tparam N The payload size in bytes.
+*/
+template<size_t N>
+struct uart_buffer {
+  static constexpr size_t capacity = N;
+
+  void *fifo_reserved;
+  uint8_t data[N] {};
+  uint16_t len{0};
+  uint8_t stream{0};
+  atomic_t refs{0};
+};
+
+constexpr size_t UART_PIPE_SIZE = CONFIG_APP_UART_PIPE_SIZE;
+constexpr size_t UART_COUNT = 1;
+
+static_assert(sizeof(uart_buffer<UART_BUF_SIZE>) == sizeof(uart_data_t), "mock uart_data_t does not match uart_buffer");
+static_assert(offsetof(uart_buffer<UART_BUF_SIZE>, data) == offsetof(uart_data_t, data), "mock uart_data_t does not match uart_buffer");
+static_assert(offsetof(uart_buffer<UART_BUF_SIZE>, len) == offsetof(uart_data_t, len), "mock uart_data_t does not match uart_buffer");
+static_assert(offsetof(uart_buffer<UART_BUF_SIZE>, stream) == offsetof(uart_data_t, stream), "mock uart_data_t does not match uart_buffer");
+static_assert(offsetof(uart_buffer<UART_BUF_SIZE>, refs) == offsetof(uart_data_t, refs), "mock uart_data_t does not match uart_buffer");
+
+/**
+ * @brief Queues of the received UART data, defined in mock_kernel/uart.c.
+*/
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+extern "C" struct k_msgq uart_rx_msgq;
+#else
+extern "C" struct k_fifo uart_rx_fifo;
+#endif
+
 /**
  * @brief Mock for Uart class.
  * 
  * @details This mock is used to mock the Uart class.
- *          Only the init() method is mocked.
+ *          Only the methods used by the UART task are mocked. The single UART
+ *          receives through uart_rx_msgq with continuous reception, through
+ *          uart_rx_fifo otherwise.
 */
 class Uart {
 public:
-  Uart();
+  struct TxSource {
+    size_t (*fill)(const Uart &uart, uint8_t *buf, size_t size);
+    size_t (*depth)(const Uart &uart);
+  };
+
+  explicit Uart(uint8_t id) : id_(id) {}
   int init();
-};
 
-Uart::Uart() {
-}
+  uint8_t id() const {
+    return id_;
+  }
+
+  void set_tx_source(const TxSource *source) {
+    (void)source;
+  }
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  struct k_msgq *rx_queue() {
+    return &uart_rx_msgq;
+  }
+#else
+  struct k_fifo *rx_queue() {
+    return &uart_rx_fifo;
+  }
+#endif
+
+private:
+  uint8_t id_;
+};
 
 /**
  * @brief Mock for Uart::init().
 */
-int Uart::init() {
+inline int Uart::init() {
   return 0;
 }
 
@@ -0,0 +1,48 @@
+#ifndef _UART_BUF_POOL_MOCK_HPP_
+#define _UART_BUF_POOL_MOCK_HPP_
+
+#include "uart.h"
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Mock for UartBufPool class.
+ * 
+ * @details This mock is backed by the kernel heap so that buffers allocated
+ *          with k_malloc() in the test can be released by the thread under test.
+*/
+class UartBufPool {
+public:
+  static uart_data_t* alloc();
+  static void ref(uart_data_t *buf);
+  static void free(uart_data_t *buf);
+};
+
+/**
+ * @brief Mock for UartBufPool::alloc().
+*/
+inline uart_data_t* UartBufPool::alloc() {
+  uart_data_t *buf = static_cast<uart_data_t*>(k_malloc(sizeof(*buf)));
+  if (buf) {
+    buf->len = 0;
+    atomic_set(&buf->refs, 1);
+  }
+  return buf;
+}
+
+/**
+ * @brief Mock for UartBufPool::ref().
+*/
+inline void UartBufPool::ref(uart_data_t *buf) {
+  atomic_inc(&buf->refs);
+}
+
+/**
+ * @brief Mock for UartBufPool::free(). Releases the buffer with its last reference.
+*/
+inline void UartBufPool::free(uart_data_t *buf) {
+  if (buf && (atomic_dec(&buf->refs) == 1)) {
+    k_free(buf);
+  }
+}
+
+#endif // _UART_BUF_POOL_MOCK_HPP_
@@ -3,14 +3,17 @@
  *
  * @note This file needs to be C for the test project to compile.
  */
+#include "uart.h"
 #include <zephyr/kernel.h>
 
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
 /**
- * @brief Pipes used by the UART.
+ * @brief Queue of the received UART segments.
 */
-K_PIPE_DEFINE(nus_uart_pipe, 1024, 4);
-
+K_MSGQ_DEFINE(uart_rx_msgq, sizeof(struct uart_rx_segment_t), 8, 4);
+#else
 /**
  * @brief FIFO buffer for UART data.
 */
-K_FIFO_DEFINE(uart_rx_fifo);
\ No newline at end of file
+K_FIFO_DEFINE(uart_rx_fifo);
+#endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "uart.hpp"
+#include "uart_buf_pool.hpp"
+#include "uart_nus.hpp"
+#include "tasks.hpp"
+
+#include <cstring>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+/**
+ * @brief The NUS side of the UART TX engine. Not used by the mock UART.
+*/
+const Uart::TxSource nus_uart_source = {};
+
+/**
+ * @brief Hand received bytes to the task, the way the UART driver does.
+ * 
+ * @param len The number of bytes, 0 up to len - 1.
+*/
+static void put_rx(size_t len) {
+  // The task takes ownership and releases the buffer.
+  struct uart_data_t *buf = UartBufPool::alloc();
+  zassert_not_null(buf);
+
+  for (size_t j = 0; j < len; ++j) {
+    buf->data[j] = j;
+  }
+  buf->len = len;
+
+#if defined(CONFIG_APP_UART_RX_CONTINUOUS)
+  // The bytes, then the release of the buffer.
+  struct uart_rx_segment_t seg = {buf, 0, static_cast<uint16_t>(len)};
+  zassert_true(0 == k_msgq_put(&uart_rx_msgq, &seg, K_NO_WAIT));
+  seg.len = 0;
+  zassert_true(0 == k_msgq_put(&uart_rx_msgq, &seg, K_NO_WAIT));
+#else
+  k_fifo_put(&uart_rx_fifo, buf);
+#endif
+}
+
+/**
+ * @brief Get what the task forwarded to the NUS.
+ * 
+ * @param data The buffer for the bytes.
+ * @param size The size of the buffer.
+ * 
+ * @return The number of bytes got, 0 once nothing more comes within a second.
+*/
+static size_t get_nus(uint8_t *data, size_t size) {
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+  uart_nus_item_t *item = static_cast<uart_nus_item_t *>(k_fifo_get(&uart_nus_fifo, K_SECONDS(1)));
+  if (!item) {
+    return 0;
+  }
+
+  zassert_true(item->len <= size);
+  memcpy(data, item->data, item->len);
+  size_t len = item->len;
+  atomic_sub(&uart_nus_fifo_bytes, len);
+  uart_nus_item_free(item);
+  return len;
+#else
+  if (k_sem_take(&uart_nus_sem, K_SECONDS(1)) != 0) {
+    return 0;
+  }
+  return uart_nus_rings[0].read(data, size);
+#endif
+}
+
+/**
+ * @brief Tests the uart task.
+ *
+ * This test checks if the uart task passes the received data on to the NUS correctly. The
+ * data may come in several pieces, since line mode forwards up to every line ending.
+ */
+ZTEST(uart_thread, test_uart_ring)
+{
+  uint8_t data_in[UART_BUF_SIZE];
+
+  for (size_t i = 0; i < UART_BUF_SIZE; ++i) {
+    put_rx(i + 1);
+
+    // Wait for the task to forward the data, then check it matches what was received
+    size_t bytes_read = 0;
+    while (bytes_read < i + 1) {
+      size_t len = get_nus(&data_in[bytes_read], sizeof(data_in) - bytes_read);
+      zassert_true(len > 0);
+      bytes_read += len;
+    }
+
+    zassert_true(bytes_read == i + 1);
+    for (size_t j = 0; j <= i; ++j) {
+      zassert_true(data_in[j] == j);
+    }
+#if defined(CONFIG_APP_NUS_ZERO_COPY)
+    zassert_true(atomic_get(&uart_nus_fifo_bytes) == 0);
+#else
+    zassert_true(uart_nus_rings[0].empty());
+#endif
+  }
+}
+
+static void *uart_thread_setup(void) {
+  uart_task_start();
+  return NULL;
+}
+
+ZTEST_SUITE(uart_thread, NULL, uart_thread_setup, NULL, NULL, NULL);
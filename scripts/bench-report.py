@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Collect the results of the bridge benchmark from a twister output directory.
+
+Every benchmark scenario prints one "BENCH {...}" JSON line per direction. This script
+gathers them into one JSON document keyed by "<scenario>/<dir>". With --baseline it
+compares the results against a previous run and exits non-zero on a regression.
+
+    west twister -T app/tests/bench
+    python3 scripts/bench-report.py twister-out --save bench.json
+    python3 scripts/bench-report.py twister-out --baseline bench.json
+"""
+
+import argparse
+import json
+import os
+import sys
+
+# Metrics checked against the baseline and whether a higher value is better.
+METRICS = {
+    "bytes_per_s": True,
+    "lat_p50_us": False,
+    "lat_p99_us": False,
+    "lost": False,
+    "pool_high_water": False,
+}
+
+def collect(outdir):
+    results = {}
+    for root, _, files in os.walk(outdir):
+        if "handler.log" not in files:
+            continue
+        scenario = os.path.basename(root)
+        with open(os.path.join(root, "handler.log"), errors="replace") as log:
+            for line in log:
+                pos = line.find("BENCH {")
+                if pos < 0:
+                    continue
+                result = json.loads(line[pos + len("BENCH "):])
+                results[f"{scenario}/{result['dir']}"] = result
+    return results
+
+def compare(results, baseline, tolerance):
+    regressions = []
+    for key, base in sorted(baseline.items()):
+        if key not in results:
+            regressions.append(f"{key}: missing")
+            continue
+        for metric, higher_is_better in METRICS.items():
+            old = base.get(metric)
+            new = results[key].get(metric)
+            if old is None or new is None:
+                continue
+            slack = max(abs(old) * tolerance / 100, 1)
+            worse = (new < old - slack) if higher_is_better else (new > old + slack)
+            if worse:
+                regressions.append(f"{key}: {metric} {old} -> {new}")
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(description="Collect bridge benchmark results")
+    parser.add_argument("outdir", help="twister output directory")
+    parser.add_argument("--save", help="write the results to this file")
+    parser.add_argument("--baseline", help="compare against the results in this file")
+    parser.add_argument("--tolerance", type=float, default=10.0,
+                        help="allowed change against the baseline in percent (default 10)")
+    args = parser.parse_args()
+
+    results = collect(args.outdir)
+    if not results:
+        print(f"No benchmark results found in {args.outdir}")
+        sys.exit(1)
+
+    for key, result in sorted(results.items()):
+        print(f"{key:60} {result['bytes_per_s']:>8} B/s  p50 {result['lat_p50_us']:>7} us  "
+              f"p99 {result['lat_p99_us']:>7} us  lost {result['lost']}")
+
+    if args.save:
+        with open(args.save, "w") as out:
+            json.dump(results, out, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as base:
+            regressions = compare(results, json.load(base), args.tolerance)
+        for regression in regressions:
+            print(f"REGRESSION {regression}")
+        if regressions:
+            sys.exit(1)
+
+if __name__ == "__main__":
+    main()